@@ -101,8 +101,11 @@ public:
      * @param rgb
      * @param depth
      * @param ptcl
+     * @param organized if true, ptcl is replaced by an organized cloud of the whole frame (width x height,
+     * NaN points for the invalid depths, x along the columns and y along the rows), as expected by the image space
+     * crop of SupervoxelSet. Otherwise the valid points are appended to ptcl, as the dataset always did.
      */
-    void rgbd_to_pointcloud(const cv::Mat &rgb, const cv::Mat &depth, PointCloudT::Ptr ptcl);
+    void rgbd_to_pointcloud(const cv::Mat &rgb, const cv::Mat &depth, PointCloudT::Ptr ptcl, bool organized = false);
 
     //GETTERS
     /**
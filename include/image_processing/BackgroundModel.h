@@ -0,0 +1,70 @@
+#ifndef BACKGROUND_MODEL_H
+#define BACKGROUND_MODEL_H
+
+#include <unordered_map>
+#include <vector>
+#include <Eigen/Core>
+#include <boost/shared_ptr.hpp>
+#include "pcl_types.h"
+
+namespace image_processing {
+
+/**
+ * @brief The BackgroundModel class
+ * Background points bucketed in a regular grid whose cells have the size of the distance threshold,
+ * stored in a hash map from cell keys to the points of the cell.
+ * Built once (e.g. per session) and reused to remove the background of the following frames.
+ * A point is background if it is within the threshold of a background point, so only the 27 cells
+ * around it have to be searched.
+ */
+class BackgroundModel {
+public:
+
+    typedef boost::shared_ptr<BackgroundModel> Ptr;
+    typedef boost::shared_ptr<const BackgroundModel> ConstPtr;
+
+    /**
+     * @param resolution distance threshold, also the size of the cells. The default is 1cm.
+     */
+    BackgroundModel(float resolution = 0.01f) :
+        _resolution(resolution), _sq_resolution(resolution*resolution), _inv_res(1.f/resolution){}
+
+    /**
+     * @brief add the points of a cloud to the model
+     * @param background
+     */
+    void add(const PointCloudT& background);
+
+    void clear(){_cells.clear(); _size = 0;}
+    bool empty() const {return _cells.empty();}
+
+    /**
+     * @brief number of background points
+     */
+    size_t size() const {return _size;}
+
+    float get_resolution() const {return _resolution;}
+
+    /**
+     * @brief is the position within the resolution of a background point ?
+     */
+    bool contain(float x, float y, float z) const;
+
+    /**
+     * @brief copy the finite points of input which are not background into output, in parallel and keeping their order
+     * @param input
+     * @param output
+     */
+    void filter(const PointCloudT& input, PointCloudT& output) const;
+
+private:
+    float _resolution;
+    float _sq_resolution;
+    float _inv_res;
+    size_t _size = 0;
+    std::unordered_map<uint64_t,std::vector<Eigen::Vector3f>> _cells;
+};
+
+}
+
+#endif //BACKGROUND_MODEL_H
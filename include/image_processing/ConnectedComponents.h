@@ -0,0 +1,71 @@
+#ifndef CONNECTED_COMPONENTS_H
+#define CONNECTED_COMPONENTS_H
+
+#include <vector>
+#include <cstdint>
+#include "FlatSupervoxelArray.h"
+
+namespace image_processing {
+
+/**
+ * @brief The ConnectedComponents class
+ * Connected components of the subgraph of a FlatSupervoxelArray induced by a mask of supervoxels.
+ * The components are computed with a concurrent union-find over the adjacency, parallelized over the supervoxels,
+ * without recursion. They are numbered by their smallest supervoxel index (i.e. by their smallest label) and
+ * their members are stored contiguously by increasing index, the members of component c being in
+ * [members_begin(c),members_end(c)).
+ * An instance keeps its memory so it can be reused across computations.
+ */
+class ConnectedComponents {
+public:
+
+    /**
+     * @brief compute the components of the supervoxels i such that mask[i] is true
+     * @param svs
+     * @param mask one value per supervoxel of svs
+     */
+    void compute(const FlatSupervoxelArray& svs, const std::vector<char>& mask);
+
+    void clear();
+
+    /**
+     * @brief number of components
+     */
+    size_t size() const {return _first.size();}
+    bool empty() const {return _first.empty();}
+
+    /**
+     * @brief component of the supervoxel of index i
+     * @return -1 if the supervoxel is not in the mask
+     */
+    int component(size_t i) const {return _component[i];}
+    const std::vector<int>& components() const {return _component;}
+
+    /**
+     * @brief smallest supervoxel index of the component c
+     */
+    int first(size_t c) const {return _members[_first[c]];}
+
+    /**
+     * @brief indices of the supervoxels of the component c
+     */
+    const int* members_begin(size_t c) const {return _members.data() + _first[c];}
+    const int* members_end(size_t c) const {return _members.data() + (c + 1 < _first.size() ? _first[c+1] : _members.size());}
+    size_t nbr_members(size_t c) const {return members_end(c) - members_begin(c);}
+
+    /**
+     * @brief labels of the supervoxels of the component c, in increasing order
+     */
+    const uint32_t* labels_begin(size_t c) const {return _labels.data() + _first[c];}
+    const uint32_t* labels_end(size_t c) const {return _labels.data() + (c + 1 < _first.size() ? _first[c+1] : _labels.size());}
+
+private:
+    std::vector<int> _component;
+    std::vector<int> _first;
+    std::vector<int> _members;
+    std::vector<uint32_t> _labels;
+};
+
+}
+
+#endif //CONNECTED_COMPONENTS_H
@@ -0,0 +1,141 @@
+#ifndef FEATURE_STORE_H
+#define FEATURE_STORE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <Eigen/Core>
+
+namespace image_processing {
+
+/**
+ * @brief The FeatureStore class
+ * Features of a set of supervoxels. Each modality is interned once to an integer id and its features are stored
+ * in one row-major matrix (one row per supervoxel, one column per dimension).
+ * The rows follow the order of a list of labels (usually the order of the FlatSupervoxelArray of the set).
+ * The const methods do not modify the store and can be called concurrently, e.g. to score all the supervoxels in parallel.
+ * They resolve the modality names with an index of the store filled at allocation, not with the global registry,
+ * so they do not contend on its lock.
+ */
+class FeatureStore {
+public:
+
+    typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> matrix_t;
+    typedef Eigen::Map<const Eigen::VectorXd> const_row_t;
+
+    /**
+     * @brief integer id of a modality. The ids are global and never change once given.
+     * @param modality
+     * @return id
+     */
+    static int modality_id(const std::string& modality);
+
+    /**
+     * @brief name of the modality of a given id
+     */
+    static const std::string& modality_name(int id);
+
+    /**
+     * @brief set the labels associated to the rows. The features of the labels already present are kept,
+     * the rows of the new labels are set to zero.
+     * @param labels
+     */
+    void set_labels(const std::vector<uint32_t>& labels);
+
+    const std::vector<uint32_t>& labels() const {return _labels;}
+
+    /**
+     * @brief remove all features and labels
+     */
+    void clear();
+
+    size_t size() const {return _labels.size();}
+    bool empty() const {return _labels.empty();}
+
+    /**
+     * @brief row of a label
+     * @return -1 if the label has no row
+     */
+    int row(uint32_t label) const {return label < _rows.size() ? _rows[label] : -1;}
+
+    /**
+     * @brief is the modality computed ?
+     */
+    bool has(int id) const {return id >= 0 && id < _present.size() && _present[id];}
+    bool has(const std::string& modality) const {return has(local_id(modality));}
+
+    /**
+     * @brief make room for the given modalities. Afterwards they can be allocated and written concurrently,
+     * one task per modality.
+     * @param ids
+     */
+    void reserve(const std::vector<int>& ids);
+
+    /**
+     * @brief allocate the matrix of a modality with one row per label, filled with zeros.
+     * Rows can then be written concurrently.
+     * @param id
+     * @param dim dimension of the features
+     * @return the matrix of the modality
+     */
+    matrix_t& allocate(int id, int dim);
+    matrix_t& allocate(const std::string& modality, int dim){return allocate(modality_id(modality),dim);}
+
+    /**
+     * @brief matrix of a modality. It must have been allocated.
+     */
+    const matrix_t& matrix(int id) const {return _data[id];}
+
+    int dimension(int id) const {return _data[id].cols();}
+
+    /**
+     * @brief view on the feature of a row
+     */
+    const_row_t feature(int id, size_t row) const {
+        return const_row_t(_data[id].data() + row*_data[id].cols(),_data[id].cols());
+    }
+
+    /**
+     * @brief copy of the feature of a label
+     * @return an empty vector if the label or the modality is unknown
+     */
+    Eigen::VectorXd get(uint32_t label, const std::string& modality) const;
+
+    /**
+     * @brief all the features of a label indexed by modality name
+     */
+    std::map<std::string,Eigen::VectorXd> get_all(uint32_t label) const;
+
+    /**
+     * @brief set the feature of a label. A row is added if the label is unknown and the modality is allocated
+     * if it is not yet.
+     * @return false if the dimension of the feature does not match the one of the modality
+     */
+    bool set(uint32_t label, const std::string& modality, const Eigen::VectorXd& feature);
+
+private:
+    /**
+     * @brief id of a modality reserved or allocated in this store, without locking the registry
+     * @return -1 if the modality is unknown to the store
+     */
+    int local_id(const std::string& modality) const {
+        auto it = _ids.find(modality);
+        return it == _ids.end() ? -1 : it->second;
+    }
+
+    /**
+     * @brief resolve the name of a modality in _names and _ids
+     */
+    void add_name(int id);
+
+    std::vector<uint32_t> _labels;
+    std::vector<int> _rows;
+    std::vector<matrix_t> _data;
+    std::vector<char> _present;
+    std::vector<const std::string*> _names;
+    std::map<std::string,int> _ids;
+};
+
+}
+
+#endif //FEATURE_STORE_H
@@ -0,0 +1,171 @@
+#ifndef FLAT_SUPERVOXEL_ARRAY_H
+#define FLAT_SUPERVOXEL_ARRAY_H
+
+#include <vector>
+#include <algorithm>
+#include <Eigen/Core>
+#include <pcl/kdtree/kdtree_flann.h>
+#include "pcl_types.h"
+
+namespace image_processing {
+
+/**
+ * @brief The FlatSupervoxelArray class
+ * Structure of arrays version of a SupervoxelArray and its AdjacencyMap.
+ * Supervoxels are indexed from 0 to size()-1 by increasing label. The voxels (and normals) of all the supervoxels
+ * are stored in one contiguous cloud, the voxels of supervoxel i being in [voxel_offset(i),voxel_offset(i+1)).
+ * The adjacency is stored in compressed rows of indices.
+ */
+class FlatSupervoxelArray {
+public:
+
+    FlatSupervoxelArray() :
+        _voxels(new PointCloudT), _normals(new PointCloudN),
+        _centroids(new PointCloudT), _centroid_normals(new PointCloudN){}
+
+    /**
+     * @brief fill this with a set of supervoxels and their adjacency. Neighbors which are not in supervoxels are ignored.
+     * @param supervoxels
+     * @param adjacency
+     */
+    void build(const SupervoxelArray& supervoxels, const AdjacencyMap& adjacency);
+
+    void clear();
+
+    size_t size() const {return _labels.size();}
+    bool empty() const {return _labels.empty();}
+
+    /**
+     * @brief label of the supervoxel of index i
+     */
+    uint32_t label(size_t i) const {return _labels[i];}
+    const std::vector<uint32_t>& labels() const {return _labels;}
+
+    /**
+     * @brief index of a supervoxel from its label
+     * @return -1 if there is no supervoxel with this label
+     */
+    int index(uint32_t label) const {return label < _index.size() ? _index[label] : -1;}
+
+    bool contain(uint32_t label) const {return index(label) >= 0;}
+
+    const PointT& centroid(size_t i) const {return _centroids->points[i];}
+    const pcl::Normal& normal(size_t i) const {return _centroid_normals->points[i];}
+
+    size_t voxel_offset(size_t i) const {return _offsets[i];}
+    size_t nbr_voxels(size_t i) const {return _offsets[i+1] - _offsets[i];}
+    const PointT* voxels_begin(size_t i) const {return _voxels->points.data() + _offsets[i];}
+    const PointT* voxels_end(size_t i) const {return _voxels->points.data() + _offsets[i+1];}
+    const pcl::Normal* normals_begin(size_t i) const {return _normals->points.data() + _offsets[i];}
+    const pcl::Normal* normals_end(size_t i) const {return _normals->points.data() + _offsets[i+1];}
+
+    /**
+     * @brief indices of the neighbors of the supervoxel i
+     */
+    const int* neighbors_begin(size_t i) const {return _neighbors.data() + _neighbor_offsets[i];}
+    const int* neighbors_end(size_t i) const {return _neighbors.data() + _neighbor_offsets[i+1];}
+    size_t nbr_neighbors(size_t i) const {return _neighbor_offsets[i+1] - _neighbor_offsets[i];}
+
+    /**
+     * @brief contiguous clouds of all the voxels and their normals
+     */
+    PointCloudT::ConstPtr voxel_cloud() const {return _voxels;}
+    PointCloudN::ConstPtr normal_cloud() const {return _normals;}
+
+    /**
+     * @brief clouds of the centroids and their normals, the point i is the centroid of the supervoxel i
+     */
+    PointCloudT::ConstPtr centroid_cloud() const {return _centroids;}
+    PointCloudN::ConstPtr centroid_normal_cloud() const {return _centroid_normals;}
+
+    /**
+     * @brief copy the voxels and normals of the supervoxel i
+     * @param i
+     * @param cloud output
+     * @param normals output
+     */
+    void get_voxels(size_t i, PointCloudT& cloud, PointCloudN& normals) const;
+
+    /**
+     * @brief copy the voxels and normals of the neighbors of the supervoxel i followed by its own
+     * @param i
+     * @param cloud output
+     * @param normals output
+     */
+    void get_neighborhood(size_t i, PointCloudT& cloud, PointCloudN& normals) const;
+
+    /**
+     * @brief FPFH signatures of all the voxels, computed once over the whole voxel cloud with one kd-tree.
+     * The point i is the signature of the voxel i of voxel_cloud(). The signatures are kept until the next build
+     * or a call with another radius. Not thread safe.
+     * The estimation uses as many threads as the calling task arena (see SupervoxelSet::setParallelFeatures).
+     * @param radius of the FPFH estimation
+     */
+    const pcl::PointCloud<pcl::FPFHSignature33>& voxel_fpfh(double radius = 0.05) const;
+
+    /**
+     * @brief Lab (resp. HSV) color of all the voxels, the vector i is the color of the voxel i of voxel_cloud().
+     * The colors are computed on the first call and kept until the next build. Not thread safe.
+     */
+    const std::vector<Eigen::VectorXd>& voxel_lab() const;
+    const std::vector<Eigen::VectorXd>& voxel_hsv() const;
+
+    /**
+     * @brief index of the supervoxel with the nearest centroid to a position.
+     * The kd-tree of the centroids is built on the first query and kept until the next build.
+     * The lazy build is not thread safe, the queries are.
+     * @return -1 if the array is empty or the position is not finite
+     */
+    int nearest_centroid(const PointT& pt) const;
+
+    /**
+     * @brief batch version of nearest_centroid, parallelized over the points
+     * @param points
+     * @param indices output, one index per point
+     */
+    void nearest_centroids(const PointCloudXYZ& points, std::vector<int>& indices) const;
+
+    /**
+     * @brief index of the supervoxel owning the nearest voxel of each point, if this voxel is closer than max_distance.
+     * The kd-tree of the voxels is built on the first query and kept until the next build.
+     * @param points
+     * @param max_distance
+     * @param indices output, one index per point, -1 if the point is in no voxel
+     */
+    void containing_supervoxels(const PointCloudXYZ& points, float max_distance, std::vector<int>& indices) const;
+
+    /**
+     * @brief index of the supervoxel owning the voxel v of voxel_cloud()
+     */
+    int owner(size_t v) const {return std::upper_bound(_offsets.begin(),_offsets.end(),v) - _offsets.begin() - 1;}
+
+private:
+    /**
+     * @brief kd-tree of the centroids (resp. voxels), built on the first call and kept until the next build.
+     * Not thread safe, call it before sharing the tree between tasks.
+     */
+    const pcl::KdTreeFLANN<PointT>& centroid_tree() const;
+    const pcl::KdTreeFLANN<PointT>& voxel_tree() const;
+
+    std::vector<uint32_t> _labels;
+    std::vector<int> _index;
+    std::vector<size_t> _offsets;
+    PointCloudT::Ptr _voxels;
+    PointCloudN::Ptr _normals;
+    PointCloudT::Ptr _centroids;
+    PointCloudN::Ptr _centroid_normals;
+    std::vector<int> _neighbor_offsets;
+    std::vector<int> _neighbors;
+    mutable pcl::PointCloud<pcl::FPFHSignature33>::Ptr _fpfh;
+    mutable double _fpfh_radius = 0;
+    mutable std::vector<Eigen::VectorXd> _lab;
+    mutable std::vector<Eigen::VectorXd> _hsv;
+    mutable bool _lab_valid = false;
+    mutable bool _hsv_valid = false;
+    mutable pcl::KdTreeFLANN<PointT>::Ptr _centroid_tree;
+    mutable pcl::KdTreeFLANN<PointT>::Ptr _voxel_tree;
+};
+
+}
+
+#endif //FLAT_SUPERVOXEL_ARRAY_H
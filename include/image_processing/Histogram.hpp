@@ -0,0 +1,143 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <Eigen/Core>
+#include <image_processing/pcl_types.h>
+#include <image_processing/tools.hpp>
+#include <image_processing/SparseHistogram.hpp>
+
+namespace image_processing {
+
+/**
+ * @brief base^exp at compile time
+ */
+constexpr int static_pow(int base, int exp){
+    return exp == 0 ? 1 : base*static_pow(base,exp - 1);
+}
+
+/**
+ * @brief Histograms with a number of bins and a dimension known at compile time.
+ * Same binning as HistogramFactory, but the histograms are written flattened in a buffer given by the caller
+ * (e.g. a row of a FeatureStore matrix) : the Bins bins of the first dimension, then those of the second, etc.
+ * An instance keeps its scratch memory so it should be reused across supervoxels (one instance per task).
+ */
+template <int Bins, int Dims>
+class Histogram {
+public:
+
+    static const int size = Bins*Dims;
+    static const int multi_dim_size = static_pow(Bins,Dims);
+
+    typedef Eigen::Matrix<double,2,Dims> bounds_t;
+    typedef Eigen::Matrix<double,size,1> flat_t;
+    typedef Eigen::Matrix<double,multi_dim_size,1> multi_dim_t;
+
+    /**
+     * @param bounds first row the lower bounds, second row the upper bounds of each dimension
+     */
+    Histogram(const bounds_t& bounds){
+        for(int i = 0; i < Dims; i++){
+            _lower[i] = bounds(0,i);
+            _width[i] = (bounds(1,i) - bounds(0,i))/Bins;
+        }
+    }
+
+    /**
+     * @brief marginal histograms of a range of vectors (e.g. of FlatSupervoxelArray::voxel_lab)
+     * @param out size values
+     */
+    void compute(const Eigen::VectorXd* first, const Eigen::VectorXd* last, double* out) const {
+        marginal(last - first,[first](size_t i, int d) -> double {return first[i][d];},out);
+    }
+
+    /**
+     * @brief marginal HSV color histograms of a range of voxels
+     * @param out size values
+     */
+    void compute(const PointT* first, const PointT* last, double* out){
+        _colors.resize(3*(last - first));
+        tools::rgb2hsv(first,last - first,_colors.data());
+        const float* colors = _colors.data();
+        marginal(last - first,[colors](size_t i, int d) -> double {return colors[3*i + d];},out);
+    }
+
+    /**
+     * @brief marginal histograms of a range of normals
+     * @param out size values
+     */
+    void compute(const pcl::Normal* first, const pcl::Normal* last, double* out) const {
+        marginal(last - first,[first](size_t i, int d) -> double {return first[i].normal[d];},out);
+    }
+
+    /**
+     * @brief joint histogram of a range of vectors. The bin of the i-th dimension has a stride of Bins^i.
+     * @param out multi_dim_size values
+     */
+    void compute_multi_dim(const Eigen::VectorXd* first, const Eigen::VectorXd* last, double* out) const {
+        joint(last - first,[first](size_t i, int d) -> double {return first[i][d];},out);
+    }
+
+    /**
+     * @brief joint histogram of a range of normals
+     * @param out multi_dim_size values
+     */
+    void compute_multi_dim(const pcl::Normal* first, const pcl::Normal* last, double* out) const {
+        joint(last - first,[first](size_t i, int d) -> double {return first[i].normal[d];},out);
+    }
+
+    /**
+     * @brief joint histogram in sparse form, for high dimensional histograms
+     * @param hist output
+     */
+    void compute_multi_dim(const Eigen::VectorXd* first, const Eigen::VectorXd* last, SparseHistogram& hist){
+        sparse_joint(last - first,[first](size_t i, int d) -> double {return first[i][d];},hist);
+    }
+
+    void compute_multi_dim(const pcl::Normal* first, const pcl::Normal* last, SparseHistogram& hist){
+        sparse_joint(last - first,[first](size_t i, int d) -> double {return first[i].normal[d];},hist);
+    }
+
+private:
+
+    template <typename Value>
+    void marginal(size_t count, Value value, double* out) const {
+        int lane_counts[tools::histogram_lanes*size];
+        tools::marginal_histogram(count,value,Dims,_lower,_width,Bins,lane_counts,out);
+    }
+
+    /**
+     * @brief call f with the joint bin index of each value
+     */
+    template <typename Value, typename F>
+    void joint_indices(size_t count, Value value, F f) const {
+        tools::joint_bin_indices(count,value,Dims,_lower,_width,Bins,f);
+    }
+
+    template <typename Value>
+    void joint(size_t count, Value value, double* out) const {
+        std::fill(out,out + multi_dim_size,0.);
+        joint_indices(count,value,[out](int index){out[index]++;});
+        for(int j = 0; j < multi_dim_size; j++)
+            out[j] = out[j]/((double)count);
+    }
+
+    template <typename Value>
+    void sparse_joint(size_t count, Value value, SparseHistogram& hist){
+        _indices.clear();
+        joint_indices(count,value,[this](int index){_indices.push_back(index);});
+        hist.set_size(multi_dim_size);
+        hist.compute(_indices);
+    }
+
+    double _lower[Dims];
+    double _width[Dims];
+    std::vector<float> _colors;
+    std::vector<uint32_t> _indices;
+};
+
+}
+
+#endif //HISTOGRAM_HPP
@@ -0,0 +1,52 @@
+#ifndef HISTOGRAM_DISTANCE_HPP
+#define HISTOGRAM_DISTANCE_HPP
+
+#include <Eigen/Core>
+
+namespace image_processing {
+
+/**
+ * @brief The HistogramDistance class
+ * Distances between histograms, vectorized with AVX2 or SSE2. The batch versions compare histograms stored as
+ * the rows of a matrix (e.g. a FeatureStore matrix) and are parallelized over the rows.
+ */
+class HistogramDistance {
+public:
+
+    typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> matrix_t;
+
+    enum type_t {
+        CHI_SQUARED,    /**< sum of (a-b)^2/(a+b) over the bins, divided by 2 (as HistogramFactory::chi_squared_distance) */
+        BHATTACHARYYA,  /**< sqrt(1 - sum(sqrt(a*b))/sqrt(sum(a)*sum(b))), in [0,1] */
+        INTERSECTION,   /**< sum of min(a,b), a similarity : 1 for two identical normalized histograms */
+        EMD_1D          /**< earth mover's distance of 1D histograms, sum of the absolute differences of the cumulated bins */
+    };
+
+    /**
+     * @brief distance between two histograms of size bins
+     */
+    static double compute(type_t type, const double* hist1, const double* hist2, int size);
+    static double compute(type_t type, const Eigen::VectorXd& hist1, const Eigen::VectorXd& hist2);
+
+    /**
+     * @brief distances between one histogram and each row of a matrix of histograms
+     * @param type
+     * @param hist
+     * @param hists one histogram per row, with as many columns as hist
+     * @param distances output, one per row of hists
+     */
+    static void one_to_many(type_t type, const Eigen::VectorXd& hist, const matrix_t& hists, Eigen::VectorXd& distances);
+
+    /**
+     * @brief distances between all the rows of two matrices of histograms
+     * @param type
+     * @param hists1
+     * @param hists2
+     * @param distances output, distances(i,j) is the distance between the i-th row of hists1 and the j-th row of hists2
+     */
+    static void all_pairs(type_t type, const matrix_t& hists1, const matrix_t& hists2, Eigen::MatrixXd& distances);
+};
+
+}
+
+#endif //HISTOGRAM_DISTANCE_HPP
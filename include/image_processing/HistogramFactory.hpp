@@ -7,6 +7,7 @@
 #include <memory>
 #include <Eigen/Core>
 #include <image_processing/tools.hpp>
+#include <image_processing/SparseHistogram.hpp>
 
 #include "SupervoxelSet.h"
 
@@ -34,6 +35,21 @@ public:
      * @param type {"color","normal"}
      */
     void compute(const pcl::Supervoxel<PointT>::ConstPtr& sv, std::string type = "color");
+
+    /**
+     * @brief compute the HSV color histograms of a range of voxels (e.g. of a FlatSupervoxelArray)
+     * @param first
+     * @param last
+     */
+    void compute(const PointT* first, const PointT* last);
+
+    /**
+     * @brief compute the histograms of a range of normals
+     * @param first
+     * @param last
+     */
+    void compute(const pcl::Normal* first, const pcl::Normal* last);
+
     /**
      * @brief compute the RGB color histograms of a open cv image
      * @param image
@@ -46,11 +62,28 @@ public:
      */
     void compute(const std::vector<Eigen::VectorXd>& data);
 
+    /**
+     * @brief compute the histograms of a range of vectors (e.g. of FlatSupervoxelArray::voxel_lab)
+     * @param first
+     * @param last
+     */
+    void compute(const Eigen::VectorXd* first, const Eigen::VectorXd* last);
+
     /**
      * @brief compute_multi_dim
      * @param data
      */
     void compute_multi_dim(const std::vector<Eigen::VectorXd>& data);
+    void compute_multi_dim(const Eigen::VectorXd* first, const Eigen::VectorXd* last);
+
+    /**
+     * @brief compute the joint histogram of the data in sparse form, for high dimensional histograms.
+     * The histogram of the factory is left unchanged.
+     * @param data
+     * @param hist output
+     */
+    void compute_multi_dim(const std::vector<Eigen::VectorXd>& data, SparseHistogram& hist) const;
+    void compute_multi_dim(const Eigen::VectorXd* first, const Eigen::VectorXd* last, SparseHistogram& hist) const;
 
     /**
      * @brief chi_squared_distance
@@ -67,12 +100,41 @@ public:
      * @brief return the histogram
      * @return histogram
      */
-     _histogram_t get_histogram(){
+     const _histogram_t& get_histogram() const {
         return _histogram;
     }
 
 
 private:
+
+    /**
+     * @brief width of the bins of each dimension
+     */
+    Eigen::VectorXd widths() const;
+
+    /**
+     * @brief index of the joint bin of each vector. The bin of the i-th dimension has a stride of bins^i.
+     */
+    void joint_indices(const Eigen::VectorXd* first, const Eigen::VectorXd* last, std::vector<uint32_t>& indices) const;
+
+    /**
+     * @brief compute the marginal histograms of count vectors
+     * @param count
+     * @param value value(i,d) is the d-th component of the i-th vector
+     * @param width width of the bins of each dimension
+     */
+    template <typename Value>
+    void marginal(size_t count, Value value, const Eigen::VectorXd& width){
+        Eigen::VectorXd lower = _bounds.row(0).transpose();
+        std::vector<int> lane_counts(tools::histogram_lanes*_dim*_bins);
+        std::vector<double> flat(_dim*_bins);
+        tools::marginal_histogram(count,value,_dim,lower.data(),width.data(),_bins,lane_counts.data(),flat.data());
+
+        _histogram = _histogram_t(_dim);
+        for(int d = 0; d < _dim; d++)
+            _histogram[d] = Eigen::Map<Eigen::VectorXd>(flat.data() + d*_bins,_bins);
+    }
+
     _histogram_t _histogram;
 
     int _bins;
@@ -127,6 +127,20 @@ public:
    */
   PointCloudT::Ptr get_result_cloud() {return _result_cloud;}
 
+  /**
+   *@brief Update the weights of a surface after the last update of the object's model
+   *       (set_initial or set_current). Only the supervoxels whose features are close to
+   *       the samples the model has been fitted with are re-scored, then the drift of the
+   *       other weights is checked on a random subset : above max_drift, all the weights are computed again.
+   *       The weights of the surface must have been computed with the model before this update.
+   *@param the surface of interrest
+   *@param the radius around the samples in the feature space
+   *@param the largest difference allowed between a kept weight and the estimation of the model
+   *@param the number of supervoxels drawn to check the drift (0 for all)
+   *@return the number of supervoxels re-scored
+   */
+  size_t update_weights(SurfaceOfInterest& surface, double radius, double max_drift = 0.05, size_t nbr_checks = 100);
+
 private:
 
   classifier_t _classifier;
@@ -145,6 +159,8 @@ private:
   PointCloudT::Ptr _transformed_initial_cloud;
   PointCloudT::Ptr _current_cloud;
   PointCloudT::Ptr _result_cloud;
+
+  std::vector<Eigen::VectorXd> _fitted_samples;
 };
 
 template<typename classifier_t>
@@ -152,8 +168,11 @@ void Object<classifier_t>::recover_center(SurfaceOfInterest& surface)
 {
   std::cout << "object hypothesis : recovering object's center" << std::endl;
 
-  surface.compute_weights<classifier_t>(_modality, _classifier);
-  SurfaceOfInterest::relevance_map_t map = surface.get_weights()[_modality];
+  if (!surface.compute_weights<classifier_t>(_modality, _classifier)) {
+    std::cerr << "object hypothesis : object's center could not be recovered" << std::endl;
+    return;
+  }
+  const SurfaceOfInterest::relevance_map_t& map = surface.get_weights().at(_modality);
 
   std::vector<std::set<uint32_t>> regions = surface.extract_regions(_relevance_modality, 0.5,_class_lbl);
 
@@ -164,7 +183,7 @@ void Object<classifier_t>::recover_center(SurfaceOfInterest& surface)
     double relevance = 0.0;
     for (const auto& sv : regions[i])
     {
-      relevance += map[sv][_class_lbl];
+      relevance += map.weight(sv,_class_lbl);
     }
     relevance /= regions[i].size();
 
@@ -188,8 +207,11 @@ bool Object<classifier_t>::set_initial(SurfaceOfInterest& initial_surface)
   _initial_hyp.clear();
   _initial_features.clear();
   _initial_cloud = PointCloudT::Ptr(new PointCloudT);
-  initial_surface.compute_weights<classifier_t>(_modality, _classifier);
-  _initial_map = initial_surface.get_weights()[_modality];
+  if (!initial_surface.compute_weights<classifier_t>(_modality, _classifier)) {
+    std::cerr << "object hypothesis : weights of the initial surface could not be computed" << std::endl;
+    return false;
+  }
+  _initial_map = initial_surface.get_weights().at(_modality);
   std::vector<std::set<uint32_t>> regions = initial_surface.extract_regions(_relevance_modality, 0.5,_class_lbl);
   size_t id = initial_surface.get_closest_region(regions, _center);
 
@@ -233,6 +255,7 @@ bool Object<classifier_t>::set_initial(SurfaceOfInterest& initial_surface)
   }
 
   _classifier.fit_batch(features, labels);
+  _fitted_samples = features;
 
   return true;
 }
@@ -245,8 +268,11 @@ bool Object<classifier_t>::set_current(SurfaceOfInterest& current_surface,
 
   _current_hyp.clear();
   _current_cloud = PointCloudT::Ptr(new PointCloudT);
-  current_surface.compute_weights<classifier_t>(_modality, _classifier);
-  _current_map = current_surface.get_weights()[_modality];
+  if (!current_surface.compute_weights<classifier_t>(_modality, _classifier)) {
+    std::cerr << "object hypothesis : weights of the current surface could not be computed" << std::endl;
+    return false;
+  }
+  _current_map = current_surface.get_weights().at(_modality);
 
   _result_cloud = PointCloudT::Ptr(new PointCloudT);
 
@@ -425,10 +451,27 @@ bool Object<classifier_t>::set_current(SurfaceOfInterest& current_surface,
 
   // update model
   _classifier.fit_batch(samples, labels);
+  _fitted_samples = samples;
 
   return true;
 }
 
+template<typename classifier_t>
+size_t Object<classifier_t>::update_weights(SurfaceOfInterest& surface, double radius,
+                                            double max_drift, size_t nbr_checks)
+{
+  size_t n = surface.update_weights<classifier_t>(_modality, _classifier, _fitted_samples, radius);
+  double drift = surface.weights_drift<classifier_t>(_modality, _classifier, nbr_checks);
+  if(drift > max_drift){
+    // the fit moved the model away from the samples, the kept weights are stale
+    surface.compute_weights<classifier_t>(_modality, _classifier);
+    n = surface.get_weights().at(_modality).size();
+    std::cout << "object hypothesis : drift of " << drift << ", all the weights are computed again" << std::endl;
+  }
+  std::cout << "object hypothesis : " << n << " supervoxels re-scored" << std::endl;
+  return n;
+}
+
 }
 
 #endif //_OBJECT_H
@@ -0,0 +1,114 @@
+#ifndef PARALLEL_SUPERVOXEL_CLUSTERING_H
+#define PARALLEL_SUPERVOXEL_CLUSTERING_H
+
+#include <memory>
+#include <vector>
+#include <Eigen/Core>
+
+#include "pcl_types.h"
+
+namespace image_processing {
+
+/**
+ * @brief The ParallelSupervoxelClustering class
+ * Multi-threaded supervoxel clustering with the same parameters and outputs as pcl::SupervoxelClustering.
+ * The cloud is voxelized on a regular grid, voxel normals are estimated from their neighborhood and
+ * seeds are picked on a grid of size seed_resolution. Instead of the sequential flow expansion of pcl,
+ * voxels are assigned to the nearest supervoxel among the ones of the surrounding seed cells for a few iterations
+ * (all the steps are done with TBB), then a connectivity pass merges the disconnected fragments to their neighbors
+ * and drops the voxels no seed reaches, as pcl does.
+ * The distance between a voxel and a supervoxel is the one of pcl.
+ */
+class ParallelSupervoxelClustering {
+public:
+
+    typedef std::shared_ptr<ParallelSupervoxelClustering> Ptr;
+
+    /**
+     * @brief constructor
+     * @param voxel_resolution
+     * @param seed_resolution
+     */
+    ParallelSupervoxelClustering(float voxel_resolution, float seed_resolution) :
+        _voxel_resolution(voxel_resolution), _seed_resolution(seed_resolution){}
+
+    /**
+     * @brief compute the supervoxels of the input cloud
+     * @param supervoxels output. Labels start at 1.
+     */
+    void extract(SupervoxelArray& supervoxels);
+
+    /**
+     * @brief adjacency of the supervoxels of the last call of extract. Each pair is given in both directions.
+     * @param adjacency output
+     */
+    void getSupervoxelAdjacency(AdjacencyMap& adjacency) const;
+
+    //SETTERS & GETTERS----------------------------------------
+    void setInputCloud(const PointCloudT::ConstPtr& cloud){_input = cloud;}
+    void setVoxelResolution(float res){_voxel_resolution = res;}
+    float getVoxelResolution() const {return _voxel_resolution;}
+    void setSeedResolution(float res){_seed_resolution = res;}
+    float getSeedResolution() const {return _seed_resolution;}
+    void setColorImportance(float val){_color_importance = val;}
+    void setSpatialImportance(float val){_spatial_importance = val;}
+    void setNormalImportance(float val){_normal_importance = val;}
+    /**
+     * @brief number of assignment/update iterations
+     */
+    void setNbrIterations(int nbr){_nbr_iterations = nbr;}
+    //---------------------------------------------------------
+
+private:
+
+    struct voxel_t{
+        Eigen::Vector3i cell;
+        Eigen::Vector3f xyz;
+        Eigen::Vector3f rgb;
+        Eigen::Vector3f normal;
+        float curvature;
+    };
+
+    struct cluster_t{
+        Eigen::Vector3f xyz;
+        Eigen::Vector3f rgb;
+        Eigen::Vector3f normal;
+    };
+
+    void _voxelize();
+    void _compute_normals();
+    void _voxel_adjacency();
+    void _select_seeds();
+    void _assign();
+    void _update_clusters();
+    void _enforce_connectivity();
+
+    /**
+     * @brief range [first,last) of the voxels of the cells cell, cell + (0,0,1), ..., cell + (0,0,length-1).
+     * These cells have consecutive keys so a single search is needed.
+     */
+    std::pair<int,int> _voxel_row(const Eigen::Vector3i& cell, int length) const;
+
+    float _distance(const voxel_t& v, const cluster_t& c) const;
+
+    PointCloudT::ConstPtr _input;
+
+    float _voxel_resolution;
+    float _seed_resolution;
+    float _color_importance = 0.1f;
+    float _spatial_importance = 0.4f;
+    float _normal_importance = 1.f;
+    int _nbr_iterations = 5;
+
+    std::vector<uint64_t> _voxel_keys; //sorted
+    std::vector<voxel_t> _voxels;
+    std::vector<int> _neighbor_offsets; //voxel adjacency in compressed rows
+    std::vector<int> _neighbors;
+    std::vector<cluster_t> _clusters;
+    std::vector<int> _assignment;
+    AdjacencyMap _adjacency;
+};
+
+}
+
+#endif //PARALLEL_SUPERVOXEL_CLUSTERING_H
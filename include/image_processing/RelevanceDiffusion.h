@@ -0,0 +1,128 @@
+#ifndef RELEVANCE_DIFFUSION_H
+#define RELEVANCE_DIFFUSION_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <tbb/tbb.h>
+#include "FlatSupervoxelArray.h"
+#include "RelevanceMap.h"
+
+namespace image_processing {
+
+/**
+ * @brief The RelevanceDiffusion class
+ * Iterative smoothing of a relevance map over the adjacency graph of the supervoxels.
+ * The probabilities are copied in two dense buffers indexed like the FlatSupervoxelArray : each sweep computes
+ * the next buffer from the current one in parallel over the supervoxels, then the buffers are swapped.
+ * Two updates are provided :
+ *  - AVERAGING : weighted average of the initial estimation of a supervoxel and of the current values of its neighbors.
+ *  - MEAN_FIELD : mean-field update of a Potts CRF, the initial estimation is the unary term and the neighbors
+ *    of the same class reward each other. The probabilities of a supervoxel are normalized over the classes.
+ * The supervoxels without weights are neither updated nor used as neighbors.
+ * An instance keeps its buffers so it should be reused from one frame to the next.
+ */
+class RelevanceDiffusion {
+public:
+
+    typedef RelevanceMap::matrix_t matrix_t;
+
+    enum mode_t {AVERAGING, MEAN_FIELD};
+
+    struct parameters_t {
+        parameters_t() : mode(AVERAGING), max_iterations(10), tolerance(1e-4),
+            unary_weight(1.), pairwise_weight(1.){}
+
+        mode_t mode;
+        int max_iterations;
+        double tolerance;       /**< stop when no probability changes more than tolerance during a sweep */
+        double unary_weight;    /**< weight of the initial estimation of a supervoxel */
+        double pairwise_weight; /**< weight of its neighbors */
+    };
+
+    RelevanceDiffusion(const parameters_t& parameters = parameters_t()) : _parameters(parameters){}
+
+    parameters_t& parameters(){return _parameters;}
+    const parameters_t& parameters() const {return _parameters;}
+
+    /**
+     * @brief weights of the edges, one per entry of the flat adjacency (i.e. the neighbor n of the supervoxel i
+     * has the weight edge_weights[n - svs.neighbors_begin(0)]). Empty for uniform weights.
+     */
+    void set_edge_weights(const std::vector<double>& edge_weights){_edge_weights = edge_weights;}
+
+    /**
+     * @brief load the weights of a set of supervoxels in the buffers
+     * @param svs
+     * @param weights
+     */
+    void init(const FlatSupervoxelArray& svs, const RelevanceMap& weights);
+
+    /**
+     * @brief run the diffusion chosen in the parameters until convergence or max_iterations sweeps
+     * @param svs
+     * @param weights input and output
+     * @return the number of sweeps done
+     */
+    int run(const FlatSupervoxelArray& svs, RelevanceMap& weights);
+
+    /**
+     * @brief one parallel sweep. rule(i,next) writes the nbr_class() probabilities of the supervoxel i in next,
+     * reading the current() probabilities of its neighbors.
+     * @return the largest change of a probability
+     */
+    template <typename Rule>
+    double sweep(Rule rule){
+        double change = tbb::parallel_reduce(tbb::blocked_range<size_t>(0,_rows.size()),0.,
+                                             [&](const tbb::blocked_range<size_t>& r, double change) -> double {
+            for(size_t i = r.begin(); i != r.end(); ++i){
+                if(_rows[i] < 0)
+                    continue;
+                double* next = _next.row(i).data();
+                rule(i,next);
+                for(int c = 0; c < nbr_class(); c++)
+                    change = std::max(change,std::fabs(next[c] - _current(i,c)));
+            }
+            return change;
+        },[](double a, double b) -> double {return std::max(a,b);});
+        _current.swap(_next);
+        return change;
+    }
+
+    /**
+     * @brief write the current probabilities back in the weights loaded by init
+     */
+    void store(RelevanceMap& weights) const;
+
+    int nbr_class() const {return _current.cols();}
+
+    /**
+     * @brief does the supervoxel i have weights ?
+     */
+    bool has_weights(size_t i) const {return _rows[i] >= 0;}
+
+    const matrix_t& current() const {return _current;}
+    const matrix_t& initial() const {return _initial;}
+
+    /**
+     * @brief weight of the edge between the supervoxel i and its neighbor n
+     * @param n pointer in [svs.neighbors_begin(i),svs.neighbors_end(i))
+     */
+    double edge_weight(const int* n) const {return _edge_weights.empty() ? 1. : _edge_weights[n - _first_neighbor];}
+
+private:
+    void averaging(const FlatSupervoxelArray& svs, size_t i, double* next) const;
+    void mean_field(const FlatSupervoxelArray& svs, size_t i, double* next) const;
+
+    parameters_t _parameters;
+    std::vector<double> _edge_weights;
+    const int* _first_neighbor = nullptr;
+    std::vector<int> _rows;
+    matrix_t _initial;
+    matrix_t _current;
+    matrix_t _next;
+};
+
+}
+
+#endif //RELEVANCE_DIFFUSION_H
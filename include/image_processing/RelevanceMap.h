@@ -0,0 +1,85 @@
+#ifndef RELEVANCE_MAP_H
+#define RELEVANCE_MAP_H
+
+#include <vector>
+#include <cstdint>
+#include <Eigen/Core>
+
+namespace image_processing {
+
+/**
+ * @brief The RelevanceMap class
+ * Probabilities of a set of supervoxels for each class, stored in one dense row-major matrix
+ * (one row per supervoxel, one column per class) with an index from label to row.
+ * Once reset, the rows can be written concurrently.
+ */
+class RelevanceMap {
+public:
+
+    typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> matrix_t;
+
+    /**
+     * @brief give one row to each label, in the order of labels, and set all the probabilities to value
+     * @param labels
+     * @param nbr_class
+     * @param value
+     */
+    void reset(const std::vector<uint32_t>& labels, int nbr_class, double value);
+
+    void clear();
+
+    size_t size() const {return _labels.size();}
+    bool empty() const {return _labels.empty();}
+    int nbr_class() const {return _data.cols();}
+
+    /**
+     * @brief label of the row r
+     */
+    uint32_t label(size_t r) const {return _labels[r];}
+    const std::vector<uint32_t>& labels() const {return _labels;}
+
+    /**
+     * @brief row of a label
+     * @return -1 if the label has no row
+     */
+    int row(uint32_t label) const {return label < _rows.size() ? _rows[label] : -1;}
+    bool contain(uint32_t label) const {return row(label) >= 0;}
+
+    double& operator()(size_t r, int c){return _data(r,c);}
+    double operator()(size_t r, int c) const {return _data(r,c);}
+
+    /**
+     * @brief probability of the class c for a label
+     * @return default_value if the label has no row
+     */
+    double weight(uint32_t label, int c, double default_value = 0.) const {
+        int r = row(label);
+        return r < 0 ? default_value : _data(r,c);
+    }
+
+    /**
+     * @brief copy the first nbr_class() values of an estimation in the row r
+     */
+    void set(size_t r, const std::vector<double>& estimation){
+        for(int c = 0; c < nbr_class() && c < estimation.size(); c++)
+            _data(r,c) = estimation[c];
+    }
+
+    /**
+     * @brief copy of the probabilities of a label
+     * @return an empty vector if the label has no row
+     */
+    std::vector<double> get(uint32_t label) const;
+
+    matrix_t& matrix(){return _data;}
+    const matrix_t& matrix() const {return _data;}
+
+private:
+    std::vector<uint32_t> _labels;
+    std::vector<int> _rows;
+    matrix_t _data;
+};
+
+}
+
+#endif //RELEVANCE_MAP_H
@@ -0,0 +1,67 @@
+#ifndef SPARSE_HISTOGRAM_HPP
+#define SPARSE_HISTOGRAM_HPP
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <Eigen/Core>
+
+namespace image_processing {
+
+/**
+ * @brief The SparseHistogram class
+ * Joint histogram stored as the list of its non empty bins (bin index, value) sorted by bin index.
+ * Meant for high dimensional joint histograms (e.g. 5 bins over 6 dimensions gives 15625 bins, mostly empty).
+ */
+class SparseHistogram {
+public:
+
+    typedef std::pair<uint32_t,double> entry_t;
+
+    /**
+     * @param size total number of bins
+     */
+    SparseHistogram(uint32_t size = 0) : _size(size){}
+
+    /**
+     * @brief set the histogram from the bin index of each sample. The values are normalized by the number of samples.
+     * @param indices bin indices, sorted in place
+     */
+    void compute(std::vector<uint32_t>& indices);
+
+    uint32_t size() const {return _size;}
+    void set_size(uint32_t size){_size = size;}
+
+    /**
+     * @brief non empty bins sorted by bin index
+     */
+    const std::vector<entry_t>& entries() const {return _entries;}
+
+    /**
+     * @brief value of a bin
+     */
+    double operator()(uint32_t index) const;
+
+    /**
+     * @brief the histogram as a dense vector of size() bins
+     */
+    Eigen::VectorXd to_dense() const;
+
+    /**
+     * @brief same distance as HistogramFactory::chi_squared_distance, computed on the non empty bins only
+     */
+    static double chi_squared_distance(const SparseHistogram& hist1, const SparseHistogram& hist2);
+
+    /**
+     * @brief histogram intersection, sum of the minimums of the bins
+     */
+    static double intersection(const SparseHistogram& hist1, const SparseHistogram& hist2);
+
+private:
+    uint32_t _size;
+    std::vector<entry_t> _entries;
+};
+
+}
+
+#endif //SPARSE_HISTOGRAM_HPP
@@ -11,6 +11,9 @@
 #include <opencv2/opencv.hpp>
 
 #include "default_parameters.hpp"
+#include "ParallelSupervoxelClustering.h"
+#include "FlatSupervoxelArray.h"
+#include "FeatureStore.h"
 #include "pcl_types.h"
 #include "tools.hpp"
 #include <string>
@@ -48,7 +51,40 @@ typedef struct workspace_t{
     sphere_t sphere;
     std::vector<double> area;
 
-    void filter(PointCloudT::Ptr cloud);
+    /**
+     * @brief crop the cloud in place to the workspace : box given by area (xmin,xmax,ymin,ymax,zmin,zmax)
+     * and, if with_sphere, removal of the points lying within sphere.threshold of the sphere surface.
+     * Both tests are evaluated in a single pass and the surviving points are written once.
+     * Non finite points are removed.
+     * @param cloud
+     * @param parallel evaluate the tests with several threads (worth it for full frames)
+     */
+    void filter(PointCloudT::Ptr cloud, bool parallel = false);
+
+    /**
+     * @brief same test as filter but leave the cloud untouched and output the indices of the surviving points
+     * @param cloud
+     * @param indices output
+     * @param parallel
+     */
+    void filter(const PointCloudT::ConstPtr& cloud, std::vector<int>& indices, bool parallel = false) const;
+
+    /**
+     * @brief variant of filter for organized clouds : only the pixels inside roi are tested in 3D.
+     * The cloud is no longer organized afterwards.
+     * @param organized cloud
+     * @param roi region of the image given by image_roi
+     */
+    void filter(PointCloudT::Ptr cloud, const cv::Rect& roi);
+
+    /**
+     * @brief project the workspace in the image with a pinhole model to get the pixel region containing it.
+     * @param focal lengths and principal point
+     * @param size of the image
+     * @param roi output
+     * @return false if the workspace does not project inside the image
+     */
+    bool image_roi(float fx, float fy, float cx, float cy, int width, int height, cv::Rect& roi) const;
 
 }workspace_t;
 
@@ -77,7 +113,7 @@ public :
 
     typedef std::shared_ptr<SupervoxelSet> Ptr;
     typedef const std::shared_ptr<SupervoxelSet> ConstPtr;
-    typedef std::map<uint32_t,std::map<std::string,Eigen::VectorXd>> features_t;
+    typedef FeatureStore features_t;
 
     /**
      * @brief default constructor
@@ -102,8 +138,13 @@ public :
         _inputCloud(super._inputCloud),
         _supervoxels(super._supervoxels),
         _adjacency_map(super._adjacency_map),
+        _next_label(super._next_label),
         _extractor(super._extractor),
-        _cam_param(super._cam_param){}
+        _parallel_extractor(super._parallel_extractor),
+        _parallel_clustering(super._parallel_clustering),
+        _parallel_features(super._parallel_features),
+        _cam_param(super._cam_param),
+        _organized_crop(super._organized_crop){}
 
     template <typename Param>
     /**
@@ -114,6 +155,10 @@ public :
         _extractor->setColorImportance(Param::color_importance);
         _extractor->setSpatialImportance(Param::spatial_importance);
         _extractor->setNormalImportance(Param::normal_importance);
+        _parallel_extractor.reset(new ParallelSupervoxelClustering(Param::voxel_resolution,Param::seed_resolution));
+        _parallel_extractor->setColorImportance(Param::color_importance);
+        _parallel_extractor->setSpatialImportance(Param::spatial_importance);
+        _parallel_extractor->setNormalImportance(Param::normal_importance);
 
         _cam_param.depth_princ_pt_x = Param::depth_princ_pt_x;
         _cam_param.depth_princ_pt_y = Param::depth_princ_pt_y;
@@ -128,12 +173,29 @@ public :
     //METHODES-------------------------------------------------
     /**
      * @brief compute the supervoxels with the input cloud
+     * If the organized crop is enabled and the input cloud is an organized frame of the camera,
+     * the workspace is first projected in the image and only the pixels of this region are filtered.
      * @param nbr_iteration (set nbr_iteration > 1 if you want to refine the supervoxels) default value = 1
      * @return colorized pointcloud. Each color correspond to a supervoxel for a vizualisation.
      */
     bool computeSupervoxel(workspace_t &workspace);
     bool computeSupervoxel();
 
+    /**
+     * @brief incremental variant of computeSupervoxel(workspace) for consecutive frames of a static camera.
+     * The cropped input cloud is compared with the one of the previous call with an octree change detector.
+     * The supervoxels touching a changed cell (or a cell next to it) are re-clustered with the new points
+     * of their region, the others keep their label. New supervoxels get labels above all the ones given since
+     * the last full computation, even those of supervoxels removed in the meantime.
+     * The first call, or a change covering more than max_change_ratio of the voxels, does a full computation.
+     * Features of the re-clustered supervoxels have to be computed again.
+     * @param workspace
+     * @param octree_res resolution of the change detection
+     * @param max_change_ratio
+     * @return false if the input cloud is empty
+     */
+    bool updateSupervoxel(workspace_t &workspace, double octree_res = 0.02, double max_change_ratio = 0.5);
+
     /**
      * @brief extract a pointcloud of edges of each supervoxel
      * @param edges_cloud output pointcloud
@@ -192,10 +254,17 @@ public :
 //        }
         _supervoxels.clear();
         _adjacency_map.clear();
+        _flat_valid = false;
+        _previous_cloud.reset();
+        _next_label = 1;
         _extractor.reset(new pcl::SupervoxelClustering<PointT>(Param::voxel_resolution,Param::seed_resolution));
         _extractor->setColorImportance(Param::color_importance);
         _extractor->setSpatialImportance(Param::spatial_importance);
         _extractor->setNormalImportance(Param::normal_importance);
+        _parallel_extractor.reset(new ParallelSupervoxelClustering(Param::voxel_resolution,Param::seed_resolution));
+        _parallel_extractor->setColorImportance(Param::color_importance);
+        _parallel_extractor->setSpatialImportance(Param::spatial_importance);
+        _parallel_extractor->setNormalImportance(Param::normal_importance);
     }
 
     /**
@@ -215,10 +284,20 @@ public :
      * @param x
      * @param y
      * @param z
-     * @return label of voxel, if the position is in any voxel the value will be 221133.
+     * @return label of the supervoxel with the nearest centroid, 0 if the set is empty.
      */
     uint32_t whichVoxelContain(float x, float y, float z);
 
+    /**
+     * @brief batch version of whichVoxelContain. The kd-tree of the centroids (resp. voxels) is built on the first
+     * query and kept until the set is modified.
+     * @param points
+     * @param labels output, one label per point, 0 if no supervoxel is found
+     * @param membership if true the label is the one of the supervoxel owning the nearest voxel,
+     * or 0 if this voxel is further than the diagonal of a voxel. Otherwise the one of the nearest centroid.
+     */
+    void whichVoxelContain(const PointCloudXYZ& points, std::vector<uint32_t>& labels, bool membership = false);
+
     /**
      * @brief comparison function between this and a given SupervoxelSet
      * @param a set of supervoxel
@@ -252,6 +331,15 @@ public :
      * @param name
      */
     void compute_feature(const std::string& name);
+
+    /**
+     * @brief compute several features at once. The intermediates they share (per voxel colors, FPFH, histograms)
+     * are computed only once and the independent features run concurrently on a task graph.
+     * The features already computed by a previous call are not computed again, unless the set changed since.
+     * @param names
+     * @return false if a feature is unknown, nothing is computed in this case
+     */
+    bool compute_features(const std::vector<std::string>& names);
     //---------------------------------------------------------
 
     //SETTERS & GETTERS----------------------------------------
@@ -295,11 +383,48 @@ public :
      */
     SupervoxelArray getSupervoxels(){return _supervoxels;}
 
+    /**
+     * @brief flat (structure of arrays) view of the supervoxels and their adjacency.
+     * It is rebuilt on the first call after a modification of the set.
+     * @return FlatSupervoxelArray
+     */
+    const FlatSupervoxelArray& flat(){
+        if(!_flat_valid){
+            _flat.build(_supervoxels,_adjacency_map);
+            _flat_valid = true;
+            _flat_builds++;
+        }
+        return _flat;
+    }
+
+    /**
+     * @brief enable the image space cropping of organized input clouds in computeSupervoxel(workspace).
+     * The cloud must have been produced with the camera parameters of this set.
+     * @param enable
+     */
+    void setOrganizedCrop(bool enable){_organized_crop = enable;}
+
     /**
      * @brief setSeedResolution
      * @param sr
      */
-    void setSeedResolution(float sr){_extractor->setSeedResolution(sr);}
+    void setSeedResolution(float sr){
+        _extractor->setSeedResolution(sr);
+        _parallel_extractor->setSeedResolution(sr);
+    }
+
+    /**
+     * @brief use the multi-threaded ParallelSupervoxelClustering instead of pcl::SupervoxelClustering
+     * @param enable
+     */
+    void setParallelClustering(bool enable){_parallel_clustering = enable;}
+
+    /**
+     * @brief compute the features with several threads (default) or with a single one, for reproducibility.
+     * The single thread setting also applies to the OpenMP FPFH estimation.
+     * @param enable
+     */
+    void setParallelFeatures(bool enable){_parallel_features = enable;}
 
     /**
      *@brief compute the neighborhood (first layer) of a given supervoxel
@@ -317,9 +442,9 @@ public :
      */
     const pcl::Supervoxel<PointT>::Ptr& at(uint32_t label) const {return _supervoxels.at(label);}
 
-    const std::map<std::string, Eigen::VectorXd>& get_features(uint32_t lbl){return _features[lbl];}
+    std::map<std::string, Eigen::VectorXd> get_features(uint32_t lbl) const {return _features.get_all(lbl);}
     void set_feature(std::string modality,uint32_t lbl,Eigen::VectorXd feature){
-        _features[lbl][modality] = feature;
+        _features.set(lbl,modality,feature);
     }
 
     /**
@@ -328,7 +453,13 @@ public :
      *@param name : std::string
      *@return Eigen::VectorXd
      */
-    Eigen::VectorXd get_feature(uint32_t lbl,std::string name){return _features[lbl][name];}
+    Eigen::VectorXd get_feature(uint32_t lbl,std::string name) const {return _features.get(lbl,name);}
+
+    /**
+     *@brief features of all the supervoxels, one matrix per modality
+     *@return FeatureStore
+     */
+    const FeatureStore& get_feature_store() const {return _features;}
 
     /**
      *@brief extract the cloud from a set of supervoxels label
@@ -339,18 +470,30 @@ public :
     //---------------------------------------------------------
 
 protected:
+    void _crop_workspace(workspace_t& workspace);
+    void _extract(const PointCloudT::Ptr& cloud, SupervoxelArray& supervoxels, AdjacencyMap& adjacency);
     uint32_t isInThisVoxel(float x, float y, float z, uint32_t label, AdjacencyMap am, boost::random::mt19937 gen, int counter = 5);
     void _color_gradient_descriptors();
 
 
     PointCloudT::Ptr _inputCloud;
+    PointCloudT::Ptr _previous_cloud;
     std::shared_ptr<pcl::SupervoxelClustering<PointT> > _extractor;
+    ParallelSupervoxelClustering::Ptr _parallel_extractor;
+    bool _parallel_clustering = false;
+    bool _parallel_features = true;
     SupervoxelArray _supervoxels;
     AdjacencyMap _adjacency_map;
+    uint32_t _next_label = 1; //label of the next supervoxel created by updateSupervoxel
+    FlatSupervoxelArray _flat;
+    bool _flat_valid = false;
+    size_t _flat_builds = 0;
     double _seed_resolution;
     features_t _features;
+    std::vector<size_t> _feature_builds; //per modality id, value of _flat_builds when compute_features last computed it
 
     camera_param _cam_param;
+    bool _organized_crop = false;
 
 };
 
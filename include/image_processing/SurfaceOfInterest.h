@@ -3,8 +3,14 @@
 
 #include "SupervoxelSet.h"
 #include "HistogramFactory.hpp"
+#include "BackgroundModel.h"
+#include "ConnectedComponents.h"
+#include "WeightedSampler.h"
+#include "RelevanceMap.h"
+#include "RelevanceDiffusion.h"
 #include <boost/random.hpp>
 #include <ctime>
+#include <type_traits>
 #include <image_processing/features.hpp>
 #include <tbb/tbb.h>
 
@@ -34,6 +40,24 @@ inline std::ostream& operator<<(std::ostream& os, const SvFeature& feature){
     return os;
 }
 
+/**
+ * @brief does the classifier provide a batch estimation ?
+ * i.e. a const method compute_estimation_batch(const Eigen::MatrixXd& samples, Eigen::MatrixXd& estimations)
+ * which computes the estimations of all the samples at once, one sample per row.
+ */
+template <typename classifier_t>
+struct has_compute_estimation_batch {
+    template <typename C>
+    static auto test(int) -> decltype(std::declval<const C&>().compute_estimation_batch(
+                                          std::declval<const Eigen::MatrixXd&>(),std::declval<Eigen::MatrixXd&>()),
+                                      std::true_type());
+    template <typename C>
+    static std::false_type test(...);
+
+    typedef decltype(test<classifier_t>(0)) type;
+    static const bool value = type::value;
+};
+
 /**
  * @brief class to build a relevance map : which is a segmentation between different categories.
  */
@@ -41,8 +65,8 @@ class SurfaceOfInterest : public SupervoxelSet
 {
 public:
 
-    typedef std::map<uint32_t,std::vector<double>> relevance_map_t;
-    /**< map of probabilities associate to each supervoxel (key sv label). Value : vector of probabilities. The size is equal to the number of class */
+    typedef RelevanceMap relevance_map_t;
+    /**< probabilities associated to each supervoxel (row of its label). One column per class */
 
     /**
      * @brief default constructor
@@ -105,8 +129,7 @@ public:
             return false;
 
         init_weights(modality,classifier.get_nbr_class(),init_val);
-        compute_weights(modality, classifier);
-        return true;
+        return compute_weights(modality, classifier);
     }
 
     /**
@@ -125,6 +148,14 @@ public:
      */
     bool generate(const PointCloudT::Ptr background, workspace_t& workspace);
 
+    /**
+     * @brief EXPERT POLICY generate the soi by deleting the background, with a background model kept across frames
+     * @param background model
+     * @param workspace
+     * @return if the generation of soi is successful
+     */
+    bool generate(const BackgroundModel& background, workspace_t& workspace);
+
     /**
      * @brief reduce the set of supervoxels to set of surface of interest. Only supervoxels with weight above certain threshold
      * @param modality
@@ -140,36 +171,20 @@ public:
      * All weights are between 0 and 1.
      * @param lbl label of the explored supervoxel
      * @param interest true if the explored supervoxel is interesting false otherwise
+     * @return false if the modality is unknown or the classifier failed, the weights are then left at 0.5
      */
     template <typename classifier_t>
-    void compute_weights(const std::string& modality, const classifier_t &classifier){
+    bool compute_weights(const std::string& modality, const classifier_t &classifier){
 
 
-        if(_features.begin()->second.find(modality) == _features.begin()->second.end()){
+        int id = FeatureStore::modality_id(modality);
+        if(!_features.has(id)){
             std::cerr << "SurfaceOfInterest Error: unknow modality : " << modality << std::endl;
-            return;
-        }
-
-        if(_weights.find(modality) != _weights.end())
-            _weights[modality].clear();
-        else
-            _weights[modality] = relevance_map_t();
-
-        std::vector<uint32_t> lbls;
-        for(const auto& sv : _supervoxels){
-            lbls.push_back(sv.first);
-            _weights[modality].emplace(sv.first,std::vector<double>(classifier.get_nbr_class(),0.5));
+            return false;
         }
 
-        tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
-                          [&](const tbb::blocked_range<size_t>& r){
-            for(size_t i = r.begin(); i != r.end(); ++i){
-                //        for(size_t i = 0; i != lbls.size(); ++i){
-                _weights[modality][lbls[i]] = classifier.compute_estimation(
-                            _features[lbls[i]][modality]);
-            }
-        });
-
+        relevance_map_t& weights = reset_weights(modality,supervoxel_labels(),classifier.get_nbr_class(),0.5);
+        return estimate(classifier,id,weights);
     }
 
 
@@ -178,43 +193,30 @@ public:
      * @param modality
      * @param classifier
      * @param comp_classifier
+     * @return false if the modality is unknown or a classifier failed
      */
     template <typename classifier_t>
-    void compute_weights(const std::string& modality, const classifier_t &classifier,
+    bool compute_weights(const std::string& modality, const classifier_t &classifier,
                          const classifier_t &comp_classifier){
 
 
-        if(_features.begin()->second.find(modality) == _features.begin()->second.end()){
+        int id = FeatureStore::modality_id(modality);
+        if(!_features.has(id)){
             std::cerr << "SurfaceOfInterest Error: unknow modality : " << modality << std::endl;
-            return;
-        }
-
-        if(_weights.find(modality) != _weights.end())
-            _weights[modality].clear();
-        else
-            _weights[modality] = relevance_map_t();
-
-        std::vector<uint32_t> lbls;
-        for(const auto& sv : _supervoxels){
-            lbls.push_back(sv.first);
-            _weights[modality].emplace(sv.first,std::vector<double>(classifier.get_nbr_class(),0.5));
+            return false;
         }
 
+        relevance_map_t& weights = reset_weights(modality,supervoxel_labels(),classifier.get_nbr_class(),0.5);
+        if(!estimate(classifier,id,weights))
+            return false;
 
-        tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
-                          [&](const tbb::blocked_range<size_t>& r){
-            for(size_t i = r.begin(); i != r.end(); ++i){
-                //        for(size_t i = 0; i != lbls.size(); ++i){
-
-                std::vector<double> comp_est = comp_classifier.compute_estimation(
-                            _features[lbls[i]][modality]);
-                std::vector<double> estimations = classifier.compute_estimation(
-                            _features[lbls[i]][modality]);
-                for(int k = 0; k < estimations.size(); k++)
-                    estimations[k] = comp_est[k]*estimations[k];
-                _weights[modality][lbls[i]] = estimations;
-            }
-        });
+        //the supervoxels without features keep their default weights
+        relevance_map_t comp_weights;
+        comp_weights.reset(weights.labels(),weights.nbr_class(),1.);
+        if(!estimate(comp_classifier,id,comp_weights))
+            return false;
+        weights.matrix().array() *= comp_weights.matrix().array();
+        return true;
     }
 
     template<typename classifier_t>
@@ -224,21 +226,12 @@ public:
      */
     void compute_weights(classifier_t classifier){
 
-        if(_weights.find("merge") != _weights.end())
-            _weights["merge"].clear();
-        else
-            _weights["merge"] = relevance_map_t();
-
-        std::vector<uint32_t> lbls;
-        for(const auto& sv : _supervoxels){
-            lbls.push_back(sv.first);
-            _weights["merge"].emplace(sv.first,std::vector<double>(classifier.get_nbr_class(),0));
-        }
-        tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
+        relevance_map_t& weights = reset_weights("merge",supervoxel_labels(),classifier.get_nbr_class(),0);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0,weights.size()),
                           [&](const tbb::blocked_range<size_t>& r){
             for(size_t i = r.begin(); i != r.end(); ++i){
-                _weights["merge"][lbls[i]] = classifier.compute_estimation(
-                            _features[lbls[i]]);
+                weights.set(i,classifier.compute_estimation(
+                                _features.get_all(weights.label(i))));
             }
         });
 
@@ -248,26 +241,138 @@ public:
     /**
      * @brief compute weights for a list of classifier each specific to one kind of feature
      * @param classifier associated with a feature.
+     * @return false if a modality is unknown or a classifier failed, the other modalities are computed anyway
      */
-    void compute_weights(std::map<std::string,classifier_t>& classifiers){
+    bool compute_weights(std::map<std::string,classifier_t>& classifiers){
+        bool ok = true;
         for(auto& classi: classifiers)
         {
-            if(_features.begin()->second.find(classi.first) == _features.begin()->second.end()){
+            int id = FeatureStore::modality_id(classi.first);
+            if(!_features.has(id)){
                 std::cerr << "SurfaceOfInterest Error: unknow modality : " << classi.first << std::endl;
+                ok = false;
                 continue;
             }
 
-            if(_weights.find(classi.first) != _weights.end())
-                _weights[classi.first].clear();
-            else
-                _weights[classi.first] = relevance_map_t();
+            //as before, the supervoxels without features have no weights
+            std::vector<uint32_t> lbls;
+            for(const auto& sv : _supervoxels)
+                if(_features.row(sv.first) >= 0)
+                    lbls.push_back(sv.first);
+
+            relevance_map_t& weights = reset_weights(classi.first,lbls,classi.second.get_nbr_class(),0.);
+            ok = estimate(classi.second,id,weights) && ok;
+        }
+        return ok;
+    }
+
+    /**
+     * @brief re-score some supervoxels of a modality whose weights have already been computed, e.g. after
+     * a small update of the classifier. The other weights are kept.
+     * @param modality
+     * @param classifier
+     * @param lbls labels of the supervoxels to re-score, those without weights are ignored
+     * @return the number of supervoxels re-scored, 0 if the classifier failed
+     */
+    template <typename classifier_t>
+    size_t update_weights(const std::string& modality, const classifier_t &classifier, const std::vector<uint32_t>& lbls){
+        _nbr_rescored = 0;
+        int id = FeatureStore::modality_id(modality);
+        auto it = _weights.find(modality);
+        if(!_features.has(id) || it == _weights.end()){
+            std::cerr << "SurfaceOfInterest Error: no weights to update for modality : " << modality << std::endl;
+            return 0;
+        }
+        relevance_map_t& weights = it->second;
+
+        std::vector<uint32_t> rescored;
+        for(const uint32_t& lbl : lbls)
+            if(weights.contain(lbl))
+                rescored.push_back(lbl);
+
+        //the supervoxels without features keep their weights
+        relevance_map_t estimations;
+        estimations.reset(rescored,weights.nbr_class(),0.);
+        for(size_t k = 0; k < rescored.size(); k++)
+            estimations.matrix().row(k) = weights.matrix().row(weights.row(rescored[k]));
+        if(!estimate(classifier,id,estimations))
+            return 0;
+
+        for(size_t k = 0; k < rescored.size(); k++){
+            int r = weights.row(rescored[k]);
+            weights.matrix().row(r) = estimations.matrix().row(k);
+            weight_updated(modality,r);
+        }
+        _nbr_rescored = rescored.size();
+        return _nbr_rescored;
+    }
+
+    /**
+     * @brief after the classifier has been fitted with new samples, re-score only the supervoxels whose features
+     * are closer than radius to one of the samples. The estimations of the others are assumed unchanged, which is
+     * an approximation : a fit which moves a component of a mixture changes the estimations of all the supervoxels
+     * this component covers, near the samples or not. Use weights_drift to know if the kept weights are stale.
+     * @param modality
+     * @param classifier
+     * @param samples the features the classifier has been fitted with
+     * @param radius in the feature space
+     * @return the number of supervoxels re-scored
+     */
+    template <typename classifier_t>
+    size_t update_weights(const std::string& modality, const classifier_t &classifier,
+                          const std::vector<Eigen::VectorXd>& samples, double radius){
+        std::vector<uint32_t> lbls;
+        near_samples(modality,samples,radius,lbls);
+        return update_weights(modality,classifier,lbls);
+    }
 
+    /**
+     * @brief number of supervoxels re-scored by the last call to update_weights
+     */
+    size_t nbr_rescored() const {return _nbr_rescored;}
 
-            for(const auto& sv : _supervoxels){
-                _weights[classi.first].emplace(sv.first,
-                                               classi.second.compute_estimation(_features[sv.first][classi.first]));
+    /**
+     * @brief drift of the weights of a modality from the current estimations of the classifier : the largest
+     * absolute difference over nbr_checks supervoxels drawn at random (all of them if nbr_checks is 0).
+     * The weights are not modified. A drift above the tolerance of the caller means the weights kept by
+     * update_weights are stale and compute_weights has to be called.
+     * @param modality
+     * @param classifier
+     * @param nbr_checks
+     * @return the drift, -1 if the modality has no weights or the classifier failed
+     */
+    template <typename classifier_t>
+    double weights_drift(const std::string& modality, const classifier_t &classifier, size_t nbr_checks = 0){
+        int id = FeatureStore::modality_id(modality);
+        auto it = _weights.find(modality);
+        if(!_features.has(id) || it == _weights.end()){
+            std::cerr << "SurfaceOfInterest Error: no weights to check for modality : " << modality << std::endl;
+            return -1;
+        }
+        const relevance_map_t& weights = it->second;
+
+        std::vector<uint32_t> lbls(weights.labels());
+        if(nbr_checks > 0 && nbr_checks < lbls.size()){
+            //partial Fisher-Yates shuffle
+            for(size_t k = 0; k < nbr_checks; k++){
+                boost::random::uniform_int_distribution<size_t> dist(k,lbls.size() - 1);
+                std::swap(lbls[k],lbls[dist(_gen)]);
             }
+            lbls.resize(nbr_checks);
         }
+
+        relevance_map_t estimations;
+        estimations.reset(lbls,weights.nbr_class(),0.);
+        for(size_t k = 0; k < lbls.size(); k++)
+            estimations.matrix().row(k) = weights.matrix().row(weights.row(lbls[k]));
+        if(!estimate(classifier,id,estimations))
+            return -1;
+
+        double drift = 0;
+        for(size_t k = 0; k < lbls.size(); k++)
+            drift = std::max(drift,(estimations.matrix().row(k) -
+                                    weights.matrix().row(weights.row(lbls[k]))).cwiseAbs().maxCoeff());
+        return drift;
     }
 
     /**
@@ -279,10 +384,21 @@ public:
     bool choice_of_soi_by_uncertainty(const std::string &modality, pcl::Supervoxel<PointT> &supervoxel, uint32_t &lbl);
 
     /**
-     * @brief delete the background of the input cloud
+     * @brief set the weight of one supervoxel for one class. The distributions of choice_of_soi and
+     * choice_of_soi_by_uncertainty are updated in O(log n) instead of being rebuilt.
+     * @param modality
+     * @param label of the supervoxel, it must have weights for this modality
+     * @param class_lbl
+     * @param value
+     */
+    void set_weight(const std::string &modality, uint32_t label, int class_lbl, double value);
+
+    /**
+     * @brief delete the background of the input cloud. The points within 1cm of a background point are removed.
      * @param a pointcloud
      */
     void delete_background(const PointCloudT::Ptr background);
+    void delete_background(const BackgroundModel& background);
 
     /**
      * @brief compute the pointcloud colored by the weights of the given modality
@@ -302,7 +418,7 @@ public:
      * @brief get the weights of all modality
      * @return the weights of all modality
      */
-    std::map<std::string,relevance_map_t> get_weights(){return _weights;}
+    const std::map<std::string,relevance_map_t>& get_weights() const {return _weights;}
 
     /**
      * @brief neighbor bluring propagate weights of each supervoxels to its neighbor. Experimental function.
@@ -319,6 +435,14 @@ public:
      */
     void adaptive_threshold(const std::string& modality, int lbl);
 
+    /**
+     * @brief smooth the weights of a modality over the adjacency of the supervoxels
+     * @param modality
+     * @param diffusion engine, its parameters choose the update and the number of iterations
+     * @return the number of iterations done
+     */
+    int diffuse(const std::string& modality, RelevanceDiffusion& diffusion);
+
     /**
      * @brief compute a average relevance map based on several relevance maps
      * @param list of relevance maps
@@ -334,6 +458,16 @@ public:
      */
     std::vector<std::set<uint32_t>> extract_regions(const std::string &modality, double saliency_threshold, int class_lbl);
 
+    /**
+     * @brief compute the connected regions of salient supervoxels as compact arrays.
+     * The indices of the components are the ones of flat().
+     * @param modality
+     * @param saliency threshold
+     * @param class_lbl
+     * @param regions output
+     */
+    void extract_regions(const std::string &modality, double saliency_threshold, int class_lbl, ConnectedComponents& regions);
+
     /**
      * @brief compute the closest region in a vector for the given center
      * @param vector of regions
@@ -351,9 +485,125 @@ public:
     std::set<uint32_t> extract_background(const std::string &modality, double saliency_threshold, int class_lbl);
 
 private :
+    /**
+     * @brief the sampler of the class 1 weights (resp. of the uncertainty of a class), built on first use.
+     * The index i of a sampler is the row i of the weights of the modality.
+     */
+    WeightedSampler& weight_sampler(const std::string &modality);
+    WeightedSampler& uncertainty_sampler(const std::string &modality, int class_lbl);
+
+    /**
+     * @brief labels of all the supervoxels, in increasing order
+     */
+    std::vector<uint32_t> supervoxel_labels() const {
+        std::vector<uint32_t> lbls;
+        lbls.reserve(_supervoxels.size());
+        for(const auto& sv : _supervoxels)
+            lbls.push_back(sv.first);
+        return lbls;
+    }
+
+    /**
+     * @brief give one row of weights set to value to each label
+     * @return the weights of the modality
+     */
+    relevance_map_t& reset_weights(const std::string &modality, const std::vector<uint32_t>& lbls, int nbr_class, double value){
+        relevance_map_t& weights = _weights[modality];
+        weights.reset(lbls,nbr_class,value);
+        weights_changed(modality);
+        return weights;
+    }
+
+    /**
+     * @brief estimations of a classifier for the features of a modality. The row i of out is set to the estimation
+     * of the supervoxel out.label(i) if it has features and is left unchanged otherwise.
+     * The classifiers with a compute_estimation_batch method are evaluated in one call, the others are called
+     * concurrently so their compute_estimation must be thread safe.
+     * The parallel bodies only read the FeatureStore and each writes its own rows : the weights must be
+     * sized beforehand (see reset_weights) and no map is looked up or modified in the parallel region.
+     * @param classifier
+     * @param id of the modality
+     * @param out
+     * @return false if the batch estimation does not give one row per sample, out is then left unchanged
+     */
+    template <typename classifier_t>
+    bool estimate(const classifier_t& classifier, int id, relevance_map_t& out) const {
+        return estimate(classifier,id,out,typename has_compute_estimation_batch<classifier_t>::type());
+    }
+
+    template <typename classifier_t>
+    bool estimate(const classifier_t& classifier, int id, relevance_map_t& out, std::false_type) const {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0,out.size()),
+                          [&](const tbb::blocked_range<size_t>& r){
+            Eigen::VectorXd sample(_features.dimension(id));
+            for(size_t i = r.begin(); i != r.end(); ++i){
+                int row = _features.row(out.label(i));
+                if(row < 0)
+                    continue;
+                sample = _features.feature(id,row);
+                out.set(i,classifier.compute_estimation(sample));
+            }
+        });
+        return true;
+    }
+
+    template <typename classifier_t>
+    bool estimate(const classifier_t& classifier, int id, relevance_map_t& out, std::true_type) const {
+        std::vector<size_t> with_features;
+        for(size_t i = 0; i < out.size(); i++)
+            if(_features.row(out.label(i)) >= 0)
+                with_features.push_back(i);
+
+        Eigen::MatrixXd samples(with_features.size(),_features.dimension(id));
+        for(size_t k = 0; k < with_features.size(); k++)
+            samples.row(k) = _features.feature(id,_features.row(out.label(with_features[k]))).transpose();
+
+        Eigen::MatrixXd estimations;
+        classifier.compute_estimation_batch(samples,estimations);
+        if(estimations.rows() != samples.rows()){
+            std::cerr << "SurfaceOfInterest Error: " << estimations.rows() << " estimations for "
+                      << samples.rows() << " samples" << std::endl;
+            return false;
+        }
+
+        int nbr_class = std::min<int>(out.nbr_class(),estimations.cols());
+        for(size_t k = 0; k < with_features.size(); k++)
+            out.matrix().row(with_features[k]).head(nbr_class) = estimations.row(k).head(nbr_class);
+        return true;
+    }
+
+    /**
+     * @brief labels of the supervoxels whose features of a modality are closer than radius to one of the samples
+     * @param modality
+     * @param samples
+     * @param radius
+     * @param lbls output, in increasing order
+     */
+    void near_samples(const std::string &modality, const std::vector<Eigen::VectorXd>& samples, double radius,
+                      std::vector<uint32_t>& lbls) const;
+
+    /**
+     * @brief update the samplers of a modality after a change of the row r of its weights
+     */
+    void weight_updated(const std::string &modality, int r);
+
+    /**
+     * @brief drop the samplers of a modality, to call each time its weights are rewritten
+     */
+    void weights_changed(const std::string &modality);
+
+    /**
+     * @brief mask of the supervoxels of flat() whose weight for class_lbl is above the threshold
+     */
+    void salient_mask(const std::string &modality, double saliency_threshold, int class_lbl, std::vector<char>& mask);
+
     std::vector<uint32_t> _labels;
     std::vector<uint32_t> _labels_no_soi;
     std::map<std::string,relevance_map_t> _weights;
+    std::map<std::string,WeightedSampler> _weight_samplers;
+    std::map<std::pair<std::string,int>,WeightedSampler> _uncertainty_samplers;
+    RelevanceDiffusion _diffusion;
+    size_t _nbr_rescored = 0;
 
     boost::random::mt19937 _gen;
 
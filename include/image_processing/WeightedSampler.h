@@ -0,0 +1,70 @@
+#ifndef WEIGHTED_SAMPLER_H
+#define WEIGHTED_SAMPLER_H
+
+#include <vector>
+#include <cstddef>
+#include <boost/random/uniform_real_distribution.hpp>
+
+namespace image_processing {
+
+/**
+ * @brief The WeightedSampler class
+ * Draws indices with a probability proportional to their weight. The weights are kept in a Fenwick tree :
+ * building is in O(n), a draw and a weight update are in O(log n). Negative weights are taken as zero.
+ */
+class WeightedSampler {
+public:
+
+    /**
+     * @brief set all the weights
+     * @param weights
+     */
+    void build(const std::vector<double>& weights);
+
+    void clear();
+
+    size_t size() const {return _weights.size();}
+    bool empty() const {return _weights.empty();}
+
+    double weight(size_t i) const {return _weights[i];}
+
+    /**
+     * @brief sum of the weights
+     */
+    double total() const {return _total;}
+
+    /**
+     * @brief change the weight of the index i
+     */
+    void set(size_t i, double weight);
+
+    /**
+     * @brief index i whose cumulative weight interval [sum_{j<i} w_j, sum_{j<=i} w_j) contains u
+     * @param u in [0,total())
+     * @return -1 if the total weight is zero
+     */
+    int find(double u) const;
+
+    /**
+     * @brief draw an index
+     * @param gen random generator
+     * @return -1 if the total weight is zero
+     */
+    template <typename Gen>
+    int sample(Gen& gen) const {
+        if(_total <= 0)
+            return -1;
+        boost::random::uniform_real_distribution<> dist(0.,_total);
+        return find(dist(gen));
+    }
+
+private:
+    std::vector<double> _weights;
+    std::vector<double> _tree;
+    double _total = 0;
+    size_t _updates = 0;
+};
+
+}
+
+#endif //WEIGHTED_SAMPLER_H
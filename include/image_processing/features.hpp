@@ -3,9 +3,13 @@
 
 #include <iostream>
 #include <functional>
-#include <image_processing/HistogramFactory.hpp>
+#include <limits>
+#include <image_processing/Histogram.hpp>
 #include <pcl/segmentation/supervoxel_clustering.h>
 #include <image_processing/pcl_types.h>
+#include <image_processing/FlatSupervoxelArray.h>
+#include <image_processing/FeatureStore.h>
+#include <image_processing/voxel_key.hpp>
 #include <eigen3/Eigen/Eigen>
 #include <pcl/features/fpfh_omp.h>
 #include <pcl/features/fpfh.h>
@@ -16,63 +20,125 @@
 
 namespace image_processing{
 
-typedef std::function<void(const SupervoxelArray&, const AdjacencyMap&, SupervoxelSet::features_t&)> function_t;
+typedef std::function<void(const FlatSupervoxelArray&, SupervoxelSet::features_t&)> function_t;
 
 struct features_fct{
-    static std::map<std::string,function_t> create_map(){
-        std::map<std::string,function_t> map;
 
-        map.emplace("meanColorNormal",
-                [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::VectorXd sample(6);
-                sample[0] = sv.second->centroid_.r;
-                sample[1] = sv.second->centroid_.g;
-                sample[2] = sv.second->centroid_.b;
-                sample[3] = sv.second->normal_.normal[0];
-                sample[4] = sv.second->normal_.normal[1];
-                sample[5] = sv.second->normal_.normal[2];
-                features[sv.first]["meanColorNormal"] = sample;
+    /**
+     * @brief sum of the cached FPFH signatures of the voxels of each supervoxel, normalized to [0,1].
+     * Signatures which could not be estimated (NaN) are ignored.
+     * @param supervoxels
+     * @param sums output : one row of 33 values per supervoxel
+     * @param counts output : number of signatures summed per supervoxel
+     */
+    static void fpfh_sums(const FlatSupervoxelArray& supervoxels, Eigen::MatrixXd& sums, std::vector<int>& counts){
+        const pcl::PointCloud<pcl::FPFHSignature33>& signatures = supervoxels.voxel_fpfh();
+        sums = Eigen::MatrixXd::Zero(supervoxels.size(),33);
+        counts.assign(supervoxels.size(),0);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                          [&](const tbb::blocked_range<size_t>& r){
+            for(size_t k = r.begin(); k != r.end(); ++k){
+                for(size_t v = supervoxels.voxel_offset(k); v < supervoxels.voxel_offset(k+1); v++){
+                    if(signatures[v].histogram[0] != signatures[v].histogram[0])
+                        continue;
+                    for(int j = 0; j < 33; j++)
+                        sums(k,j) += signatures[v].histogram[j]/100.;
+                    counts[k]++;
+                }
             }
         });
+    }
 
-        map.emplace("colorNormalHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::VectorXd sample;
+    /**
+     * @brief mean FPFH signature of the voxels of a supervoxel and of its neighbors
+     * @param supervoxels
+     * @param sums computed by fpfh_sums
+     * @param counts computed by fpfh_sums
+     * @param k index of the supervoxel
+     * @return mean signature, zero if no signature could be estimated in the neighborhood
+     */
+    static Eigen::VectorXd neighborhood_fpfh(const FlatSupervoxelArray& supervoxels, const Eigen::MatrixXd& sums,
+                                             const std::vector<int>& counts, size_t k){
+        Eigen::VectorXd mean = sums.row(k).transpose();
+        int count = counts[k];
+        for(const int* n = supervoxels.neighbors_begin(k); n != supervoxels.neighbors_end(k); ++n){
+            mean += sums.row(*n).transpose();
+            count += counts[*n];
+        }
+        return count ? Eigen::VectorXd(mean/(double)count) : Eigen::VectorXd::Zero(33);
+    }
 
-                Eigen::MatrixXd bounds_c(2,3);
-                bounds_c << 0,0,0,
-                        1,1,1;
+    /**
+     * @brief voxels with a valid FPFH signature, sorted by their cell in a grid of the XY plane
+     * @param supervoxels
+     * @param cell_size side of the cells of the grid
+     * @param cells output : (key of the cell, voxel index) sorted by key then index
+     */
+    static void fpfh_xy_grid(const FlatSupervoxelArray& supervoxels, float cell_size,
+                             std::vector<std::pair<uint64_t,int>>& cells){
+        const pcl::PointCloud<pcl::FPFHSignature33>& signatures = supervoxels.voxel_fpfh();
+        const PointCloudT& voxels = *supervoxels.voxel_cloud();
+        float inv_size = 1.f/cell_size;
+        cells.clear();
+        for(size_t i = 0; i < voxels.size(); i++)
+            if(signatures[i].histogram[0] == signatures[i].histogram[0])
+                cells.push_back(std::make_pair(tools::cell_key(voxels[i].x,voxels[i].y,0,inv_size),static_cast<int>(i)));
+        std::sort(cells.begin(),cells.end());
+    }
 
-                Eigen::MatrixXd bounds_n(2,3);
-                bounds_n << -1,-1,-1,
-                        1,1,1;
-                HistogramFactory hf_color(10,3,bounds_c);
-                HistogramFactory hf_normal(5,3,bounds_n);
-                hf_color.compute(sv.second);
-                hf_normal.compute(sv.second,"normal");
-
-                sample.resize(45);
-                int k = 0 , l = 0;
-                for(int i = 0; i < 30; i++){
-                    sample(i) = hf_color.get_histogram()[k](l);
-                    l = (l+1)%10;
-                    if(l == 0)
-                        k++;
-                }
-                l = 0; k = 0;
-                for(int i = 30; i < 45; i++){
-                    sample(i) = hf_normal.get_histogram()[k](l);
-                    l = (l+1)%5;
-                    if(l == 0)
-                        k++;
+    /**
+     * @brief index in the voxel cloud of the voxel of the neighborhood of a supervoxel closest to its centroid
+     * @param supervoxels
+     * @param k index of the supervoxel
+     * @return voxel index
+     */
+    static size_t central_voxel(const FlatSupervoxelArray& supervoxels, size_t k){
+        const PointT& centroid = supervoxels.centroid(k);
+        const PointCloudT& voxels = *supervoxels.voxel_cloud();
+        size_t closest = supervoxels.voxel_offset(k);
+        float min_dist = std::numeric_limits<float>::max();
+        auto search = [&](size_t sv){
+            for(size_t v = supervoxels.voxel_offset(sv); v < supervoxels.voxel_offset(sv+1); v++){
+                float dist = (voxels[v].getVector3fMap() - centroid.getVector3fMap()).squaredNorm();
+                if(dist < min_dist){
+                    min_dist = dist;
+                    closest = v;
+                }
+            }
+        };
+        search(k);
+        for(const int* n = supervoxels.neighbors_begin(k); n != supervoxels.neighbors_end(k); ++n)
+            search(*n);
+        return closest;
+    }
+
+    static std::map<std::string,function_t> create_map(){
+        std::map<std::string,function_t> map;
+
+        map.emplace("meanColorNormal",
+                [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("meanColorNormal",6);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    Eigen::VectorXd sample(6);
+                    sample[0] = supervoxels.centroid(sv).r;
+                    sample[1] = supervoxels.centroid(sv).g;
+                    sample[2] = supervoxels.centroid(sv).b;
+                    sample[3] = supervoxels.normal(sv).normal[0];
+                    sample[4] = supervoxels.normal(sv).normal[1];
+                    sample[5] = supervoxels.normal(sv).normal[2];
+                    results.row(sv) = sample.transpose();
                 }
-                features[sv.first]["colorNormalHist"] = sample;
-            }
+            });
         });
 
-        //TO DO
+        map.emplace("colorNormalHist",
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorNormalHist",45);
+            results.leftCols(30) = features.matrix(FeatureStore::modality_id("colorHist"));
+            results.rightCols(15) = features.matrix(FeatureStore::modality_id("normalHist"));
+        });
 //        map.emplace("colorHSVHistContrast",
 //                    [](const SupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
 
@@ -97,439 +163,290 @@ struct features_fct{
 //        });
 
         map.emplace("colorHSV",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                float hsv[3];
-                tools::rgb2hsv(sv.second->centroid_.r,
-                               sv.second->centroid_.g,
-                               sv.second->centroid_.b,
-                               hsv[0],hsv[1],hsv[2]);
-                Eigen::VectorXd sample(3);
-                sample << hsv[0], hsv[1], hsv[2];
-                features[sv.first]["colorHSV"] = sample;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorHSV",3);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                std::vector<float> colors(3*r.size());
+                tools::rgb2hsv(&supervoxels.centroid(r.begin()),r.size(),colors.data());
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    const float* hsv = &colors[3*(sv - r.begin())];
+                    Eigen::VectorXd sample(3);
+                    sample << hsv[0], hsv[1], hsv[2];
+                    results.row(sv) = sample.transpose();
+                }
+            });
         });
 
         map.emplace("colorLab",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                float Lab[3];
-                tools::rgb2Lab(sv.second->centroid_.r,
-                               sv.second->centroid_.g,
-                               sv.second->centroid_.b,
-                               Lab[0],Lab[1],Lab[2]);
-                Eigen::VectorXd sample(3);
-                sample << Lab[0], Lab[1], Lab[2];
-                features[sv.first]["colorLab"] = sample;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorLab",3);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                std::vector<float> colors(3*r.size());
+                tools::rgb2Lab(&supervoxels.centroid(r.begin()),r.size(),colors.data());
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    const float* Lab = &colors[3*(sv - r.begin())];
+                    Eigen::VectorXd sample(3);
+                    sample << Lab[0], Lab[1], Lab[2];
+                    results.row(sv) = sample.transpose();
+                }
+            });
         });
 
         map.emplace("colorLabHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-           for(const auto& sv: supervoxels){
-               std::vector<Eigen::VectorXd> data;
-               for(auto it = sv.second->voxels_->begin(); it != sv.second->voxels_->end(); ++it){
-                   float Lab[3];
-                   tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                   Eigen::VectorXd vect(3);
-                   vect(0) = Lab[0];
-                   vect(1) = Lab[1];
-                   vect[2] = Lab[2];
-                   data.push_back(vect);
-               }
-               Eigen::MatrixXd bounds(2,3);
-               bounds << 0,-1,-1,
-                       1,1,1;
-               HistogramFactory hf(5,3,bounds);
-               hf.compute(data);
-
-               Eigen::VectorXd sample(15);
-               int k = 0 , l = 0;
-               for(int i = 0; i < 15; i++){
-                   sample(i) = hf.get_histogram()[k](l);
-                   l = (l+1)%5;
-                   if(l == 0)
-                       k++;
-               }
-               features[sv.first]["colorLabHist"] = sample;
-           }
-        });
-
-        map.emplace("colorL",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                std::vector<Eigen::VectorXd> data;
-                for(auto it = sv.second->voxels_->begin(); it != sv.second->voxels_->end(); ++it){
-                    float Lab[3];
-                    tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                    Eigen::VectorXd vect(3);
-                    vect(0) = Lab[0];
-                    vect(1) = Lab[1];
-                    vect[2] = Lab[2];
-                    data.push_back(vect);
-                }
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+           FeatureStore::matrix_t& results = features.allocate("colorLabHist",15);
+           const std::vector<Eigen::VectorXd>& lab = supervoxels.voxel_lab();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<5,3>::bounds_t bounds;
                 bounds << 0,-1,-1,
                         1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(data);
+                Histogram<5,3> hist(bounds);
+                for(size_t sv = r.begin(); sv != r.end(); ++sv)
+                    hist.compute(lab.data() + supervoxels.voxel_offset(sv),lab.data() + supervoxels.voxel_offset(sv+1),
+                                 results.row(sv).data());
+            });
+        });
 
-                Eigen::VectorXd sample(5);
-                sample = hf.get_histogram()[0];
-                features[sv.first]["colorL"] = sample;
-            }
+        map.emplace("colorL",
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorL",5);
+            results = features.matrix(FeatureStore::modality_id("colorLabHist")).leftCols(5);
         });
 
         map.emplace("colora",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                std::vector<Eigen::VectorXd> data;
-                for(auto it = sv.second->voxels_->begin(); it != sv.second->voxels_->end(); ++it){
-                    float Lab[3];
-                    tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                    Eigen::VectorXd vect(3);
-                    vect(0) = Lab[0];
-                    vect(1) = Lab[1];
-                    vect[2] = Lab[2];
-                    data.push_back(vect);
-                }
-                Eigen::MatrixXd bounds(2,3);
-                bounds << 0,-1,-1,
-                        1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(data);
-
-                Eigen::VectorXd sample(5);
-                sample = hf.get_histogram()[1];
-                features[sv.first]["colora"] = sample;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colora",5);
+            results = features.matrix(FeatureStore::modality_id("colorLabHist")).middleCols(5,5);
         });
         map.emplace("colorb",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                std::vector<Eigen::VectorXd> data;
-                for(auto it = sv.second->voxels_->begin(); it != sv.second->voxels_->end(); ++it){
-                    float Lab[3];
-                    tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                    Eigen::VectorXd vect(3);
-                    vect(0) = Lab[0];
-                    vect(1) = Lab[1];
-                    vect[2] = Lab[2];
-                    data.push_back(vect);
-                }
-                Eigen::MatrixXd bounds(2,3);
-                bounds << 0,-1,-1,
-                        1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(data);
-
-                Eigen::VectorXd sample(5);
-                sample = hf.get_histogram()[2];
-                features[sv.first]["colorb"] = sample;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorb",5);
+            results = features.matrix(FeatureStore::modality_id("colorLabHist")).rightCols(5);
         });
 
         map.emplace("colorLabNormalHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-           for(const auto& sv: supervoxels){
-               std::vector<Eigen::VectorXd> data;
-               for(auto it = sv.second->voxels_->begin(); it != sv.second->voxels_->end(); ++it){
-                   float Lab[3];
-                   tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                   data.push_back(Eigen::VectorXd(3));
-                   data.back()[0] = Lab[0];
-                   data.back()[1] = Lab[1];
-                   data.back()[2] = Lab[2];
-               }
-               Eigen::MatrixXd bounds_c(2,3);
-               Eigen::MatrixXd bounds_n(2,3);
-               bounds_c << 0,-1,-1,
-                       1,1,1;
-               bounds_n << -1,-1,-1,
-                       1,1,1;
-               HistogramFactory hf_color(5,3,bounds_c);
-               hf_color.compute(data);
-               HistogramFactory hf_normal(5,3,bounds_n);
-               hf_normal.compute(sv.second,"normal");
-
-               Eigen::VectorXd sample(30);
-               int k = 0 , l = 0;
-               for(int i = 0; i < 15; i++){
-                   sample(i) = hf_color.get_histogram()[k](l);
-                   l = (l+1)%5;
-                   if(l == 0)
-                       k++;
-               }
-               k = 0; l = 0;
-               for(int i = 15; i < 30; i++){
-                   sample(i) = hf_normal.get_histogram()[k](l);
-                   l = (l+1)%5;
-                   if(l == 0)
-                       k++;
-               }
-               features[sv.first]["colorLabNormalHist"] = sample;
-           }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorLabNormalHist",30);
+            results.leftCols(15) = features.matrix(FeatureStore::modality_id("colorLabHist"));
+            results.rightCols(15) = features.matrix(FeatureStore::modality_id("normalHist"));
         });
 
 
         map.emplace("colorRGB",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::VectorXd sample(3);
-                sample << sv.second->centroid_.r,
-                        sv.second->centroid_.g,
-                        sv.second->centroid_.b;
-                features[sv.first]["colorRGB"] = sample;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorRGB",3);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    Eigen::VectorXd sample(3);
+                    sample << supervoxels.centroid(sv).r,
+                            supervoxels.centroid(sv).g,
+                            supervoxels.centroid(sv).b;
+                    results.row(sv) = sample.transpose();
+                }
+            });
         });
 
         map.emplace("colorH",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorH",5);
+            const std::vector<Eigen::VectorXd>& hsv = supervoxels.voxel_hsv();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<5,3>::bounds_t bounds;
                 bounds << 0,0,0,
                         1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second);
-                features[sv.first]["colorH"] = hf.get_histogram()[0];
-            }
+                Histogram<5,3> hist(bounds);
+                Histogram<5,3>::flat_t sample;
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    hist.compute(hsv.data() + supervoxels.voxel_offset(sv),hsv.data() + supervoxels.voxel_offset(sv+1),
+                                 sample.data());
+                    results.row(sv) = sample.segment<5>(0).transpose();
+                }
+            });
         });
 
         map.emplace("colorS",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorS",5);
+            const std::vector<Eigen::VectorXd>& hsv = supervoxels.voxel_hsv();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<5,3>::bounds_t bounds;
                 bounds << 0,0,0,
                         1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second);
-                features[sv.first]["colorS"] = hf.get_histogram()[1];
-            }
+                Histogram<5,3> hist(bounds);
+                Histogram<5,3>::flat_t sample;
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    hist.compute(hsv.data() + supervoxels.voxel_offset(sv),hsv.data() + supervoxels.voxel_offset(sv+1),
+                                 sample.data());
+                    results.row(sv) = sample.segment<5>(5).transpose();
+                }
+            });
         });
 
         map.emplace("colorV",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorV",5);
+            const std::vector<Eigen::VectorXd>& hsv = supervoxels.voxel_hsv();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<5,3>::bounds_t bounds;
                 bounds << 0,0,0,
                         1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second);
-                features[sv.first]["colorV"] = hf.get_histogram()[2];
-            }
+                Histogram<5,3> hist(bounds);
+                Histogram<5,3>::flat_t sample;
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    hist.compute(hsv.data() + supervoxels.voxel_offset(sv),hsv.data() + supervoxels.voxel_offset(sv+1),
+                                 sample.data());
+                    results.row(sv) = sample.segment<5>(10).transpose();
+                }
+            });
         });
 
         map.emplace("colorHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorHist",30);
+            const std::vector<Eigen::VectorXd>& hsv = supervoxels.voxel_hsv();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<10,3>::bounds_t bounds;
                 bounds << 0,0,0,
                         1,1,1;
-                HistogramFactory hf(10,3,bounds);
-                hf.compute(sv.second);
-
-                Eigen::VectorXd sample(30);
-                int k = 0 , l = 0;
-                for(int i = 0; i < 30; i++){
-                    sample(i) = hf.get_histogram()[k](l);
-                    l = (l+1)%10;
-                    if(l == 0)
-                        k++;
-                }
-                features[sv.first]["colorHist"] = sample;
-            }
+                Histogram<10,3> hist(bounds);
+                for(size_t sv = r.begin(); sv != r.end(); ++sv)
+                    hist.compute(hsv.data() + supervoxels.voxel_offset(sv),hsv.data() + supervoxels.voxel_offset(sv+1),
+                                 results.row(sv).data());
+            });
         });
 
         map.emplace("normal",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::VectorXd new_s(3);
-                new_s << sv.second->normal_.normal[0],
-                        sv.second->normal_.normal[1],
-                        sv.second->normal_.normal[2];
-                features[sv.first]["normal"] = new_s;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normal",3);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    Eigen::VectorXd new_s(3);
+                    new_s << supervoxels.normal(sv).normal[0],
+                            supervoxels.normal(sv).normal[1],
+                            supervoxels.normal(sv).normal[2];
+                    results.row(sv) = new_s.transpose();
+                }
+            });
         });
 
         map.emplace("normalX",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                Eigen::MatrixXd bounds(2,3);
-                bounds << -1,-1,-1,
-                        1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second,"normal");
-                features[sv.first]["normalX"] = hf.get_histogram()[0];
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normalX",5);
+            results = features.matrix(FeatureStore::modality_id("normalHist")).middleCols(0,5);
         });
 
         map.emplace("normalY",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                Eigen::MatrixXd bounds(2,3);
-                bounds << -1,-1,-1,
-                        1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second,"normal");
-                features[sv.first]["normalY"] = hf.get_histogram()[1];
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normalY",5);
+            results = features.matrix(FeatureStore::modality_id("normalHist")).middleCols(5,5);
         });
 
         map.emplace("normalZ",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                Eigen::MatrixXd bounds(2,3);
-                bounds << -1,-1,-1,
-                        1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second,"normal");
-                features[sv.first]["normalZ"] = hf.get_histogram()[2];
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normalZ",5);
+            results = features.matrix(FeatureStore::modality_id("normalHist")).middleCols(10,5);
         });
 
         map.emplace("normalHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normalHist",15);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<5,3>::bounds_t bounds;
                 bounds << -1,-1,-1,
                         1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute(sv.second,"normal");
-
-                Eigen::VectorXd sample(15);
-                int k = 0 , l = 0;
-                for(int i = 0; i < 15; i++){
-                    sample(i) = hf.get_histogram()[k](l);
-                    l = (l+1)%5;
-                    if(l == 0)
-                        k++;
-                }
-                features[sv.first]["normalHist"] = sample;
-            }
+                Histogram<5,3> hist(bounds);
+                for(size_t sv = r.begin(); sv != r.end(); ++sv)
+                    hist.compute(supervoxels.normals_begin(sv),supervoxels.normals_end(sv),results.row(sv).data());
+            });
         });
 
         map.emplace("normalHistLarge",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                std::vector<Eigen::VectorXd> data;
-                for(auto it = sv.second->normals_->begin(); it != sv.second->normals_->end(); ++it){
-                    Eigen::VectorXd vect(3);
-                    vect(0) = it->normal[0];
-                    vect(1) = it->normal[1];
-                    vect[2] = it->normal[2];
-                    data.push_back(vect);
-                }
-
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normalHistLarge",27);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<3,3>::bounds_t bounds;
                 bounds << -1,-1,-1,
                         1,1,1;
-                HistogramFactory hf(3,3,bounds);
-                hf.compute_multi_dim(data);
-
-                features[sv.first]["normalHistLarge"] = hf.get_histogram()[0];
-            }
+                Histogram<3,3> hist(bounds);
+                for(size_t sv = r.begin(); sv != r.end(); ++sv)
+                    hist.compute_multi_dim(supervoxels.normals_begin(sv),supervoxels.normals_end(sv),
+                                           results.row(sv).data());
+            });
         });
 
         map.emplace("normalHistNeigh",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            Eigen::VectorXd sum = Eigen::VectorXd::Zero(8);
-            Eigen::MatrixXd bounds(2,3);
-            bounds << -1,-1,-1,
-                    1,1,1;
-            HistogramFactory hf(2,3,bounds);
-            int count;
-            Eigen::VectorXd new_s(16);
-            for(const auto& sv: supervoxels){
-                std::vector<Eigen::VectorXd> data;
-                auto it_pair = adj_map.equal_range(sv.first);
-                count = 0;
-                data.clear();
-                for(auto it = it_pair.first; it != it_pair.second; it++){
-                    for(auto it_norm = supervoxels.at(it->second)->normals_->begin();
-                        it_norm != supervoxels.at(it->second)->normals_->end(); ++it_norm){
-                        Eigen::VectorXd vect(3);
-                        vect(0) = it_norm->normal[0];
-                        vect(1) = it_norm->normal[1];
-                        vect[2] = it_norm->normal[2];
-                        data.push_back(vect);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("normalHistNeigh",16);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<2,3>::multi_dim_t sum, hist_neigh;
+                Histogram<2,3>::bounds_t bounds;
+                bounds << -1,-1,-1,
+                        1,1,1;
+                Histogram<2,3> hist(bounds);
+                int count;
+                std::vector<pcl::Normal> data;
+
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    count = 0;
+                    sum.setZero();
+                    data.clear();
+                    for(auto it = supervoxels.neighbors_begin(sv); it != supervoxels.neighbors_end(sv); it++){
+                        data.insert(data.end(),supervoxels.normals_begin(*it),supervoxels.normals_end(*it));
+                        hist.compute_multi_dim(data.data(),data.data() + data.size(),hist_neigh.data());
+                        sum += hist_neigh;
+                        count++;
                     }
-                    hf.compute_multi_dim(data);
-                    sum += hf.get_histogram()[0];
-                    count++;
-                }
-
-                if(count > 0)
-                    sum = sum/(float)count;
-
 
+                    if(count > 0)
+                        sum = sum/(float)count;
+                    for(int i = 0; i < 8; i++)
+                        if(fabs(sum(i)) < 1e-4)
+                            sum(i) = 0.;
 
-                data.clear();
-                for(auto it = sv.second->normals_->begin(); it != sv.second->normals_->end(); ++it){
-                    Eigen::VectorXd vect(3);
-                    vect(0) = it->normal[0];
-                    vect(1) = it->normal[1];
-                    vect[2] = it->normal[2];
-                    data.push_back(vect);
+                    hist.compute_multi_dim(supervoxels.normals_begin(sv),supervoxels.normals_end(sv),
+                                           results.row(sv).data());
+                    results.row(sv).tail<8>() = sum.transpose();
                 }
-                hf.compute_multi_dim(data);
-
-                for(int i = 0; i < 8; i++)
-                    new_s(i) = hf.get_histogram()[0](i);
-                for(int i = 8; i < 16; i++){
-                    if(fabs(sum(i-8)) < 1e-4)
-                        sum(i-8) = 0.;
-                    new_s(i) = sum(i - 8);
-                }
-
-                features[sv.first]["normalHistNeigh"] = new_s;
-            }
+            });
         });
 
         map.emplace("colorLabHistLarge",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv: supervoxels){
-                std::vector<Eigen::VectorXd> data;
-                for(auto it = sv.second->voxels_->begin(); it != sv.second->voxels_->end(); ++it){
-                    float Lab[3];
-                    tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                    Eigen::VectorXd vect(3);
-                    vect(0) = Lab[0];
-                    vect(1) = Lab[1];
-                    vect[2] = Lab[2];
-                    data.push_back(vect);
-                }
-
-                Eigen::MatrixXd bounds(2,3);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorLabHistLarge",125);
+            const std::vector<Eigen::VectorXd>& lab = supervoxels.voxel_lab();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Histogram<5,3>::bounds_t bounds;
                 bounds << 0,-1,-1,
                         1,1,1;
-                HistogramFactory hf(5,3,bounds);
-                hf.compute_multi_dim(data);
-
-                features[sv.first]["colorLabHistLarge"] = hf.get_histogram()[0];
-            }
+                Histogram<5,3> hist(bounds);
+                for(size_t sv = r.begin(); sv != r.end(); ++sv)
+                    hist.compute_multi_dim(lab.data() + supervoxels.voxel_offset(sv),
+                                           lab.data() + supervoxels.voxel_offset(sv+1),
+                                           results.row(sv).data());
+            });
         });
 
 
 
         map.emplace("fpfh",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            PointCloudT::Ptr centroids(new PointCloudT);
-            PointCloudN::Ptr centroids_n(new PointCloudN);
-            std::map<int, uint32_t> centroids_lbl;
-
-            int i = 0;
-            for(auto it = supervoxels.begin()
-                ; it != supervoxels.end(); it++){
-                pcl::Supervoxel<PointT>::Ptr supervoxel = it->second;
-                centroids->push_back(supervoxel->centroid_);
-                centroids_n->push_back(supervoxel->normal_);
-                centroids_lbl.insert(std::pair<int,uint32_t>(i,it->first));
-                i++;
-            }
-
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("fpfh",33);
             pcl::FPFHEstimation<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-            fpfh.setInputCloud(centroids);
-            fpfh.setInputNormals(centroids_n);
+            fpfh.setInputCloud(supervoxels.centroid_cloud());
+            fpfh.setInputNormals(supervoxels.centroid_normal_cloud());
 
             pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
             fpfh.setSearchMethod(tree);
@@ -538,325 +455,89 @@ struct features_fct{
 
             pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
             fpfh.compute(*fpfh_cloud);
-            for(auto feat : centroids_lbl){
-                features[feat.second]["fpfh"] = Eigen::VectorXd(33);
+            for(size_t sv = 0; sv < supervoxels.size(); sv++){
+                auto feature = results.row(sv);
                 for(int i = 0; i < 33; ++i){
-                   features[feat.second]["fpfh"](i) = fpfh_cloud->points[feat.first].histogram[i]/100.;
+                   feature(i) = fpfh_cloud->points[sv].histogram[i]/100.;
                 }
             }
         });
 
         map.emplace("localMeanFPFH",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-
-            pcl::FPFHEstimationOMP<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-            pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-            pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-
-
-            for(const auto& sv : supervoxels){
-                fpfh.setInputCloud(sv.second->voxels_);
-                fpfh.setInputNormals(sv.second->normals_);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("localMeanFPFH",33);
+            Eigen::MatrixXd sums;
+            std::vector<int> counts;
+            fpfh_sums(supervoxels,sums,counts);
 
-                fpfh.setSearchMethod(tree);
-                fpfh.setRadiusSearch (0.05);
-                fpfh.compute(*fpfh_cloud);
-
-                features[sv.first]["localMeanFPFH"] = Eigen::VectorXd::Zero(33);
-                for(int i = 0; i < fpfh_cloud->size(); i++){
-                    for(int j = 0; j < 33; j++)
-                        features[sv.first]["localMeanFPFH"](j) += fpfh_cloud->points[i].histogram[j]/100.;
-                }
-                features[sv.first]["localMeanFPFH"] = features[sv.first]["localMeanFPFH"]/(double)fpfh_cloud->size();
+            for(size_t sv = 0; sv < supervoxels.size(); sv++){
+                if(counts[sv])
+                    results.row(sv) = sums.row(sv)/(double)counts[sv];
+                else results.row(sv).setZero();
             }
         });
 
         map.emplace("neighMeanFPFH",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            std::vector<uint32_t> lbls;
-
-            for(const auto& sv : supervoxels)
-                lbls.push_back(sv.first);
-
-            tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
-                              [&](const tbb::blocked_range<size_t>& r){
-
-                pcl::FPFHEstimationOMP<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-                pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-                PointCloudN::Ptr inputNormal(new PointCloudN);
-                PointCloudT::Ptr inputCloud(new PointCloudT);
-                pcl::IndicesPtr indices(new std::vector<int>);
-
-                for(int k = r.begin(); k < r.end(); k++){
-;
-                    inputNormal.reset(new PointCloudN);
-                    inputCloud.reset(new PointCloudT);
-                    auto it_pair = adj_map.equal_range(lbls[k]);
-                    for(auto it = it_pair.first; it != it_pair.second; it++){
-                        if(supervoxels.find(it->second) == supervoxels.end())
-                            continue;
-                        for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                            inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                            inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                        }
-                    }
-
-                    for(int i = 0; i < supervoxels.at(lbls[k])->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(lbls[k])->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(lbls[k])->voxels_->at(i));
-                    }
-
-                    indices.reset(new std::vector<int>);
-                    for(int i = 0; i < inputCloud->size(); i++)
-                        indices->push_back(i);
-
-                    fpfh.setInputCloud(inputCloud);
-                    fpfh.setInputNormals(inputNormal);
-                    fpfh.setIndices(indices);
-
-                    fpfh.setSearchMethod(tree);
-                    fpfh.setRadiusSearch (0.05);
-                    fpfh.compute(*fpfh_cloud);
-
-                    features[lbls[k]]["neighMeanFPFH"] = Eigen::VectorXd::Zero(33);
-                    for(int i = 0; i < fpfh_cloud->size(); i++){
-                        for(int j = 0; j < 33; j++)
-                            features[lbls[k]]["neighMeanFPFH"](j) += fpfh_cloud->points[i].histogram[j]/100.;
-                    }
-                    features[lbls[k]]["neighMeanFPFH"] = features[lbls[k]]["neighMeanFPFH"]/(double)fpfh_cloud->size();
-                }
-            });
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("neighMeanFPFH",33);
+            Eigen::MatrixXd sums;
+            std::vector<int> counts;
+            fpfh_sums(supervoxels,sums,counts);
+
+            for(size_t k = 0; k < supervoxels.size(); k++)
+                results.row(k) = neighborhood_fpfh(supervoxels,sums,counts,k).transpose();
        });
 
         map.emplace("meanFPFH",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            std::vector<uint32_t> lbls;
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("meanFPFH",33);
+            Eigen::MatrixXd sums;
+            std::vector<int> counts;
+            fpfh_sums(supervoxels,sums,counts);
 
-            for(const auto& sv : supervoxels){
-                lbls.push_back(sv.first);
-                features.emplace(sv.first,std::map<std::string,Eigen::VectorXd>());
-            }
-
-            tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
-                              [&](const tbb::blocked_range<size_t>& r){
+            Eigen::VectorXd new_s(33);
+            for(size_t k = 0; k < supervoxels.size(); k++){
+                new_s = neighborhood_fpfh(supervoxels,sums,counts,k);
 
-                pcl::FPFHEstimation<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-                pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-                PointCloudN::Ptr inputNormal(new PointCloudN);
-                PointCloudT::Ptr inputCloud(new PointCloudT);
-                pcl::IndicesPtr indices(new std::vector<int>);
-                Eigen::VectorXd new_s(33);
-                for(int k = r.begin(); k < r.end(); k++){
-                    inputNormal.reset(new PointCloudN);
-                    inputCloud.reset(new PointCloudT);
-                    auto it_pair = adj_map.equal_range(lbls[k]);
-                    for(auto it = it_pair.first; it != it_pair.second; it++){
-                        if(supervoxels.find(it->second) == supervoxels.end())
-                            continue;
-                        for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                            inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                            inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                        }
-                    }
-
-                    for(int i = 0; i < supervoxels.at(lbls[k])->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(lbls[k])->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(lbls[k])->voxels_->at(i));
-                    }
-
-                    indices.reset(new std::vector<int>);
-                    for(int i = 0; i < inputCloud->size(); i++)
-                        indices->push_back(i);
-
-                    fpfh.setInputCloud(inputCloud);
-                    fpfh.setInputNormals(inputNormal);
-                    fpfh.setIndices(indices);
-
-                    fpfh.setSearchMethod(tree);
-                    fpfh.setRadiusSearch (0.05);
-                    fpfh.compute(*fpfh_cloud);
-
-                    Eigen::VectorXd tmp = Eigen::VectorXd::Zero(33);
-                    for(int i = 0; i < fpfh_cloud->size(); i++){
-                        for(int j = 0; j < 33; j++)
-                            tmp(j) += fpfh_cloud->points[i].histogram[j]/100.;
-                    }
-                    tmp = tmp/(double)fpfh_cloud->size();
-                    for(int i = 0; i < 33; i++)
-                        new_s(i) = tmp(i);
-
-                    for(int i = 0; i < 33; i++){
-                        if(new_s(i) > 1)
-                            new_s(i) = 1;
-                        else if (new_s(i) < 10e-4)
-                            new_s(i) = 0;
-                    }
-                    features[lbls[k]]["meanFPFH"] = new_s;
+                for(int i = 0; i < 33; i++){
+                    if(new_s(i) > 1)
+                        new_s(i) = 1;
+                    else if (new_s(i) < 10e-4)
+                        new_s(i) = 0;
                 }
-            });
+                results.row(k) = new_s.transpose();
+            }
         });
 
         map.emplace("meanFPFHLabHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-
-            std::vector<uint32_t> lbls;
-
-            for(const auto& sv : supervoxels){
-                lbls.push_back(sv.first);
-                features.emplace(sv.first,std::map<std::string,Eigen::VectorXd>());
-            }
-
-            tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
-                              [&](const tbb::blocked_range<size_t>& r){
-
-                pcl::FPFHEstimation<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-                pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-                PointCloudN::Ptr inputNormal(new PointCloudN);
-                PointCloudT::Ptr inputCloud(new PointCloudT);
-                pcl::IndicesPtr indices(new std::vector<int>);
-                Eigen::VectorXd new_s(48);
-                for(int k = r.begin(); k < r.end(); k++){
-//                for(int k = 0; k < lbls.size(); k++){
-                    //* Lab
-                    std::vector<Eigen::VectorXd> data;
-                    for(auto it = supervoxels.at(lbls[k])->voxels_->begin(); it != supervoxels.at(lbls[k])->voxels_->end(); ++it){
-                        float Lab[3];
-                        tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                        Eigen::VectorXd vect(3);
-                        vect(0) = Lab[0];
-                        vect(1) = Lab[1];
-                        vect[2] = Lab[2];
-                        data.push_back(vect);
-                    }
-                    Eigen::MatrixXd bounds(2,3);
-                    bounds << 0,-1,-1,
-                            1,1,1;
-                    HistogramFactory hf(5,3,bounds);
-                    hf.compute(data);
-
-                    int t = 0 , l = 0;
-                    for(int i = 0; i < 15; i++){
-                        new_s(i) = hf.get_histogram()[t](l);
-                        l = (l+1)%5;
-                        if(l == 0)
-                            t++;
-                    }
-                    //*/
-
-                    //* FPFH
-                    inputNormal.reset(new PointCloudN);
-                    inputCloud.reset(new PointCloudT);
-                    auto it_pair = adj_map.equal_range(lbls[k]);
-                    for(auto it = it_pair.first; it != it_pair.second; it++){
-                        if(supervoxels.find(it->second) == supervoxels.end())
-                            continue;
-                        for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                            inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                            inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                        }
-                    }
-
-                    for(int i = 0; i < supervoxels.at(lbls[k])->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(lbls[k])->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(lbls[k])->voxels_->at(i));
-                    }
-
-                    indices.reset(new std::vector<int>);
-                    for(int i = 0; i < inputCloud->size(); i++)
-                        indices->push_back(i);
-
-                    fpfh.setInputCloud(inputCloud);
-                    fpfh.setInputNormals(inputNormal);
-                    fpfh.setIndices(indices);
-
-                    fpfh.setSearchMethod(tree);
-                    fpfh.setRadiusSearch (0.05);
-                    fpfh.compute(*fpfh_cloud);
-
-                    Eigen::VectorXd tmp = Eigen::VectorXd::Zero(33);
-                    for(int i = 0; i < fpfh_cloud->size(); i++){
-                        for(int j = 0; j < 33; j++)
-                            tmp(j) += fpfh_cloud->points[i].histogram[j]/100.;
-                    }
-                    tmp = tmp/(double)fpfh_cloud->size();
-                    for(int i = 0; i < 33; i++)
-                        new_s(i+15) = tmp(i);
-                    //*/
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("meanFPFHLabHist",48);
+            results.leftCols(15) = features.matrix(FeatureStore::modality_id("colorLabHist"));
+            results.rightCols(33) = features.matrix(FeatureStore::modality_id("meanFPFH"));
 
-                    for(int i = 0; i < 48; i++){
-                        if(new_s(i) > 1)
-                            new_s(i) = 1;
-                        else if (new_s(i) < 10e-4)
-                            new_s(i) = 0;
-                    }
-                    features[lbls[k]]["meanFPFHLabHist"] = new_s;
+            for(int k = 0; k < results.rows(); k++){
+                for(int i = 0; i < 48; i++){
+                    if(results(k,i) > 1)
+                        results(k,i) = 1;
+                    else if (results(k,i) < 10e-4)
+                        results(k,i) = 0;
                 }
-            });
+            }
         });
 
         map.emplace("centralFPFH",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            std::vector<uint32_t> lbls;
-            for(const auto& sv : supervoxels){
-                lbls.push_back(sv.first);
-                features.emplace(sv.first,std::map<std::string,Eigen::VectorXd>());
-            }
-            tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("centralFPFH",33);
+            const pcl::PointCloud<pcl::FPFHSignature33>& signatures = supervoxels.voxel_fpfh();
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
                               [&](const tbb::blocked_range<size_t>& r){
-                pcl::FPFHEstimation<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-                pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-                PointCloudN::Ptr inputNormal(new PointCloudN);
-                PointCloudT::Ptr inputCloud(new PointCloudT);
-                pcl::IndicesPtr indices(new std::vector<int>);
                 Eigen::VectorXd new_s(33);
                 for(int k = r.begin(); k < r.end(); k++){
-
-                    inputNormal.reset(new PointCloudN);
-                    inputCloud.reset(new PointCloudT);
-                    auto it_pair = adj_map.equal_range(lbls[k]);
-                    for(auto it = it_pair.first; it != it_pair.second; it++){
-                        if(supervoxels.find(it->second) == supervoxels.end())
-                            continue;
-                        for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                            inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                            inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                        }
-                    }
-
-                    for(int i = 0; i < supervoxels.at(lbls[k])->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(lbls[k])->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(lbls[k])->voxels_->at(i));
-                    }
-
-                    indices.reset(new std::vector<int>);
-                    for(int i = 0; i < inputCloud->size(); i++)
-                        indices->push_back(i);
-
-                    fpfh.setInputCloud(inputCloud);
-                    fpfh.setInputNormals(inputNormal);
-                    fpfh.setIndices(indices);
-
-                    fpfh.setSearchMethod(tree);
-                    fpfh.setRadiusSearch (0.05*inputCloud->size());
-                    fpfh.compute(*fpfh_cloud);
-
-                    PointT centroid = supervoxels.at(lbls[k])->centroid_;
-
-                    pcl::KdTreeFLANN<PointT> tree;
-                    tree.setInputCloud(inputCloud);
-
-                    std::vector<int> nn_indices(1);
-                    std::vector<float> nn_distance(1);
-
-                    if(!tree.nearestKSearch(centroid,1,nn_indices,nn_distance))
-                        return false;
+                    size_t central = central_voxel(supervoxels,k);
 
                     for(int i = 0; i < 33; i++)
-                        new_s(i) = fpfh_cloud->points[nn_indices[0]].histogram[i]/100.;
+                        new_s(i) = signatures[central].histogram[i]/100.;
 
                     for(int i = 0; i < 33; i++){
                         if(new_s(i) > 1)
@@ -864,7 +545,7 @@ struct features_fct{
                         else if (new_s(i) < 10e-4)
                             new_s(i) = 0;
                     }
-                    features[lbls[k]]["centralFPFH"] = new_s;
+                    results.row(k) = new_s.transpose();
                 }
             });
         });
@@ -872,192 +553,68 @@ struct features_fct{
 
 
         map.emplace("centralFPFHLabHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-
-            std::vector<uint32_t> lbls;
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("centralFPFHLabHist",48);
+            results.leftCols(15) = features.matrix(FeatureStore::modality_id("colorLabHist"));
+            results.rightCols(33) = features.matrix(FeatureStore::modality_id("centralFPFH"));
 
-            for(const auto& sv : supervoxels){
-                lbls.push_back(sv.first);
-                features.emplace(sv.first,std::map<std::string,Eigen::VectorXd>());
-            }
-
-            tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
-                              [&](const tbb::blocked_range<size_t>& r){
-
-                pcl::FPFHEstimation<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-                pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-                PointCloudN::Ptr inputNormal(new PointCloudN);
-                PointCloudT::Ptr inputCloud(new PointCloudT);
-                pcl::IndicesPtr indices(new std::vector<int>);
-                Eigen::VectorXd new_s(48);
-                for(int k = r.begin(); k < r.end(); k++){
-//                for(int k = 0; k < lbls.size(); k++){
-                    //* Lab
-                    std::vector<Eigen::VectorXd> data;
-                    for(auto it = supervoxels.at(lbls[k])->voxels_->begin(); it != supervoxels.at(lbls[k])->voxels_->end(); ++it){
-                        float Lab[3];
-                        tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                        Eigen::VectorXd vect(3);
-                        vect(0) = Lab[0];
-                        vect(1) = Lab[1];
-                        vect[2] = Lab[2];
-                        data.push_back(vect);
-                    }
-                    Eigen::MatrixXd bounds(2,3);
-                    bounds << 0,-1,-1,
-                            1,1,1;
-                    HistogramFactory hf(5,3,bounds);
-                    hf.compute(data);
-
-                    int t = 0 , l = 0;
-                    for(int i = 0; i < 15; i++){
-                        new_s(i) = hf.get_histogram()[t](l);
-                        l = (l+1)%5;
-                        if(l == 0)
-                            t++;
-                    }
-                    //*/
-
-                    //* FPFH
-                    inputNormal.reset(new PointCloudN);
-                    inputCloud.reset(new PointCloudT);
-                    auto it_pair = adj_map.equal_range(lbls[k]);
-                    for(auto it = it_pair.first; it != it_pair.second; it++){
-                        if(supervoxels.find(it->second) == supervoxels.end())
-                            continue;
-                        for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                            inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                            inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                        }
-                    }
-
-                    for(int i = 0; i < supervoxels.at(lbls[k])->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(lbls[k])->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(lbls[k])->voxels_->at(i));
-                    }
-
-                    indices.reset(new std::vector<int>);
-                    for(int i = 0; i < inputCloud->size(); i++)
-                        indices->push_back(i);
-
-                    fpfh.setInputCloud(inputCloud);
-                    fpfh.setInputNormals(inputNormal);
-                    fpfh.setIndices(indices);
-
-                    fpfh.setSearchMethod(tree);
-                    fpfh.setRadiusSearch (0.05*inputCloud->size());
-                    fpfh.compute(*fpfh_cloud);
-
-                    PointT centroid = supervoxels.at(lbls[k])->centroid_;
-
-                    pcl::KdTreeFLANN<PointT> tree;
-                    tree.setInputCloud(inputCloud);
-
-                    std::vector<int> nn_indices(1);
-                    std::vector<float> nn_distance(1);
-
-                    if(!tree.nearestKSearch(centroid,1,nn_indices,nn_distance))
-                        return false;
-
-                    for(int i = 0; i < 33; i++)
-                        new_s(i+15) = fpfh_cloud->points[nn_indices[0]].histogram[i]/100.;
-                    //*/
-
-                    for(int i = 0; i < 48; i++){
-                        if(new_s(i) > 1)
-                            new_s(i) = 1;
-                        else if (new_s(i) < 10e-4)
-                            new_s(i) = 0;
-                    }
-                    features[lbls[k]]["centralFPFHLabHist"] = new_s;
+            for(int k = 0; k < results.rows(); k++){
+                for(int i = 0; i < 48; i++){
+                    if(results(k,i) > 1)
+                        results(k,i) = 1;
+                    else if (results(k,i) < 10e-4)
+                        results(k,i) = 0;
                 }
-            });
+            }
         });
 
         map.emplace("circleFPFHLabHist",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-
-            std::vector<uint32_t> lbls;
-
-            for(const auto& sv : supervoxels){
-                lbls.push_back(sv.first);
-                features.emplace(sv.first,std::map<std::string,Eigen::VectorXd>());
-            }
-
-            tbb::parallel_for(tbb::blocked_range<size_t>(0,lbls.size()),
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("circleFPFHLabHist",48);
+            const pcl::PointCloud<pcl::FPFHSignature33>& signatures = supervoxels.voxel_fpfh();
+            const PointCloudT& voxels = *supervoxels.voxel_cloud();
+            const FeatureStore::matrix_t& lab_hist = features.matrix(FeatureStore::modality_id("colorLabHist"));
+            const double radius = 0.2;
+            //cells a bit larger than the radius so that the 3x3 cells around a centroid contain its cylinder
+            const float cell_size = 1.01*radius;
+            std::vector<std::pair<uint64_t,int>> cells;
+            fpfh_xy_grid(supervoxels,cell_size,cells);
+
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
                               [&](const tbb::blocked_range<size_t>& r){
 
-                pcl::FPFHEstimation<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
-                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-                pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfh_cloud(new pcl::PointCloud<pcl::FPFHSignature33>);
-                PointCloudN::Ptr inputNormal(new PointCloudN);
-                PointCloudT::Ptr inputCloud(new PointCloudT);
-                pcl::IndicesPtr indices(new std::vector<int>);
                 Eigen::VectorXd new_s(48);
                 for(int k = r.begin(); k < r.end(); k++){
-//                for(int k = 0; k < lbls.size(); k++){
                     //* Lab
-                    std::vector<Eigen::VectorXd> data;
-                    for(auto it = supervoxels.at(lbls[k])->voxels_->begin(); it != supervoxels.at(lbls[k])->voxels_->end(); ++it){
-                        float Lab[3];
-                        tools::rgb2Lab(it->r,it->g,it->b,Lab[0],Lab[1],Lab[2]);
-                        Eigen::VectorXd vect(3);
-                        vect(0) = Lab[0];
-                        vect(1) = Lab[1];
-                        vect[2] = Lab[2];
-                        data.push_back(vect);
-                    }
-                    Eigen::MatrixXd bounds(2,3);
-                    bounds << 0,-1,-1,
-                            1,1,1;
-                    HistogramFactory hf(5,3,bounds);
-                    hf.compute(data);
-
-                    int t = 0 , l = 0;
-                    for(int i = 0; i < 15; i++){
-                        new_s(i) = hf.get_histogram()[t](l);
-                        l = (l+1)%5;
-                        if(l == 0)
-                            t++;
-                    }
+                    new_s.head(15) = lab_hist.row(k).transpose();
                     //*/
 
-                    //* FPFH
-                    inputNormal.reset(new PointCloudN);
-                    inputCloud.reset(new PointCloudT);
+                    //* FPFH : mean over the voxels in a vertical cylinder of radius 0.2 around the centroid,
+                    //found in the 3x3 cells of the XY grid around the one of the centroid
                     double x,y,center_x,center_y;
-                    center_x = supervoxels.at(k)->centroid_.x;
-                    center_y = supervoxels.at(k)->centroid_.y;
-                    for(const auto &sv : supervoxels){
-                        for(int i = 0; sv.second->voxels_->size(); i++){
-                            x = sv.second->voxels_->at(i).x;
-                            y = sv.second->voxels_->at(i).y;
-                            if((x-center_x)*(x-center_x) + (y - center_y)*(y - center_y) <= 0.2*0.2){
-                                inputNormal->push_back(sv.second->normals_->at(i));
-                                inputCloud->push_back(sv.second->voxels_->at(i));
+                    center_x = supervoxels.centroid(k).x;
+                    center_y = supervoxels.centroid(k).y;
+                    Eigen::VectorXd tmp = Eigen::VectorXd::Zero(33);
+                    int count = 0;
+                    Eigen::Vector3i center_cell = tools::cell_of(center_x,center_y,0,1.f/cell_size);
+                    for(int ci = -1; ci <= 1; ci++){
+                        for(int cj = -1; cj <= 1; cj++){
+                            uint64_t key = tools::cell_key(center_cell + Eigen::Vector3i(ci,cj,0));
+                            auto it = std::lower_bound(cells.begin(),cells.end(),std::make_pair(key,0));
+                            for(; it != cells.end() && it->first == key; ++it){
+                                int i = it->second;
+                                x = voxels[i].x;
+                                y = voxels[i].y;
+                                if((x-center_x)*(x-center_x) + (y - center_y)*(y - center_y) > radius*radius)
+                                    continue;
+                                for(int j = 0; j < 33; j++)
+                                    tmp(j) += signatures[i].histogram[j]/100.;
+                                count++;
                             }
                         }
                     }
-
-                    indices.reset(new std::vector<int>);
-                    for(int i = 0; i < inputCloud->size(); i++)
-                        indices->push_back(i);
-
-                    fpfh.setInputCloud(inputCloud);
-                    fpfh.setInputNormals(inputNormal);
-                    fpfh.setIndices(indices);
-
-                    fpfh.setSearchMethod(tree);
-                    fpfh.setRadiusSearch (0.05);
-                    fpfh.compute(*fpfh_cloud);
-
-                    Eigen::VectorXd tmp = Eigen::VectorXd::Zero(33);
-                    for(int i = 0; i < fpfh_cloud->size(); i++){
-                        for(int j = 0; j < 33; j++)
-                            tmp(j) += fpfh_cloud->points[i].histogram[j]/100.;
-                    }
-                    tmp = tmp/(double)fpfh_cloud->size();
+                    if(count)
+                        tmp = tmp/(double)count;
                     for(int i = 0; i < 33; i++)
                         new_s(i+15) = tmp(i);
                     //*/
@@ -1068,195 +625,176 @@ struct features_fct{
                         else if (new_s(i) < 10e-4)
                             new_s(i) = 0;
                     }
-                    features[lbls[k]]["circleFPFHLabHist"] = new_s;
+                    results.row(k) = new_s.transpose();
                 }
             });
         });
 
         map.emplace("colorHSVNormal",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                float hsv[3];
-                tools::rgb2hsv(sv.second->centroid_.r,
-                               sv.second->centroid_.g,
-                               sv.second->centroid_.b,
-                               hsv[0],hsv[1],hsv[2]);
-
-                Eigen::VectorXd new_s(6);
-                new_s << sv.second->normal_.normal[0],
-                        sv.second->normal_.normal[1],
-                        sv.second->normal_.normal[2]
-                        , hsv[0], hsv[1], hsv[2];
-                features[sv.first]["colorHSVNormal"] = new_s;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorHSVNormal",6);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                std::vector<float> colors(3*r.size());
+                tools::rgb2hsv(&supervoxels.centroid(r.begin()),r.size(),colors.data());
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    const float* hsv = &colors[3*(sv - r.begin())];
+
+                    Eigen::VectorXd new_s(6);
+                    new_s << supervoxels.normal(sv).normal[0],
+                            supervoxels.normal(sv).normal[1],
+                            supervoxels.normal(sv).normal[2]
+                            , hsv[0], hsv[1], hsv[2];
+                    results.row(sv) = new_s.transpose();
+                }
+            });
         });
 
         map.emplace("colorRGBNormal",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            for(const auto& sv : supervoxels){
-                Eigen::VectorXd new_s(6);
-                new_s << sv.second->normal_.normal[0],
-                        sv.second->normal_.normal[1],
-                        sv.second->normal_.normal[2],
-                        sv.second->centroid_.r,
-                        sv.second->centroid_.g,
-                        sv.second->centroid_.b;
-                features[sv.first]["colorRGBNormal"] = new_s;
-            }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("colorRGBNormal",6);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    Eigen::VectorXd new_s(6);
+                    new_s << supervoxels.normal(sv).normal[0],
+                            supervoxels.normal(sv).normal[1],
+                            supervoxels.normal(sv).normal[2],
+                            supervoxels.centroid(sv).r,
+                            supervoxels.centroid(sv).g,
+                            supervoxels.centroid(sv).b;
+                    results.row(sv) = new_s.transpose();
+                }
+            });
         });
 
         map.emplace("principalCurvatures",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            pcl::PrincipalCurvaturesEstimation<PointT,pcl::Normal,pcl::PrincipalCurvatures> pce;
-            Eigen::VectorXd new_s(5);
-            std::vector<int> indices;
-            pcl::KdTreeFLANN<PointT>::Ptr tree(new pcl::KdTreeFLANN<PointT>);
-            std::vector<int> ind_tree(1);
-            std::vector<float> dist_tree(1);
-            float cx, cy, cz, c_min, c_max;
-            PointCloudN::Ptr inputNormal(new PointCloudN);
-            PointCloudT::Ptr inputCloud(new PointCloudT);
-
-            for(const auto& sv : supervoxels){
-                inputNormal->clear();
-                inputCloud->clear();
-                auto it_pair = adj_map.equal_range(sv.first);
-                for(auto it = it_pair.first; it != it_pair.second; it++){
-                    if(supervoxels.find(it->second) == supervoxels.end())
-                        continue;
-                    for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                    }
-                }
-
-                for(int i = 0; i < sv.second->normals_->size(); i++){
-                    inputNormal->push_back(sv.second->normals_->at(i));
-                    inputCloud->push_back(sv.second->voxels_->at(i));
-                }
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("principalCurvatures",5);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                pcl::PrincipalCurvaturesEstimation<PointT,pcl::Normal,pcl::PrincipalCurvatures> pce;
+                Eigen::VectorXd new_s(5);
+                std::vector<int> indices;
+                pcl::KdTreeFLANN<PointT>::Ptr tree(new pcl::KdTreeFLANN<PointT>);
+                std::vector<int> ind_tree(1);
+                std::vector<float> dist_tree(1);
+                float cx, cy, cz, c_min, c_max;
+                PointCloudN::Ptr inputNormal(new PointCloudN);
+                PointCloudT::Ptr inputCloud(new PointCloudT);
 
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    supervoxels.get_neighborhood(sv,*inputCloud,*inputNormal);
 
+                    indices.clear();
+                    for(int i = 0; i < inputCloud->size(); i++)
+                        indices.push_back(i);
 
-                indices.clear();
-                for(int i = 0; i < inputCloud->size(); i++)
-                    indices.push_back(i);
+                    tree->setInputCloud(inputCloud);
+                    tree->nearestKSearch(supervoxels.centroid(sv),1,ind_tree,dist_tree);
+                    pce.computePointPrincipalCurvatures(*inputNormal,ind_tree[0],indices,
+                            cx,cy,cz,c_max,c_min);
 
-                tree->setInputCloud(inputCloud);
-                tree->nearestKSearch(sv.second->centroid_,1,ind_tree,dist_tree);
-                pce.computePointPrincipalCurvatures(*inputNormal,ind_tree[0],indices,
-                        cx,cy,cz,c_max,c_min);
+                    new_s << cx,cy,cz,c_max,c_min;
 
-                new_s << cx,cy,cz,c_max,c_min;
+                    for(int i = 0; i < new_s.rows(); i++)
+                    {
+                        if(fabs(new_s(i)) < 1e-4)
+                            new_s(i) = 0.;
+                        else if(new_s(i) > 1.)
+                            new_s(i) = 1.;
+                        else if(new_s(i) < -1.)
+                            new_s(i) = -1.;
+                    }
 
-                for(int i = 0; i < new_s.rows(); i++)
-                {
-                    if(fabs(new_s(i)) < 1e-4)
-                        new_s(i) = 0.;
-                    else if(new_s(i) > 1.)
-                        new_s(i) = 1.;
-                    else if(new_s(i) < -1.)
-                        new_s(i) = -1.;
+                    results.row(sv) = new_s.transpose();
                 }
-
-                features[sv.first]["principalCurvatures"] = new_s;
-            }
+            });
         });
 
         map.emplace("prinCurvNeigh",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            pcl::PrincipalCurvaturesEstimation<PointT,pcl::Normal,pcl::PrincipalCurvatures> pce;
-            Eigen::VectorXd new_s(10);
-            std::vector<int> indices;
-            pcl::KdTreeFLANN<PointT>::Ptr tree(new pcl::KdTreeFLANN<PointT>);
-            std::vector<int> ind_tree(1);
-            std::vector<float> dist_tree(1);
-            float cx, cy, cz, c_min, c_max;
-            float cx2, cy2, cz2, c_min2, c_max2;
-            float cx_n, cy_n, cz_n, c_min_n, c_max_n;
-            int count;
-            for(const auto& sv : supervoxels){
-                count = 0;
-                cx_n = 0; cy_n = 0; cz_n = 0; c_min_n = 0; c_max_n = 0;
-                auto it_pair = adj_map.equal_range(sv.first);
-                for(auto it = it_pair.first; it != it_pair.second; it++){
-                    if(supervoxels.find(it->second) == supervoxels.end())
-                        continue;
-                    indices.clear();
-                    for(int i = 0; i < sv.second->normals_->size(); i++)
-                        indices.push_back(i);
-
-                    tree->setInputCloud(sv.second->voxels_);
-                    tree->nearestKSearch(sv.second->centroid_,1,ind_tree,dist_tree);
-                    pce.computePointPrincipalCurvatures(*(sv.second->normals_),ind_tree[0],indices,
-                            cx,cy,cz,c_max,c_min);
-
-                    indices.clear();
-                    for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++)
-                        indices.push_back(i);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("prinCurvNeigh",10);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                pcl::PrincipalCurvaturesEstimation<PointT,pcl::Normal,pcl::PrincipalCurvatures> pce;
+                Eigen::VectorXd new_s(10);
+                pcl::KdTreeFLANN<PointT>::Ptr tree(new pcl::KdTreeFLANN<PointT>);
+                std::vector<int> ind_tree(1);
+                std::vector<float> dist_tree(1);
+                float cx, cy, cz, c_min, c_max;
+                float cx2, cy2, cz2, c_min2, c_max2;
+                float cx_n, cy_n, cz_n, c_min_n, c_max_n;
+                int count;
+
+                //the supervoxels are searched in the contiguous voxel cloud through their indices
+                auto curvatures = [&](size_t sv, float& pcx, float& pcy, float& pcz, float& pc1, float& pc2){
+                    boost::shared_ptr<std::vector<int>> indices(new std::vector<int>(supervoxels.nbr_voxels(sv)));
+                    for(int i = 0; i < indices->size(); i++)
+                        (*indices)[i] = supervoxels.voxel_offset(sv) + i;
+
+                    tree->setInputCloud(supervoxels.voxel_cloud(),indices);
+                    tree->nearestKSearch(supervoxels.centroid(sv),1,ind_tree,dist_tree);
+                    pce.computePointPrincipalCurvatures(*supervoxels.normal_cloud(),ind_tree[0],*indices,
+                            pcx,pcy,pcz,pc1,pc2);
+                };
+
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    count = 0;
+                    cx_n = 0; cy_n = 0; cz_n = 0; c_min_n = 0; c_max_n = 0;
+                    curvatures(sv,cx,cy,cz,c_max,c_min);
+                    for(auto it = supervoxels.neighbors_begin(sv); it != supervoxels.neighbors_end(sv); it++){
+                        curvatures(*it,cx2,cy2,cz2,c_max2,c_min2);
+                        cx_n+= fabs(cx-cx2);
+                        cy_n+= fabs(cy-cy2);
+                        cz_n+= fabs(cz-cz2);
+                        c_min_n+= fabs(c_min-c_min2);
+                        c_max_n+= fabs(c_max-c_max2);
+                        count++;
+                    }
+                    if(count > 0){
+                        cx_n = cx_n/(float)count;
+                        cy_n = cy_n/(float)count;
+                        cz_n = cz_n/(float)count;
+                        c_min_n = c_min_n/(float)count;
+                        c_max_n = c_max_n/(float)count;
+                    }
 
-                    tree->setInputCloud(supervoxels.at(it->second)->voxels_);
-                    tree->nearestKSearch(supervoxels.at(it->second)->centroid_,1,ind_tree,dist_tree);
-                    pce.computePointPrincipalCurvatures(*(supervoxels.at(it->second)->normals_),ind_tree[0],indices,
-                            cx2,cy2,cz2,c_max2,c_min2);
-                    cx_n+= fabs(cx-cx2);
-                    cy_n+= fabs(cy-cy2);
-                    cz_n+= fabs(cz-cz2);
-                    c_min_n+= fabs(c_min-c_min2);
-                    c_max_n+= fabs(c_max-c_max2);
-                    count++;
-                }
-                if(count > 0){
-                    cx_n = cx_n/(float)count;
-                    cy_n = cy_n/(float)count;
-                    cz_n = cz_n/(float)count;
-                    c_min_n = c_min_n/(float)count;
-                    c_max_n = c_max_n/(float)count;
-                }
 
 
+                    new_s << cx, cy, cz, c_max, c_min, cx_n, cy_n, cz_n, c_max_n, c_min_n;
 
-                new_s << cx, cy, cz, c_max, c_min, cx_n, cy_n, cz_n, c_max_n, c_min_n;
 
+                    for(int i = 0; i < new_s.rows(); i++)
+                    {
+                        if(fabs(new_s(i)) < 1e-4)
+                            new_s(i) = 0.;
+                        else if(new_s(i) > 1.)
+                            new_s(i) = 1.;
+                        else if(new_s(i) < -1.)
+                            new_s(i) = -1.;
+                    }
 
-                for(int i = 0; i < new_s.rows(); i++)
-                {
-                    if(fabs(new_s(i)) < 1e-4)
-                        new_s(i) = 0.;
-                    else if(new_s(i) > 1.)
-                        new_s(i) = 1.;
-                    else if(new_s(i) < -1.)
-                        new_s(i) = -1.;
+                    results.row(sv) = new_s.transpose();
                 }
-
-                features[sv.first]["prinCurvNeigh"] = new_s;
-            }
+            });
         });
 
         map.emplace("centroidsPrinCurv",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("centroidsPrinCurv",5);
             pcl::PrincipalCurvaturesEstimation<PointT,pcl::Normal,pcl::PrincipalCurvatures> pce;
             pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
 
 
             Eigen::VectorXd new_s(5);
 
-            PointCloudN::Ptr normals(new PointCloudN);
-            PointCloudT::Ptr centroids(new PointCloudT);
-            std::vector<uint32_t> lbl;
-
             pcl::PointCloud<pcl::PrincipalCurvatures> output_cloud;
 
-
-            for(const auto& sv : supervoxels){
-                normals->push_back(sv.second->normal_);
-                centroids->push_back(sv.second->centroid_);
-                lbl.push_back(sv.first);
-            }
-
             pce.setSearchMethod(tree);
             pce.setRadiusSearch(0.1);
-            pce.setInputNormals(normals);
-            pce.setInputCloud(centroids);
+            pce.setInputNormals(supervoxels.centroid_normal_cloud());
+            pce.setInputCloud(supervoxels.centroid_cloud());
 
             pce.compute(output_cloud);
 
@@ -1279,43 +817,44 @@ struct features_fct{
 
                 }
 
-                features[lbl[i]]["centroidsPrinCurv"] = new_s;
+                results.row(i) = new_s.transpose();
             }
 
         });
         map.emplace("momentInvariant",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
-            Eigen::VectorXd new_s(3);
-            pcl::MomentInvariantsEstimation<PointT,pcl::MomentInvariants> mie;
-            mie.setRadiusSearch(0.005);
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("momentInvariant",3);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Eigen::VectorXd new_s(3);
+                pcl::MomentInvariantsEstimation<PointT,pcl::MomentInvariants> mie;
+                mie.setRadiusSearch(0.005);
 
-            float j1,j2,j3;
-            for(const auto& sv : supervoxels){
-                mie.computePointMomentInvariants(*(sv.second->voxels_),j1,j2,j3);
-                new_s << j1, j2, j3;
-                features[sv.first]["momentInvariant"] = new_s;
-            }
+                float j1,j2,j3;
+                std::vector<int> indices;
+
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    indices.resize(supervoxels.nbr_voxels(sv));
+                    for(int i = 0; i < indices.size(); i++)
+                        indices[i] = supervoxels.voxel_offset(sv) + i;
+                    mie.computePointMomentInvariants(*supervoxels.voxel_cloud(),indices,j1,j2,j3);
+                    new_s << j1, j2, j3;
+                    results.row(sv) = new_s.transpose();
+                }
+            });
         });
         map.emplace("centroidsMomInv",
-                    [](const SupervoxelArray& supervoxels, const AdjacencyMap&, SupervoxelSet::features_t& features){
+                    [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("centroidsMomInv",3);
             pcl::MomentInvariantsEstimation<PointT,pcl::MomentInvariants> mie;
 
             mie.setRadiusSearch(0.005);
 
             Eigen::VectorXd new_s(3);
 
-            PointCloudT::Ptr centroids(new PointCloudT);
-            std::vector<uint32_t> lbl;
-
             pcl::PointCloud<pcl::MomentInvariants> output_cloud;
 
-
-            for(const auto& sv : supervoxels){
-                centroids->push_back(sv.second->centroid_);
-                lbl.push_back(sv.first);
-            }
-
-            mie.setInputCloud(centroids);
+            mie.setInputCloud(supervoxels.centroid_cloud());
 
             mie.compute(output_cloud);
 
@@ -1323,125 +862,154 @@ struct features_fct{
                 new_s << output_cloud[i].j1,
                         output_cloud[i].j2,
                         output_cloud[i].j3;
-                features[lbl[i]]["centroidsMomInv"] = new_s;
+                results.row(i) = new_s.transpose();
             }
         });
 
         map.emplace("localConvexityCP",
-                   [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-
-            Eigen::Vector3d connectV, surfaceV,
-                    centr_pos1, centr_pos2, norm1, norm2;
-            Eigen::VectorXd new_s(8);
-            double a1,a2;
-            int count;
-            for(const auto& sv : supervoxels){
-                a1 = 0;
-                a2 = 0;
-                connectV = Eigen::Vector3d::Zero(3);
-                surfaceV = Eigen::Vector3d::Zero(3);
-                count = 0;
-                centr_pos1 << sv.second->centroid_.x,
-                        sv.second->centroid_.y,
-                        sv.second->centroid_.z;
-                norm1 << sv.second->normal_.normal[0],
-                        sv.second->normal_.normal[1],
-                        sv.second->normal_.normal[2];
-
-
-                auto it_pair = adj_map.equal_range(sv.first);
-                for(auto it = it_pair.first; it != it_pair.second; it++){
-                    if(supervoxels.find(it->second) == supervoxels.end())
-                        continue;
-                    centr_pos2 << supervoxels.at(it->second)->centroid_.x,
-                            supervoxels.at(it->second)->centroid_.y,
-                            supervoxels.at(it->second)->centroid_.z;
-                    norm2 << supervoxels.at(it->second)->normal_.normal[0],
-                            supervoxels.at(it->second)->normal_.normal[1],
-                            supervoxels.at(it->second)->normal_.normal[2];
-
-                    connectV += centr_pos1 - centr_pos2;
-                    surfaceV += norm1.cross(norm2);
-                    a1 += norm1.dot(connectV);
-                    a2 += norm1.dot(connectV);
-                    count++;
-                }
-                a1 = a1/(double)count;
-                a2 = a2/(double)count;
-                connectV = connectV/(double)count;
-                surfaceV = surfaceV/(double)count;
-
-                new_s << connectV(0), connectV(1), connectV(2),
-                        surfaceV(0), surfaceV(1), surfaceV(2),
-                        a1, a2;
+                   [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            FeatureStore::matrix_t& results = features.allocate("localConvexityCP",8);
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                Eigen::Vector3d connectV, surfaceV,
+                        centr_pos1, centr_pos2, norm1, norm2;
+                Eigen::VectorXd new_s(8);
+                double a1,a2;
+                int count;
+
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    a1 = 0;
+                    a2 = 0;
+                    connectV = Eigen::Vector3d::Zero(3);
+                    surfaceV = Eigen::Vector3d::Zero(3);
+                    count = 0;
+                    centr_pos1 << supervoxels.centroid(sv).x,
+                            supervoxels.centroid(sv).y,
+                            supervoxels.centroid(sv).z;
+                    norm1 << supervoxels.normal(sv).normal[0],
+                            supervoxels.normal(sv).normal[1],
+                            supervoxels.normal(sv).normal[2];
+
+
+                    for(auto it = supervoxels.neighbors_begin(sv); it != supervoxels.neighbors_end(sv); it++){
+                        centr_pos2 << supervoxels.centroid(*it).x,
+                                supervoxels.centroid(*it).y,
+                                supervoxels.centroid(*it).z;
+                        norm2 << supervoxels.normal(*it).normal[0],
+                                supervoxels.normal(*it).normal[1],
+                                supervoxels.normal(*it).normal[2];
+
+                        connectV += centr_pos1 - centr_pos2;
+                        surfaceV += norm1.cross(norm2);
+                        a1 += norm1.dot(connectV);
+                        a2 += norm1.dot(connectV);
+                        count++;
+                    }
+                    a1 = a1/(double)count;
+                    a2 = a2/(double)count;
+                    connectV = connectV/(double)count;
+                    surfaceV = surfaceV/(double)count;
+
+                    new_s << connectV(0), connectV(1), connectV(2),
+                            surfaceV(0), surfaceV(1), surfaceV(2),
+                            a1, a2;
+
+                    for(int i = 0; i < new_s.rows(); i++)
+                    {
+                        if(new_s(i) != new_s(i))
+                            new_s(i) = 0.;
+                        else if(fabs(new_s(i)) < 1e-4)
+                            new_s(i) = 0.;
+                        else if(new_s(i) > 1.)
+                            new_s(i) = 1.;
+                        else if(new_s(i) < -1.)
+                            new_s(i) = -1.;
+                    }
 
-                for(int i = 0; i < new_s.rows(); i++)
-                {
-                    if(new_s(i) != new_s(i))
-                        new_s(i) = 0.;
-                    else if(fabs(new_s(i)) < 1e-4)
-                        new_s(i) = 0.;
-                    else if(new_s(i) > 1.)
-                        new_s(i) = 1.;
-                    else if(new_s(i) < -1.)
-                        new_s(i) = -1.;
+                    results.row(sv) = new_s.transpose();
                 }
-
-                features[sv.first]["localConvexityCP"] = new_s;
-            }
-
+            });
         });
 
         map.emplace("boundary",
-                   [](const SupervoxelArray& supervoxels, const AdjacencyMap& adj_map, SupervoxelSet::features_t& features){
-            pcl::BoundaryEstimation<PointT,pcl::Normal,pcl::Boundary> be;
-            pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
-            PointCloudN::Ptr inputNormal(new PointCloudN);
-            PointCloudT::Ptr inputCloud(new PointCloudT);
-            PointCloudT boundaryCloud;
-            pcl::PointCloud<pcl::Boundary> boundaries;
-            for(const auto& sv: supervoxels){
-                boundaries.clear();
-                inputNormal->clear();
-                inputCloud->clear();
-                boundaryCloud.clear();
-
-                auto it_pair = adj_map.equal_range(sv.first);
-                for(auto it = it_pair.first; it != it_pair.second; it++){
-                    if(supervoxels.find(it->second) == supervoxels.end())
-                        continue;
-                    for(int i = 0; i < supervoxels.at(it->second)->normals_->size(); i++){
-                        inputNormal->push_back(supervoxels.at(it->second)->normals_->at(i));
-                        inputCloud->push_back(supervoxels.at(it->second)->voxels_->at(i));
-                    }
-                }
-
-                for(int i = 0; i < sv.second->normals_->size(); i++){
-                    inputNormal->push_back(sv.second->normals_->at(i));
-                    inputCloud->push_back(sv.second->voxels_->at(i));
-                }
-
-                be.setInputCloud(inputCloud);
-                be.setInputNormals(inputNormal);
-                be.setSearchMethod(tree);
-                be.setRadiusSearch(0.02);
-                be.compute(boundaries);
-
-                for(int i = 0; i < boundaries.size(); i++){
-                    if(boundaries[i].boundary_point != boundaries[i].boundary_point)
-                        continue;
-                    if(boundaries[i].boundary_point){
-                        boundaryCloud.push_back(inputCloud->at(i));
+                   [](const FlatSupervoxelArray& supervoxels, SupervoxelSet::features_t& features){
+            tbb::parallel_for(tbb::blocked_range<size_t>(0,supervoxels.size()),
+                              [&](const tbb::blocked_range<size_t>& r){
+                pcl::BoundaryEstimation<PointT,pcl::Normal,pcl::Boundary> be;
+                pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
+                PointCloudN::Ptr inputNormal(new PointCloudN);
+                PointCloudT::Ptr inputCloud(new PointCloudT);
+                PointCloudT boundaryCloud;
+                pcl::PointCloud<pcl::Boundary> boundaries;
+
+                for(size_t sv = r.begin(); sv != r.end(); ++sv){
+                    boundaries.clear();
+                    boundaryCloud.clear();
+                    supervoxels.get_neighborhood(sv,*inputCloud,*inputNormal);
+
+                    be.setInputCloud(inputCloud);
+                    be.setInputNormals(inputNormal);
+                    be.setSearchMethod(tree);
+                    be.setRadiusSearch(0.02);
+                    be.compute(boundaries);
+
+                    for(int i = 0; i < boundaries.size(); i++){
+                        if(boundaries[i].boundary_point != boundaries[i].boundary_point)
+                            continue;
+                        if(boundaries[i].boundary_point){
+                            boundaryCloud.push_back(inputCloud->at(i));
+                        }
                     }
                 }
-            }
+            });
         });
         return map;
     }
 
+    /**
+     * @brief per voxel intermediates shared by several features. Each function fills a cache of the FlatSupervoxelArray.
+     */
+    static std::map<std::string,std::function<void(const FlatSupervoxelArray&)>> create_cache_map(){
+        std::map<std::string,std::function<void(const FlatSupervoxelArray&)>> map;
+        map.emplace("voxel_lab",[](const FlatSupervoxelArray& supervoxels){supervoxels.voxel_lab();});
+        map.emplace("voxel_hsv",[](const FlatSupervoxelArray& supervoxels){supervoxels.voxel_hsv();});
+        map.emplace("voxel_fpfh",[](const FlatSupervoxelArray& supervoxels){supervoxels.voxel_fpfh();});
+        return map;
+    }
 
+    /**
+     * @brief what each feature reads : other features or per voxel intermediates of cache_map.
+     * Features which are not listed have no dependency.
+     */
+    static std::map<std::string,std::vector<std::string>> create_dependencies(){
+        std::map<std::string,std::vector<std::string>> map;
+        map["colorNormalHist"] = {"colorHist","normalHist"};
+        map["colorLabHist"] = {"voxel_lab"};
+        map["colorL"] = {"colorLabHist"};
+        map["colora"] = {"colorLabHist"};
+        map["colorb"] = {"colorLabHist"};
+        map["colorLabNormalHist"] = {"colorLabHist","normalHist"};
+        map["colorH"] = {"voxel_hsv"};
+        map["colorS"] = {"voxel_hsv"};
+        map["colorV"] = {"voxel_hsv"};
+        map["colorHist"] = {"voxel_hsv"};
+        map["normalX"] = {"normalHist"};
+        map["normalY"] = {"normalHist"};
+        map["normalZ"] = {"normalHist"};
+        map["colorLabHistLarge"] = {"voxel_lab"};
+        map["localMeanFPFH"] = {"voxel_fpfh"};
+        map["neighMeanFPFH"] = {"voxel_fpfh"};
+        map["meanFPFH"] = {"voxel_fpfh"};
+        map["meanFPFHLabHist"] = {"colorLabHist","meanFPFH"};
+        map["centralFPFH"] = {"voxel_fpfh"};
+        map["centralFPFHLabHist"] = {"colorLabHist","centralFPFH"};
+        map["circleFPFHLabHist"] = {"colorLabHist","voxel_fpfh"};
+        return map;
+    }
 
     static const std::map<std::string,function_t> fct_map;
+    static const std::map<std::string,std::function<void(const FlatSupervoxelArray&)>> cache_map;
+    static const std::map<std::string,std::vector<std::string>> dependencies;
 };
 
 }
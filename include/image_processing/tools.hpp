@@ -1,6 +1,7 @@
 #ifndef _TOOLS_HPP
 #define _TOOLS_HPP
 
+#include <algorithm>
 #include <Eigen/Core>
 #include <pcl/point_types.h>
 #include <pcl/surface/convex_hull.h>
@@ -35,8 +36,113 @@ namespace tools{
  */
     void cloudRGB2HSV(const PointCloudT::Ptr input, PointCloudHSV::Ptr output);
 
+    /**
+ * @brief Convert a RGB tuple to a Lab one. The components are normalized : L in [0,1], a and b in [-1,1].
+ */
     void rgb2Lab(int r, int g, int b, float& L, float& a, float& b2);
 
+    /**
+ * @brief Batch version of rgb2hsv. The results are exactly the ones of rgb2hsv.
+ * Vectorized with AVX2 or SSE4.1 when the library is compiled for them (see the WITH_AVX2 option).
+ * @param rgb interleaved 8-bit RGB triplets
+ * @param size number of colors
+ * @param hsv output, 3*size interleaved (h,s,v). Must be allocated by the caller.
+ */
+    void rgb2hsv(const uint8_t* rgb, size_t size, float* hsv);
+    void rgb2hsv(const PointT* points, size_t size, float* hsv);
+    void cloudRGB2HSV(const PointCloudT& cloud, std::vector<float>& hsv);
+
+    /**
+ * @brief Batch version of rgb2Lab, vectorized with AVX2 or SSE2.
+ * The cube root is read from an interpolated lookup table : the results differ from the ones of rgb2Lab
+ * by less than lab_batch_tolerance on each normalized component.
+ * @param rgb interleaved 8-bit RGB triplets
+ * @param size number of colors
+ * @param Lab output, 3*size interleaved (L,a,b). Must be allocated by the caller.
+ */
+    void rgb2Lab(const uint8_t* rgb, size_t size, float* Lab);
+    void rgb2Lab(const PointT* points, size_t size, float* Lab);
+    void cloudRGB2Lab(const PointCloudT& cloud, std::vector<float>& Lab);
+
+    const float lab_batch_tolerance = 1e-4f;
+
+    /**
+ * @brief Bins of values in a histogram, vectorized with AVX2 or SSE2. The bin of val is (val - lower)/width
+ * truncated, with a division so that the values on the bounds of the bins fall in the same bins as with the
+ * scalar formula. Values smaller than 10e-4 in magnitude are taken as 0 and values equal to the upper bound
+ * go to the last bin.
+ * @param values
+ * @param size number of values
+ * @param lower lower bound of the histogram
+ * @param width width of a bin, i.e. (upper - lower)/bins
+ * @param bins number of bins
+ * @param out bin of each value, -1 if the value is not a number, larger than 10e3 in magnitude or out of the histogram
+ */
+    void bin_values(const double* values, size_t size, double lower, double width, int bins, int* out);
+
+    const int histogram_block_size = 256;
+    // sub-histograms filled in turn so that consecutive increments do not depend on each other
+    const int histogram_lanes = 4;
+
+    /**
+ * @brief Marginal histograms of count vectors, binned by blocks of histogram_block_size values with bin_values.
+ * @param value value(i,d) is the d-th component of the i-th vector
+ * @param dims dimension of the vectors
+ * @param lower lower bound of each dimension
+ * @param width width of the bins of each dimension
+ * @param bins number of bins per dimension
+ * @param lane_counts scratch memory of histogram_lanes*dims*bins values
+ * @param out dims*bins values normalized by count : the bins of the first dimension, then those of the second, etc.
+ */
+    template <typename Value>
+    void marginal_histogram(size_t count, Value value, int dims, const double* lower, const double* width, int bins,
+                            int* lane_counts, double* out){
+        std::fill(lane_counts,lane_counts + histogram_lanes*dims*bins,0);
+        double block[histogram_block_size];
+        int block_bins[histogram_block_size];
+        for(size_t start = 0; start < count; start += histogram_block_size){
+            int n = std::min<size_t>(histogram_block_size,count - start);
+            for(int d = 0; d < dims; d++){
+                for(int k = 0; k < n; k++)
+                    block[k] = value(start + k,d);
+                bin_values(block,n,lower[d],width[d],bins,block_bins);
+                for(int k = 0; k < n; k++)
+                    if(block_bins[k] >= 0)
+                        lane_counts[((k % histogram_lanes)*dims + d)*bins + block_bins[k]]++;
+            }
+        }
+        for(int j = 0; j < dims*bins; j++){
+            int total = 0;
+            for(int l = 0; l < histogram_lanes; l++)
+                total += lane_counts[l*dims*bins + j];
+            out[j] = total/((double)count);
+        }
+    }
+
+    /**
+ * @brief Call f with the joint bin index of each of count vectors, in order. The bin of the d-th dimension
+ * has a stride of bins^d and the dimensions out of the histogram are skipped. Parameters as marginal_histogram.
+ */
+    template <typename Value, typename F>
+    void joint_bin_indices(size_t count, Value value, int dims, const double* lower, const double* width, int bins, F f){
+        double block[histogram_block_size];
+        int block_bins[histogram_block_size], index[histogram_block_size];
+        for(size_t start = 0; start < count; start += histogram_block_size){
+            int n = std::min<size_t>(histogram_block_size,count - start);
+            std::fill(index,index + n,0);
+            for(int d = 0, stride = 1; d < dims; d++, stride *= bins){
+                for(int k = 0; k < n; k++)
+                    block[k] = value(start + k,d);
+                bin_values(block,n,lower[d],width[d],bins,block_bins);
+                for(int k = 0; k < n; k++)
+                    if(block_bins[k] >= 0)
+                        index[k] += block_bins[k]*stride;
+            }
+            for(int k = 0; k < n; k++)
+                f(index[k]);
+        }
+    }
+
 
 
 }//tools
@@ -0,0 +1,48 @@
+#ifndef _VOXEL_KEY_HPP
+#define _VOXEL_KEY_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <Eigen/Core>
+
+namespace image_processing{
+namespace tools{
+
+    /**
+     * @brief integer coordinates of the cell of a regular grid containing the position (x,y,z)
+     * @param x
+     * @param y
+     * @param z
+     * @param inv_res inverse of the size of a cell
+     * @return cell coordinates
+     */
+    inline Eigen::Vector3i cell_of(float x, float y, float z, float inv_res){
+        return Eigen::Vector3i(static_cast<int>(std::floor(x*inv_res)),
+                               static_cast<int>(std::floor(y*inv_res)),
+                               static_cast<int>(std::floor(z*inv_res)));
+    }
+
+    /**
+     * @brief pack cell coordinates in a 64 bits key (21 bits per axis, i.e. +/- 10^6 cells).
+     * @param cell coordinates
+     * @return key usable in hash containers
+     */
+    inline uint64_t cell_key(const Eigen::Vector3i& c){
+        const int64_t offset = 1 << 20;
+        const uint64_t mask = (1 << 21) - 1;
+        return (static_cast<uint64_t>(c(0) + offset) & mask) << 42
+                | (static_cast<uint64_t>(c(1) + offset) & mask) << 21
+                | (static_cast<uint64_t>(c(2) + offset) & mask);
+    }
+
+    /**
+     * @brief key of the cell containing the position (x,y,z)
+     */
+    inline uint64_t cell_key(float x, float y, float z, float inv_res){
+        return cell_key(cell_of(x,y,z,inv_res));
+    }
+
+}//tools
+}//image_processing
+
+#endif //_VOXEL_KEY_HPP
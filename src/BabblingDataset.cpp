@@ -248,7 +248,7 @@ bool BabblingDataset::_load_arm_trajectories(const std::string &filename, arm_tr
     return true;
 }
 
-void BabblingDataset::rgbd_to_pointcloud(const cv::Mat& rgb, const cv::Mat& depth, PointCloudT::Ptr ptcl){
+void BabblingDataset::rgbd_to_pointcloud(const cv::Mat& rgb, const cv::Mat& depth, PointCloudT::Ptr ptcl, bool organized){
 //    std::cout << "_rgbd_to_pointcloud" << std::endl;
 
     double center_x = _camera_parameter["depth"]["principal_point"]["x"].as<double>();
@@ -259,9 +259,15 @@ void BabblingDataset::rgbd_to_pointcloud(const cv::Mat& rgb, const cv::Mat& dept
 
     int rgb_cn = rgb.channels();
 
-    ptcl->width = rgb.cols;
-    ptcl->height = rgb.rows;
+    if(organized){
+        ptcl->clear();
+        ptcl->points.reserve(rgb.rows*rgb.cols);
+    }else{
+        ptcl->width = rgb.cols;
+        ptcl->height = rgb.rows;
+    }
 
+    //in the organized layout, invalid depths are kept as NaN points (row major, width x height)
     for(int i = 0; i < rgb.rows; i++){
         uchar* rgb_rowPtr = reinterpret_cast<uchar*>(rgb.row(i).data);
         float* depth_rowPtr = reinterpret_cast<float*>(depth.row(i).data);
@@ -272,7 +278,12 @@ void BabblingDataset::rgbd_to_pointcloud(const cv::Mat& rgb, const cv::Mat& dept
             float z = depth_rowPtr[j];
             if(z != z){
                 pt.x = pt.y = pt.z = bad_point;
-                continue;
+                if(!organized)
+                    continue;
+            }else if(organized){
+                pt.x = (j - center_x)*z/focal_x;
+                pt.y = (i - center_y)*z/focal_y;
+                pt.z = z;
             }else{
                 pt.x = (i - center_x)*z/focal_x;
                 pt.y = (j - center_y)*z/focal_y;
@@ -286,9 +297,16 @@ void BabblingDataset::rgbd_to_pointcloud(const cv::Mat& rgb, const cv::Mat& dept
 
             pt.a = 255;
 
-            ptcl->push_back(pt);
+            if(organized)
+                ptcl->points.push_back(pt);
+            else ptcl->push_back(pt);
         }
     }
+    if(organized){
+        ptcl->width = rgb.cols;
+        ptcl->height = rgb.rows;
+        ptcl->is_dense = false;
+    }
 
 
 //    pcl::PassThrough<PointT> passFilter;
@@ -0,0 +1,52 @@
+#include <image_processing/BackgroundModel.h>
+#include <image_processing/voxel_key.hpp>
+#include <tbb/tbb.h>
+
+using namespace image_processing;
+
+void BackgroundModel::add(const PointCloudT& background){
+    _cells.reserve(_cells.size() + background.size());
+    for(const PointT& pt : background.points){
+        if(!pcl::isFinite(pt))
+            continue;
+        _cells[tools::cell_key(pt.x,pt.y,pt.z,_inv_res)].push_back(Eigen::Vector3f(pt.x,pt.y,pt.z));
+        _size++;
+    }
+}
+
+bool BackgroundModel::contain(float x, float y, float z) const {
+    //the cells are as large as the threshold so the nearest background point, if close enough, is in a neighbor cell
+    Eigen::Vector3f p(x,y,z);
+    Eigen::Vector3i cell = tools::cell_of(x,y,z,_inv_res);
+    for(int dx = -1; dx <= 1; dx++){
+        for(int dy = -1; dy <= 1; dy++){
+            for(int dz = -1; dz <= 1; dz++){
+                auto it = _cells.find(tools::cell_key(cell + Eigen::Vector3i(dx,dy,dz)));
+                if(it == _cells.end())
+                    continue;
+                for(const Eigen::Vector3f& b : it->second)
+                    if((b - p).squaredNorm() <= _sq_resolution)
+                        return true;
+            }
+        }
+    }
+    return false;
+}
+
+void BackgroundModel::filter(const PointCloudT& input, PointCloudT& output) const {
+    std::vector<char> keep(input.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,input.size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            const PointT& pt = input.points[i];
+            keep[i] = pcl::isFinite(pt) && !contain(pt.x,pt.y,pt.z);
+        }
+    });
+
+    output.clear();
+    for(size_t i = 0; i < input.size(); i++)
+        if(keep[i])
+            output.points.push_back(input.points[i]);
+    output.width = output.points.size();
+    output.height = 1;
+}
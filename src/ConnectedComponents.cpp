@@ -0,0 +1,110 @@
+#include <image_processing/ConnectedComponents.h>
+#include <atomic>
+#include <tbb/tbb.h>
+
+using namespace image_processing;
+
+namespace {
+/**
+ * @brief lock-free disjoint sets. A root is always linked under a smaller root, so parent[i] <= i,
+ * the root of a set is its smallest element and the concurrent unions terminate.
+ */
+struct disjoint_sets {
+    disjoint_sets(size_t n) : parent(n){
+        for(size_t i = 0; i < n; i++)
+            parent[i].store(i,std::memory_order_relaxed);
+    }
+
+    int find(int i){
+        int p = parent[i].load(std::memory_order_relaxed);
+        while(p != i){
+            //path halving, the grandparent is still an ancestor whatever the concurrent unions
+            int gp = parent[p].load(std::memory_order_relaxed);
+            if(gp != p)
+                parent[i].compare_exchange_weak(p,gp,std::memory_order_relaxed);
+            i = p;
+            p = parent[i].load(std::memory_order_relaxed);
+        }
+        return i;
+    }
+
+    void unite(int a, int b){
+        for(;;){
+            a = find(a);
+            b = find(b);
+            if(a == b)
+                return;
+            if(a < b)
+                std::swap(a,b);
+            int expected = a;
+            if(parent[a].compare_exchange_strong(expected,b,std::memory_order_relaxed))
+                return;
+        }
+    }
+
+    std::vector<std::atomic<int>> parent;
+};
+}
+
+void ConnectedComponents::clear(){
+    _component.clear();
+    _first.clear();
+    _members.clear();
+    _labels.clear();
+}
+
+void ConnectedComponents::compute(const FlatSupervoxelArray& svs, const std::vector<char>& mask){
+    size_t n = svs.size();
+    disjoint_sets sets(n);
+
+    //each edge is united once, from its smaller end
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,n),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            if(!mask[i])
+                continue;
+            for(const int* nb = svs.neighbors_begin(i); nb != svs.neighbors_end(i); nb++)
+                if(*nb > (int)i && mask[*nb])
+                    sets.unite(i,*nb);
+        }
+    });
+
+    _component.assign(n,-1);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,n),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i)
+            if(mask[i])
+                _component[i] = sets.find(i);
+    });
+
+    //number the components by their root, the smallest index, and count their members
+    std::vector<int> counts;
+    for(size_t i = 0; i < n; i++){
+        if(_component[i] < 0)
+            continue;
+        if(_component[i] == (int)i){
+            _component[i] = counts.size();
+            counts.push_back(0);
+        }
+        else _component[i] = _component[_component[i]];
+        counts[_component[i]]++;
+    }
+
+    _first.resize(counts.size());
+    int offset = 0;
+    for(size_t c = 0; c < counts.size(); c++){
+        _first[c] = offset;
+        offset += counts[c];
+    }
+
+    _members.resize(offset);
+    _labels.resize(offset);
+    std::vector<int> next(_first);
+    for(size_t i = 0; i < n; i++){
+        if(_component[i] < 0)
+            continue;
+        int k = next[_component[i]]++;
+        _members[k] = i;
+        _labels[k] = svs.label(i);
+    }
+}
@@ -0,0 +1,144 @@
+#include <image_processing/FeatureStore.h>
+#include <iostream>
+#include <deque>
+#include <mutex>
+
+using namespace image_processing;
+
+namespace {
+struct modality_registry {
+    std::mutex mutex;
+    std::map<std::string,int> ids;
+    std::deque<std::string> names;
+};
+
+modality_registry& registry(){
+    static modality_registry reg;
+    return reg;
+}
+}
+
+int FeatureStore::modality_id(const std::string& modality){
+    modality_registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto it = reg.ids.find(modality);
+    if(it != reg.ids.end())
+        return it->second;
+    int id = reg.names.size();
+    reg.names.push_back(modality);
+    reg.ids.emplace(modality,id);
+    return id;
+}
+
+const std::string& FeatureStore::modality_name(int id){
+    modality_registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    return reg.names.at(id);
+}
+
+void FeatureStore::clear(){
+    _labels.clear();
+    _rows.clear();
+    _data.clear();
+    _present.clear();
+    _names.clear();
+    _ids.clear();
+}
+
+void FeatureStore::set_labels(const std::vector<uint32_t>& labels){
+    if(labels == _labels)
+        return;
+
+    std::vector<int> old_rows(_rows);
+    _labels = labels;
+    uint32_t max_label = 0;
+    for(const uint32_t& lbl : _labels)
+        max_label = std::max(max_label,lbl);
+    _rows.assign(_labels.empty() ? 0 : max_label + 1,-1);
+    for(size_t i = 0; i < _labels.size(); i++)
+        _rows[_labels[i]] = i;
+
+    for(size_t id = 0; id < _data.size(); id++){
+        if(!_present[id])
+            continue;
+        matrix_t remapped = matrix_t::Zero(_labels.size(),_data[id].cols());
+        for(size_t i = 0; i < _labels.size(); i++){
+            int old = _labels[i] < old_rows.size() ? old_rows[_labels[i]] : -1;
+            if(old >= 0)
+                remapped.row(i) = _data[id].row(old);
+        }
+        _data[id].swap(remapped);
+    }
+}
+
+void FeatureStore::add_name(int id){
+    if(id >= _data.size()){
+        _data.resize(id + 1);
+        _present.resize(id + 1,false);
+        _names.resize(id + 1,nullptr);
+    }
+    if(_names[id])
+        return;
+    //the names are never moved by the registry
+    _names[id] = &modality_name(id);
+    _ids.emplace(*_names[id],id);
+}
+
+void FeatureStore::reserve(const std::vector<int>& ids){
+    for(const int& id : ids)
+        add_name(id);
+}
+
+FeatureStore::matrix_t& FeatureStore::allocate(int id, int dim){
+    //nothing to resolve for the reserved modalities, which are allocated concurrently
+    add_name(id);
+    _data[id] = matrix_t::Zero(_labels.size(),dim);
+    _present[id] = true;
+    return _data[id];
+}
+
+Eigen::VectorXd FeatureStore::get(uint32_t label, const std::string& modality) const {
+    int id = local_id(modality);
+    int r = row(label);
+    if(r < 0 || !has(id))
+        return Eigen::VectorXd();
+    return feature(id,r);
+}
+
+std::map<std::string,Eigen::VectorXd> FeatureStore::get_all(uint32_t label) const {
+    std::map<std::string,Eigen::VectorXd> features;
+    int r = row(label);
+    if(r < 0)
+        return features;
+    for(size_t id = 0; id < _data.size(); id++)
+        if(_present[id])
+            features.emplace(*_names[id],feature(id,r));
+    return features;
+}
+
+bool FeatureStore::set(uint32_t label, const std::string& modality, const Eigen::VectorXd& feature){
+    int id = modality_id(modality);
+    if(has(id) && _data[id].cols() != feature.size()){
+        std::cerr << "FeatureStore Error: feature " << modality << " is of dimension " << _data[id].cols()
+                  << " not " << feature.size() << std::endl;
+        return false;
+    }
+
+    if(row(label) < 0){
+        if(label >= _rows.size())
+            _rows.resize(label + 1,-1);
+        _rows[label] = _labels.size();
+        _labels.push_back(label);
+        for(size_t i = 0; i < _data.size(); i++){
+            if(!_present[i])
+                continue;
+            _data[i].conservativeResize(_labels.size(),Eigen::NoChange);
+            _data[i].row(_labels.size() - 1).setZero();
+        }
+    }
+    if(!has(id))
+        allocate(id,feature.size());
+
+    _data[id].row(row(label)) = feature.transpose();
+    return true;
+}
@@ -0,0 +1,246 @@
+#include <image_processing/FlatSupervoxelArray.h>
+#include <image_processing/tools.hpp>
+#include <tbb/tbb.h>
+#include <pcl/features/fpfh_omp.h>
+#include <limits>
+
+using namespace image_processing;
+
+void FlatSupervoxelArray::clear(){
+    _labels.clear();
+    _index.clear();
+    _offsets.clear();
+    _voxels->clear();
+    _normals->clear();
+    _centroids->clear();
+    _centroid_normals->clear();
+    _neighbor_offsets.clear();
+    _neighbors.clear();
+    _fpfh.reset();
+    _lab.clear();
+    _hsv.clear();
+    _lab_valid = false;
+    _hsv_valid = false;
+    _centroid_tree.reset();
+    _voxel_tree.reset();
+}
+
+void FlatSupervoxelArray::build(const SupervoxelArray& supervoxels, const AdjacencyMap& adjacency){
+    clear();
+    if(supervoxels.empty())
+        return;
+
+    size_t nbr_sv = supervoxels.size();
+    std::vector<pcl::Supervoxel<PointT>::Ptr> svs;
+    svs.reserve(nbr_sv);
+    _labels.reserve(nbr_sv);
+    _offsets.resize(nbr_sv + 1);
+    _offsets[0] = 0;
+    for(const auto& sv : supervoxels){
+        _offsets[svs.size() + 1] = _offsets[svs.size()] + sv.second->voxels_->size();
+        _labels.push_back(sv.first);
+        svs.push_back(sv.second);
+    }
+
+    _index.assign(_labels.back() + 1,-1);
+    for(size_t i = 0; i < nbr_sv; i++)
+        _index[_labels[i]] = i;
+
+    _voxels->resize(_offsets.back());
+    _normals->resize(_offsets.back());
+    _centroids->resize(nbr_sv);
+    _centroid_normals->resize(nbr_sv);
+
+    pcl::Normal nan_normal;
+    nan_normal.normal_x = nan_normal.normal_y = nan_normal.normal_z = std::numeric_limits<float>::quiet_NaN();
+    nan_normal.curvature = std::numeric_limits<float>::quiet_NaN();
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,nbr_sv),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            const pcl::Supervoxel<PointT>& sv = *svs[i];
+            std::copy(sv.voxels_->begin(),sv.voxels_->end(),_voxels->begin() + _offsets[i]);
+            //supervoxels built by hand may have less normals than voxels
+            size_t nbr_normals = std::min(sv.normals_->size(),sv.voxels_->size());
+            std::copy(sv.normals_->begin(),sv.normals_->begin() + nbr_normals,_normals->begin() + _offsets[i]);
+            std::fill(_normals->begin() + _offsets[i] + nbr_normals,_normals->begin() + _offsets[i+1],nan_normal);
+            _centroids->points[i] = sv.centroid_;
+            _centroid_normals->points[i] = sv.normal_;
+        }
+    });
+
+    _neighbor_offsets.assign(nbr_sv + 1,0);
+    _neighbors.reserve(adjacency.size());
+    for(size_t i = 0; i < nbr_sv; i++){
+        auto range = adjacency.equal_range(_labels[i]);
+        for(auto it = range.first; it != range.second; ++it){
+            int n = index(it->second);
+            if(n >= 0)
+                _neighbors.push_back(n);
+        }
+        _neighbor_offsets[i+1] = _neighbors.size();
+    }
+}
+
+void FlatSupervoxelArray::get_voxels(size_t i, PointCloudT& cloud, PointCloudN& normals) const {
+    cloud.clear();
+    normals.clear();
+    cloud.insert(cloud.end(),voxels_begin(i),voxels_end(i));
+    normals.insert(normals.end(),normals_begin(i),normals_end(i));
+}
+
+void FlatSupervoxelArray::get_neighborhood(size_t i, PointCloudT& cloud, PointCloudN& normals) const {
+    cloud.clear();
+    normals.clear();
+    for(const int* n = neighbors_begin(i); n != neighbors_end(i); ++n){
+        cloud.insert(cloud.end(),voxels_begin(*n),voxels_end(*n));
+        normals.insert(normals.end(),normals_begin(*n),normals_end(*n));
+    }
+    cloud.insert(cloud.end(),voxels_begin(i),voxels_end(i));
+    normals.insert(normals.end(),normals_begin(i),normals_end(i));
+}
+
+const pcl::PointCloud<pcl::FPFHSignature33>& FlatSupervoxelArray::voxel_fpfh(double radius) const {
+    if(_fpfh && _fpfh_radius == radius)
+        return *_fpfh;
+
+    _fpfh.reset(new pcl::PointCloud<pcl::FPFHSignature33>);
+    _fpfh_radius = radius;
+    if(_voxels->empty())
+        return *_fpfh;
+
+    pcl::FPFHEstimationOMP<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh;
+    pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT>);
+    fpfh.setInputCloud(_voxels);
+    fpfh.setInputNormals(_normals);
+    fpfh.setSearchMethod(tree);
+    fpfh.setRadiusSearch(radius);
+    //as many OpenMP threads as the current task arena, i.e. one when the features are computed sequentially
+    fpfh.setNumberOfThreads(tbb::this_task_arena::max_concurrency());
+    fpfh.compute(*_fpfh);
+    return *_fpfh;
+}
+
+const std::vector<Eigen::VectorXd>& FlatSupervoxelArray::voxel_lab() const {
+    if(_lab_valid)
+        return _lab;
+
+    _lab.assign(_voxels->size(),Eigen::VectorXd(3));
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,_voxels->size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        std::vector<float> Lab(3*r.size());
+        tools::rgb2Lab(&_voxels->points[r.begin()],r.size(),Lab.data());
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            const float* c = &Lab[3*(i - r.begin())];
+            _lab[i] << c[0], c[1], c[2];
+        }
+    });
+    _lab_valid = true;
+    return _lab;
+}
+
+const std::vector<Eigen::VectorXd>& FlatSupervoxelArray::voxel_hsv() const {
+    if(_hsv_valid)
+        return _hsv;
+
+    _hsv.assign(_voxels->size(),Eigen::VectorXd(3));
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,_voxels->size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        std::vector<float> hsv(3*r.size());
+        tools::rgb2hsv(&_voxels->points[r.begin()],r.size(),hsv.data());
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            const float* c = &hsv[3*(i - r.begin())];
+            _hsv[i] << c[0], c[1], c[2];
+        }
+    });
+    _hsv_valid = true;
+    return _hsv;
+}
+
+namespace {
+/**
+ * @brief nearest neighbor queries on a kd-tree, with result buffers reused from a query to the next.
+ * One per task.
+ */
+struct nearest_query {
+    nearest_query(const pcl::KdTreeFLANN<PointT>& t) : tree(t), nn_indices(1), nn_distance(1){}
+
+    /**
+     * @brief index of the nearest point of the tree, -1 if none
+     */
+    int operator()(const PointT& pt, float& sqr_distance){
+        if(!pcl::isFinite(pt) || !tree.nearestKSearch(pt,1,nn_indices,nn_distance))
+            return -1;
+        sqr_distance = nn_distance[0];
+        return nn_indices[0];
+    }
+
+    const pcl::KdTreeFLANN<PointT>& tree;
+    std::vector<int> nn_indices;
+    std::vector<float> nn_distance;
+};
+
+PointT to_point(const pcl::PointXYZ& p){
+    PointT pt;
+    pt.x = p.x;
+    pt.y = p.y;
+    pt.z = p.z;
+    return pt;
+}
+}
+
+const pcl::KdTreeFLANN<PointT>& FlatSupervoxelArray::centroid_tree() const {
+    if(!_centroid_tree){
+        _centroid_tree.reset(new pcl::KdTreeFLANN<PointT>);
+        _centroid_tree->setInputCloud(_centroids);
+    }
+    return *_centroid_tree;
+}
+
+const pcl::KdTreeFLANN<PointT>& FlatSupervoxelArray::voxel_tree() const {
+    if(!_voxel_tree){
+        _voxel_tree.reset(new pcl::KdTreeFLANN<PointT>);
+        _voxel_tree->setInputCloud(_voxels);
+    }
+    return *_voxel_tree;
+}
+
+int FlatSupervoxelArray::nearest_centroid(const PointT& pt) const {
+    if(_centroids->empty())
+        return -1;
+    float sqr_distance;
+    return nearest_query(centroid_tree())(pt,sqr_distance);
+}
+
+void FlatSupervoxelArray::nearest_centroids(const PointCloudXYZ& points, std::vector<int>& indices) const {
+    indices.assign(points.size(),-1);
+    if(_centroids->empty() || points.empty())
+        return;
+    const pcl::KdTreeFLANN<PointT>& tree = centroid_tree();
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,points.size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        nearest_query nearest(tree);
+        float sqr_distance;
+        for(size_t i = r.begin(); i != r.end(); ++i)
+            indices[i] = nearest(to_point(points.points[i]),sqr_distance);
+    });
+}
+
+void FlatSupervoxelArray::containing_supervoxels(const PointCloudXYZ& points, float max_distance, std::vector<int>& indices) const {
+    indices.assign(points.size(),-1);
+    if(_voxels->empty() || points.empty())
+        return;
+    const pcl::KdTreeFLANN<PointT>& tree = voxel_tree();
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,points.size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        nearest_query nearest(tree);
+        float sqr_distance;
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            int v = nearest(to_point(points.points[i]),sqr_distance);
+            if(v >= 0 && sqr_distance <= max_distance*max_distance)
+                indices[i] = owner(v);
+        }
+    });
+}
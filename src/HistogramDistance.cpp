@@ -0,0 +1,174 @@
+#include "image_processing/HistogramDistance.hpp"
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <tbb/tbb.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace image_processing;
+
+namespace {
+
+// The kernels are written once over these packs of doubles.
+
+#if defined(__AVX2__)
+struct pack {
+    typedef __m256d type;
+    static const int width = 4;
+    static type zero(){return _mm256_setzero_pd();}
+    static type load(const double* p){return _mm256_loadu_pd(p);}
+    static type add(type a, type b){return _mm256_add_pd(a,b);}
+    static type sub(type a, type b){return _mm256_sub_pd(a,b);}
+    static type mul(type a, type b){return _mm256_mul_pd(a,b);}
+    static type min(type a, type b){return _mm256_min_pd(a,b);}
+    static type sqrt(type a){return _mm256_sqrt_pd(a);}
+    // a/b where b is not 0, 0 elsewhere
+    static type safe_div(type a, type b){
+        type nz = _mm256_cmp_pd(b,zero(),_CMP_NEQ_UQ);
+        return _mm256_and_pd(nz,_mm256_div_pd(a,_mm256_blendv_pd(_mm256_set1_pd(1.),b,nz)));
+    }
+    static double sum(type a){
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a),_mm256_extractf128_pd(a,1));
+        return _mm_cvtsd_f64(_mm_add_sd(s,_mm_unpackhi_pd(s,s)));
+    }
+};
+#elif defined(__SSE2__)
+struct pack {
+    typedef __m128d type;
+    static const int width = 2;
+    static type zero(){return _mm_setzero_pd();}
+    static type load(const double* p){return _mm_loadu_pd(p);}
+    static type add(type a, type b){return _mm_add_pd(a,b);}
+    static type sub(type a, type b){return _mm_sub_pd(a,b);}
+    static type mul(type a, type b){return _mm_mul_pd(a,b);}
+    static type min(type a, type b){return _mm_min_pd(a,b);}
+    static type sqrt(type a){return _mm_sqrt_pd(a);}
+    static type safe_div(type a, type b){
+        type nz = _mm_cmpneq_pd(b,zero());
+        type one = _mm_set1_pd(1.);
+        return _mm_and_pd(nz,_mm_div_pd(a,_mm_or_pd(_mm_and_pd(nz,b),_mm_andnot_pd(nz,one))));
+    }
+    static double sum(type a){
+        return _mm_cvtsd_f64(_mm_add_sd(a,_mm_unpackhi_pd(a,a)));
+    }
+};
+#else
+struct pack {
+    typedef double type;
+    static const int width = 1;
+    static type zero(){return 0.;}
+    static type load(const double* p){return *p;}
+    static type add(type a, type b){return a + b;}
+    static type sub(type a, type b){return a - b;}
+    static type mul(type a, type b){return a*b;}
+    static type min(type a, type b){return std::min(a,b);}
+    static type sqrt(type a){return std::sqrt(a);}
+    static type safe_div(type a, type b){return b != 0 ? a/b : 0.;}
+    static double sum(type a){return a;}
+};
+#endif
+
+double chi_squared(const double* h1, const double* h2, int size){
+    pack::type acc = pack::zero();
+    int i = 0;
+    for(; i + pack::width <= size; i += pack::width){
+        pack::type a = pack::load(h1 + i), b = pack::load(h2 + i);
+        pack::type d = pack::sub(a,b);
+        acc = pack::add(acc,pack::safe_div(pack::mul(d,d),pack::add(a,b)));
+    }
+    double sum = pack::sum(acc);
+    for(; i < size; i++)
+        if(h1[i] + h2[i] != 0)
+            sum += (h1[i] - h2[i])*(h1[i] - h2[i])/(h1[i] + h2[i]);
+    return sum/2.;
+}
+
+double bhattacharyya(const double* h1, const double* h2, int size){
+    pack::type acc = pack::zero(), acc1 = pack::zero(), acc2 = pack::zero();
+    int i = 0;
+    for(; i + pack::width <= size; i += pack::width){
+        pack::type a = pack::load(h1 + i), b = pack::load(h2 + i);
+        acc = pack::add(acc,pack::sqrt(pack::mul(a,b)));
+        acc1 = pack::add(acc1,a);
+        acc2 = pack::add(acc2,b);
+    }
+    double coef = pack::sum(acc), sum1 = pack::sum(acc1), sum2 = pack::sum(acc2);
+    for(; i < size; i++){
+        coef += std::sqrt(h1[i]*h2[i]);
+        sum1 += h1[i];
+        sum2 += h2[i];
+    }
+    double norm = std::sqrt(sum1*sum2);
+    if(norm == 0)
+        return sum1 == sum2 ? 0. : 1.;
+    return std::sqrt(std::max(0.,1. - coef/norm));
+}
+
+double intersection(const double* h1, const double* h2, int size){
+    pack::type acc = pack::zero();
+    int i = 0;
+    for(; i + pack::width <= size; i += pack::width)
+        acc = pack::add(acc,pack::min(pack::load(h1 + i),pack::load(h2 + i)));
+    double sum = pack::sum(acc);
+    for(; i < size; i++)
+        sum += std::min(h1[i],h2[i]);
+    return sum;
+}
+
+// the cumulated sum is sequential, it is left to the compiler
+double emd_1d(const double* h1, const double* h2, int size){
+    double cumul = 0, sum = 0;
+    for(int i = 0; i < size; i++){
+        cumul += h1[i] - h2[i];
+        sum += std::fabs(cumul);
+    }
+    return sum;
+}
+
+typedef double (*distance_fct)(const double*, const double*, int);
+
+distance_fct distance(HistogramDistance::type_t type){
+    switch(type){
+    case HistogramDistance::CHI_SQUARED: return chi_squared;
+    case HistogramDistance::BHATTACHARYYA: return bhattacharyya;
+    case HistogramDistance::INTERSECTION: return intersection;
+    case HistogramDistance::EMD_1D: return emd_1d;
+    }
+    return chi_squared;
+}
+
+}
+
+double HistogramDistance::compute(type_t type, const double* hist1, const double* hist2, int size){
+    return distance(type)(hist1,hist2,size);
+}
+
+double HistogramDistance::compute(type_t type, const Eigen::VectorXd& hist1, const Eigen::VectorXd& hist2){
+    assert(hist1.size() == hist2.size());
+    return distance(type)(hist1.data(),hist2.data(),hist1.size());
+}
+
+void HistogramDistance::one_to_many(type_t type, const Eigen::VectorXd& hist, const matrix_t& hists, Eigen::VectorXd& distances){
+    assert(hist.size() == hists.cols());
+    distance_fct fct = distance(type);
+    distances.resize(hists.rows());
+    tbb::parallel_for(tbb::blocked_range<int>(0,hists.rows()),
+                      [&](const tbb::blocked_range<int>& r){
+        for(int i = r.begin(); i != r.end(); ++i)
+            distances(i) = fct(hist.data(),hists.data() + i*hists.cols(),hists.cols());
+    });
+}
+
+void HistogramDistance::all_pairs(type_t type, const matrix_t& hists1, const matrix_t& hists2, Eigen::MatrixXd& distances){
+    assert(hists1.cols() == hists2.cols());
+    distance_fct fct = distance(type);
+    distances.resize(hists1.rows(),hists2.rows());
+    tbb::parallel_for(tbb::blocked_range2d<int>(0,hists1.rows(),0,hists2.rows()),
+                      [&](const tbb::blocked_range2d<int>& r){
+        for(int i = r.rows().begin(); i != r.rows().end(); ++i)
+            for(int j = r.cols().begin(); j != r.cols().end(); ++j)
+                distances(i,j) = fct(hists1.data() + i*hists1.cols(),hists2.data() + j*hists2.cols(),hists1.cols());
+    });
+}
@@ -0,0 +1,461 @@
+#include <image_processing/ParallelSupervoxelClustering.h>
+#include <image_processing/voxel_key.hpp>
+#include <Eigen/Eigenvalues>
+#include <tbb/tbb.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <set>
+
+using namespace image_processing;
+
+namespace {
+const size_t grain_size = 1024;
+const uint64_t invalid_key = std::numeric_limits<uint64_t>::max();
+//radius in voxels of the neighborhood used for the normal estimation
+const int normal_ring = 2;
+}
+
+std::pair<int,int> ParallelSupervoxelClustering::_voxel_row(const Eigen::Vector3i& cell, int length) const {
+    uint64_t key = tools::cell_key(cell);
+    auto first = std::lower_bound(_voxel_keys.begin(),_voxel_keys.end(),key);
+    //first + length may be past the end of the keys
+    auto bound = first + std::min<std::ptrdiff_t>(length,_voxel_keys.end() - first);
+    auto last = std::upper_bound(first,bound,key + length - 1);
+    return std::make_pair(first - _voxel_keys.begin(),last - _voxel_keys.begin());
+}
+
+float ParallelSupervoxelClustering::_distance(const voxel_t& v, const cluster_t& c) const {
+    float spatial_dist = (v.xyz - c.xyz).norm()/_seed_resolution;
+    float color_dist = (v.rgb - c.rgb).norm()/255.f;
+    float cos_angle_normal = 1.f - std::fabs(v.normal.dot(c.normal));
+    return cos_angle_normal*_normal_importance + color_dist*_color_importance + spatial_dist*_spatial_importance;
+}
+
+void ParallelSupervoxelClustering::_voxelize(){
+    const PointCloudT& cloud = *_input;
+    float inv_res = 1.f/_voxel_resolution;
+
+    std::vector<std::pair<uint64_t,int>> keys(cloud.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,cloud.size(),grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            const PointT& pt = cloud.points[i];
+            if(std::isfinite(pt.x) && std::isfinite(pt.y) && std::isfinite(pt.z))
+                keys[i] = std::make_pair(tools::cell_key(pt.x,pt.y,pt.z,inv_res),static_cast<int>(i));
+            else keys[i] = std::make_pair(invalid_key,static_cast<int>(i));
+        }
+    });
+    tbb::parallel_sort(keys.begin(),keys.end());
+
+    std::vector<size_t> starts;
+    for(size_t i = 0; i < keys.size() && keys[i].first != invalid_key; i++)
+        if(i == 0 || keys[i].first != keys[i-1].first)
+            starts.push_back(i);
+    size_t end = std::lower_bound(keys.begin(),keys.end(),std::make_pair(invalid_key,0)) - keys.begin();
+    starts.push_back(end);
+
+    size_t nbr_voxels = starts.size() - 1;
+    _voxel_keys.resize(nbr_voxels);
+    _voxels.resize(nbr_voxels);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,nbr_voxels,grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t v = r.begin(); v != r.end(); ++v){
+            voxel_t& voxel = _voxels[v];
+            voxel.xyz.setZero();
+            voxel.rgb.setZero();
+            for(size_t i = starts[v]; i < starts[v+1]; i++){
+                const PointT& pt = cloud.points[keys[i].second];
+                voxel.xyz += Eigen::Vector3f(pt.x,pt.y,pt.z);
+                voxel.rgb += Eigen::Vector3f(pt.r,pt.g,pt.b);
+            }
+            float n = starts[v+1] - starts[v];
+            voxel.xyz /= n;
+            voxel.rgb /= n;
+            const PointT& pt = cloud.points[keys[starts[v]].second];
+            voxel.cell = tools::cell_of(pt.x,pt.y,pt.z,inv_res);
+            _voxel_keys[v] = keys[starts[v]].first;
+        }
+    });
+}
+
+void ParallelSupervoxelClustering::_voxel_adjacency(){
+    size_t nbr_voxels = _voxels.size();
+    std::vector<int> count(nbr_voxels + 1,0);
+
+    //neighbors among the 26 surrounding cells
+    auto find_neighbors = [&](size_t v, int* neighbors) -> int {
+        int nbr = 0;
+        for(int i = -1; i <= 1; i++)
+            for(int j = -1; j <= 1; j++){
+                std::pair<int,int> row = _voxel_row(_voxels[v].cell + Eigen::Vector3i(i,j,-1),3);
+                for(int n = row.first; n < row.second; n++)
+                    if(n != static_cast<int>(v))
+                        neighbors[nbr++] = n;
+            }
+        return nbr;
+    };
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,nbr_voxels,grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        int neighbors[26];
+        for(size_t v = r.begin(); v != r.end(); ++v)
+            count[v+1] = find_neighbors(v,neighbors);
+    });
+
+    _neighbor_offsets.resize(nbr_voxels + 1);
+    std::partial_sum(count.begin(),count.end(),_neighbor_offsets.begin());
+    _neighbors.resize(_neighbor_offsets.back());
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,nbr_voxels,grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t v = r.begin(); v != r.end(); ++v)
+            find_neighbors(v,&_neighbors[_neighbor_offsets[v]]);
+    });
+}
+
+void ParallelSupervoxelClustering::_compute_normals(){
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,_voxels.size(),grain_size / 8),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t v = r.begin(); v != r.end(); ++v){
+            voxel_t& voxel = _voxels[v];
+            Eigen::Vector3f mean = Eigen::Vector3f::Zero();
+            Eigen::Matrix3f second_moment = Eigen::Matrix3f::Zero();
+            int nbr = 0;
+            for(int i = -normal_ring; i <= normal_ring; i++)
+                for(int j = -normal_ring; j <= normal_ring; j++){
+                    std::pair<int,int> row = _voxel_row(voxel.cell + Eigen::Vector3i(i,j,-normal_ring),2*normal_ring + 1);
+                    for(int n = row.first; n < row.second; n++){
+                        //centered on the voxel to keep the float precision
+                        Eigen::Vector3f p = _voxels[n].xyz - voxel.xyz;
+                        mean += p;
+                        second_moment += p*p.transpose();
+                        nbr++;
+                    }
+                }
+
+            //normals are oriented toward the viewpoint (origin of the cloud)
+            Eigen::Vector3f view = -voxel.xyz;
+            if(nbr < 3){
+                voxel.normal = view.normalized();
+                voxel.curvature = 0;
+                continue;
+            }
+            mean /= nbr;
+            Eigen::Matrix3f covariance = second_moment/nbr - mean*mean.transpose();
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+            voxel.normal = solver.eigenvectors().col(0);
+            if(voxel.normal.dot(view) < 0)
+                voxel.normal = -voxel.normal;
+            float sum = solver.eigenvalues().sum();
+            voxel.curvature = sum > 0 ? solver.eigenvalues()(0)/sum : 0;
+        }
+    });
+}
+
+void ParallelSupervoxelClustering::_select_seeds(){
+    float inv_res = 1.f/_seed_resolution;
+    size_t nbr_voxels = _voxels.size();
+
+    std::vector<std::pair<uint64_t,int>> keys(nbr_voxels);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,nbr_voxels,grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t v = r.begin(); v != r.end(); ++v){
+            const Eigen::Vector3f& p = _voxels[v].xyz;
+            keys[v] = std::make_pair(tools::cell_key(p(0),p(1),p(2),inv_res),static_cast<int>(v));
+        }
+    });
+    tbb::parallel_sort(keys.begin(),keys.end());
+
+    //same density criterion as pcl : at least 5% of a ball of diameter seed_resolution must be occupied
+    float search_volume = 4.f/3.f*M_PI*std::pow(0.5f*_seed_resolution,3);
+    float min_voxels = 0.05f*search_volume/std::pow(_voxel_resolution,3);
+
+    _clusters.clear();
+    size_t start = 0;
+    for(size_t i = 1; i <= keys.size(); i++){
+        if(i < keys.size() && keys[i].first == keys[start].first)
+            continue;
+        if(i - start >= min_voxels){
+            const Eigen::Vector3f& p = _voxels[keys[start].second].xyz;
+            Eigen::Vector3f center = (tools::cell_of(p(0),p(1),p(2),inv_res).cast<float>()
+                                      + Eigen::Vector3f::Constant(0.5f))*_seed_resolution;
+            int seed = keys[start].second;
+            float min_dist = (p - center).squaredNorm();
+            for(size_t j = start + 1; j < i; j++){
+                float dist = (_voxels[keys[j].second].xyz - center).squaredNorm();
+                if(dist < min_dist){
+                    min_dist = dist;
+                    seed = keys[j].second;
+                }
+            }
+            cluster_t cluster;
+            cluster.xyz = _voxels[seed].xyz;
+            cluster.rgb = _voxels[seed].rgb;
+            cluster.normal = _voxels[seed].normal;
+            _clusters.push_back(cluster);
+        }
+        start = i;
+    }
+}
+
+void ParallelSupervoxelClustering::_assign(){
+    float inv_res = 1.f/_seed_resolution;
+
+    //clusters sorted by the seed cell of their centroid
+    std::vector<std::pair<uint64_t,int>> cells(_clusters.size());
+    for(size_t c = 0; c < _clusters.size(); c++){
+        const Eigen::Vector3f& p = _clusters[c].xyz;
+        cells[c] = std::make_pair(tools::cell_key(p(0),p(1),p(2),inv_res),static_cast<int>(c));
+    }
+    std::sort(cells.begin(),cells.end());
+
+    _assignment.resize(_voxels.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,_voxels.size(),grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t v = r.begin(); v != r.end(); ++v){
+            const voxel_t& voxel = _voxels[v];
+            Eigen::Vector3i cell = tools::cell_of(voxel.xyz(0),voxel.xyz(1),voxel.xyz(2),inv_res);
+            int best = -1;
+            float best_dist = std::numeric_limits<float>::max();
+            for(int i = -1; i <= 1; i++)
+                for(int j = -1; j <= 1; j++)
+                    for(int k = -1; k <= 1; k++){
+                        uint64_t key = tools::cell_key(cell + Eigen::Vector3i(i,j,k));
+                        auto it = std::lower_bound(cells.begin(),cells.end(),std::make_pair(key,0));
+                        for(; it != cells.end() && it->first == key; ++it){
+                            float dist = _distance(voxel,_clusters[it->second]);
+                            if(dist < best_dist){
+                                best_dist = dist;
+                                best = it->second;
+                            }
+                        }
+                    }
+            _assignment[v] = best;
+        }
+    });
+}
+
+void ParallelSupervoxelClustering::_update_clusters(){
+    struct accumulator_t{
+        Eigen::Vector3f xyz = Eigen::Vector3f::Zero();
+        Eigen::Vector3f rgb = Eigen::Vector3f::Zero();
+        Eigen::Vector3f normal = Eigen::Vector3f::Zero();
+        int nbr = 0;
+    };
+
+    size_t nbr_clusters = _clusters.size();
+    tbb::combinable<std::vector<accumulator_t>> partial_sums([nbr_clusters]{
+        return std::vector<accumulator_t>(nbr_clusters);
+    });
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,_voxels.size(),grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        std::vector<accumulator_t>& sums = partial_sums.local();
+        for(size_t v = r.begin(); v != r.end(); ++v){
+            if(_assignment[v] < 0)
+                continue;
+            accumulator_t& acc = sums[_assignment[v]];
+            acc.xyz += _voxels[v].xyz;
+            acc.rgb += _voxels[v].rgb;
+            acc.normal += _voxels[v].normal;
+            acc.nbr++;
+        }
+    });
+
+    std::vector<accumulator_t> sums(nbr_clusters);
+    partial_sums.combine_each([&](const std::vector<accumulator_t>& local){
+        for(size_t c = 0; c < nbr_clusters; c++){
+            sums[c].xyz += local[c].xyz;
+            sums[c].rgb += local[c].rgb;
+            sums[c].normal += local[c].normal;
+            sums[c].nbr += local[c].nbr;
+        }
+    });
+
+    //a cluster without voxel keeps its previous position
+    for(size_t c = 0; c < nbr_clusters; c++){
+        if(sums[c].nbr == 0)
+            continue;
+        _clusters[c].xyz = sums[c].xyz/sums[c].nbr;
+        _clusters[c].rgb = sums[c].rgb/sums[c].nbr;
+        if(sums[c].normal.squaredNorm() > 0)
+            _clusters[c].normal = sums[c].normal.normalized();
+    }
+}
+
+void ParallelSupervoxelClustering::_enforce_connectivity(){
+    size_t nbr_voxels = _voxels.size();
+
+    //connected components of voxels with the same assignment
+    std::vector<int> component(nbr_voxels,-1);
+    std::vector<int> component_size;
+    std::vector<int> component_cluster;
+    std::queue<int> to_visit;
+    for(size_t v = 0; v < nbr_voxels; v++){
+        if(component[v] >= 0)
+            continue;
+        int comp = component_size.size();
+        component_size.push_back(0);
+        component_cluster.push_back(_assignment[v]);
+        component[v] = comp;
+        to_visit.push(v);
+        while(!to_visit.empty()){
+            int cur = to_visit.front();
+            to_visit.pop();
+            component_size[comp]++;
+            for(int i = _neighbor_offsets[cur]; i < _neighbor_offsets[cur+1]; i++){
+                int n = _neighbors[i];
+                if(component[n] < 0 && _assignment[n] == _assignment[v]){
+                    component[n] = comp;
+                    to_visit.push(n);
+                }
+            }
+        }
+    }
+
+    //each cluster keeps its largest component, the other fragments are merged to a neighbor
+    std::vector<int> largest(_clusters.size(),-1);
+    for(size_t comp = 0; comp < component_size.size(); comp++){
+        int c = component_cluster[comp];
+        if(c >= 0 && (largest[c] < 0 || component_size[comp] > component_size[largest[c]]))
+            largest[c] = comp;
+    }
+    std::vector<int> final_cluster(component_size.size(),-1);
+    for(size_t c = 0; c < largest.size(); c++)
+        if(largest[c] >= 0)
+            final_cluster[largest[c]] = c;
+
+    //voxels of each component, grouped by a counting sort
+    std::vector<int> component_offsets(component_size.size() + 1,0);
+    for(size_t comp = 0; comp < component_size.size(); comp++)
+        component_offsets[comp + 1] = component_offsets[comp] + component_size[comp];
+    std::vector<int> component_voxels(nbr_voxels);
+    std::vector<int> fill(component_offsets.begin(),component_offsets.end() - 1);
+    for(size_t v = 0; v < nbr_voxels; v++)
+        component_voxels[fill[component[v]]++] = v;
+
+    //one breadth first search over the components from the kept ones : a fragment joins the cluster
+    //of the first kept component reaching it. The unreached voxels (no cluster) are not traversed.
+    std::queue<int> components;
+    for(size_t comp = 0; comp < final_cluster.size(); comp++)
+        if(final_cluster[comp] >= 0)
+            components.push(comp);
+    while(!components.empty()){
+        int comp = components.front();
+        components.pop();
+        for(int k = component_offsets[comp]; k < component_offsets[comp + 1]; k++){
+            int v = component_voxels[k];
+            for(int i = _neighbor_offsets[v]; i < _neighbor_offsets[v+1]; i++){
+                int n_comp = component[_neighbors[i]];
+                if(final_cluster[n_comp] < 0 && component_cluster[n_comp] >= 0){
+                    final_cluster[n_comp] = final_cluster[comp];
+                    components.push(n_comp);
+                }
+            }
+        }
+    }
+
+    //the unreached voxels and the fragments without a path to a kept component are dropped, as pcl does
+    //for the voxels no seed reaches
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,nbr_voxels,grain_size),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t v = r.begin(); v != r.end(); ++v)
+            _assignment[v] = final_cluster[component[v]];
+    });
+}
+
+void ParallelSupervoxelClustering::extract(SupervoxelArray& supervoxels){
+    supervoxels.clear();
+    _adjacency.clear();
+    _voxels.clear();
+    _voxel_keys.clear();
+    _clusters.clear();
+    if(!_input || _input->empty())
+        return;
+
+    _voxelize();
+    _voxel_adjacency();
+    _compute_normals();
+    _select_seeds();
+    if(_clusters.empty())
+        return;
+
+    for(int i = 0; i < _nbr_iterations; i++){
+        _assign();
+        _update_clusters();
+    }
+    _assign();
+    _enforce_connectivity();
+
+    //labels from 1 for the non empty clusters
+    std::vector<std::vector<int>> members(_clusters.size());
+    for(size_t v = 0; v < _voxels.size(); v++)
+        if(_assignment[v] >= 0)
+            members[_assignment[v]].push_back(v);
+    std::vector<uint32_t> labels(_clusters.size(),0);
+    uint32_t next_label = 1;
+    for(size_t c = 0; c < _clusters.size(); c++)
+        if(!members[c].empty())
+            labels[c] = next_label++;
+
+    std::vector<pcl::Supervoxel<PointT>::Ptr> result(_clusters.size());
+    std::vector<std::set<uint32_t>> neighbors(_clusters.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,_clusters.size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t c = r.begin(); c != r.end(); ++c){
+            if(members[c].empty())
+                continue;
+            pcl::Supervoxel<PointT>::Ptr sv(new pcl::Supervoxel<PointT>);
+            Eigen::Vector3f xyz = Eigen::Vector3f::Zero(), rgb = Eigen::Vector3f::Zero(), normal = Eigen::Vector3f::Zero();
+            float curvature = 0;
+            for(int v : members[c]){
+                const voxel_t& voxel = _voxels[v];
+                PointT pt;
+                pt.x = voxel.xyz(0); pt.y = voxel.xyz(1); pt.z = voxel.xyz(2);
+                pt.r = voxel.rgb(0) + .5f; pt.g = voxel.rgb(1) + .5f; pt.b = voxel.rgb(2) + .5f;
+                pt.a = 255;
+                sv->voxels_->push_back(pt);
+                pcl::Normal n;
+                n.normal_x = voxel.normal(0); n.normal_y = voxel.normal(1); n.normal_z = voxel.normal(2);
+                n.curvature = voxel.curvature;
+                sv->normals_->push_back(n);
+
+                xyz += voxel.xyz;
+                rgb += voxel.rgb;
+                normal += voxel.normal;
+                curvature += voxel.curvature;
+
+                for(int i = _neighbor_offsets[v]; i < _neighbor_offsets[v+1]; i++){
+                    int a = _assignment[_neighbors[i]];
+                    if(a >= 0 && a != static_cast<int>(c))
+                        neighbors[c].insert(labels[a]);
+                }
+            }
+            float nbr = members[c].size();
+            xyz /= nbr;
+            rgb /= nbr;
+            if(normal.squaredNorm() > 0)
+                normal.normalize();
+            sv->centroid_.x = xyz(0); sv->centroid_.y = xyz(1); sv->centroid_.z = xyz(2);
+            sv->centroid_.r = rgb(0) + .5f; sv->centroid_.g = rgb(1) + .5f; sv->centroid_.b = rgb(2) + .5f;
+            sv->centroid_.a = 255;
+            sv->normal_.normal_x = normal(0); sv->normal_.normal_y = normal(1); sv->normal_.normal_z = normal(2);
+            sv->normal_.curvature = curvature/nbr;
+            result[c] = sv;
+        }
+    });
+
+    for(size_t c = 0; c < _clusters.size(); c++){
+        if(!result[c])
+            continue;
+        supervoxels.emplace(labels[c],result[c]);
+        for(const uint32_t& n : neighbors[c])
+            _adjacency.emplace(labels[c],n);
+    }
+}
+
+void ParallelSupervoxelClustering::getSupervoxelAdjacency(AdjacencyMap& adjacency) const {
+    adjacency = _adjacency;
+}
@@ -0,0 +1,90 @@
+#include <image_processing/RelevanceDiffusion.h>
+#include <limits>
+
+using namespace image_processing;
+
+void RelevanceDiffusion::init(const FlatSupervoxelArray& svs, const RelevanceMap& weights){
+    _first_neighbor = svs.empty() ? nullptr : svs.neighbors_begin(0);
+    _rows.resize(svs.size());
+    _current = matrix_t::Zero(svs.size(),weights.nbr_class());
+    for(size_t i = 0; i < svs.size(); i++){
+        _rows[i] = weights.row(svs.label(i));
+        if(_rows[i] >= 0)
+            _current.row(i) = weights.matrix().row(_rows[i]);
+    }
+    _initial = _current;
+    _next = _current;
+}
+
+void RelevanceDiffusion::store(RelevanceMap& weights) const {
+    for(size_t i = 0; i < _rows.size(); i++)
+        if(_rows[i] >= 0)
+            weights.matrix().row(_rows[i]) = _current.row(i);
+}
+
+int RelevanceDiffusion::run(const FlatSupervoxelArray& svs, RelevanceMap& weights){
+    init(svs,weights);
+
+    int iterations = 0;
+    while(iterations < _parameters.max_iterations){
+        double change;
+        if(_parameters.mode == MEAN_FIELD)
+            change = sweep([&](size_t i, double* next){mean_field(svs,i,next);});
+        else change = sweep([&](size_t i, double* next){averaging(svs,i,next);});
+        iterations++;
+        if(change < _parameters.tolerance)
+            break;
+    }
+
+    store(weights);
+    return iterations;
+}
+
+void RelevanceDiffusion::averaging(const FlatSupervoxelArray& svs, size_t i, double* next) const {
+    double total = _parameters.unary_weight;
+    for(int c = 0; c < nbr_class(); c++)
+        next[c] = _parameters.unary_weight*_initial(i,c);
+
+    for(const int* n = svs.neighbors_begin(i); n != svs.neighbors_end(i); n++){
+        if(_rows[*n] < 0)
+            continue;
+        double w = _parameters.pairwise_weight*edge_weight(n);
+        total += w;
+        for(int c = 0; c < nbr_class(); c++)
+            next[c] += w*_current(*n,c);
+    }
+
+    if(total <= 0){
+        for(int c = 0; c < nbr_class(); c++)
+            next[c] = _current(i,c);
+        return;
+    }
+    for(int c = 0; c < nbr_class(); c++)
+        next[c] /= total;
+}
+
+void RelevanceDiffusion::mean_field(const FlatSupervoxelArray& svs, size_t i, double* next) const {
+    //energies in log space : unary log-probability plus the agreement with the neighbors
+    const double min_prob = 1e-12;
+    for(int c = 0; c < nbr_class(); c++)
+        next[c] = _parameters.unary_weight*std::log(std::max(_initial(i,c),min_prob));
+
+    for(const int* n = svs.neighbors_begin(i); n != svs.neighbors_end(i); n++){
+        if(_rows[*n] < 0)
+            continue;
+        double w = _parameters.pairwise_weight*edge_weight(n);
+        for(int c = 0; c < nbr_class(); c++)
+            next[c] += w*_current(*n,c);
+    }
+
+    double max_energy = -std::numeric_limits<double>::max();
+    for(int c = 0; c < nbr_class(); c++)
+        max_energy = std::max(max_energy,next[c]);
+    double sum = 0;
+    for(int c = 0; c < nbr_class(); c++){
+        next[c] = std::exp(next[c] - max_energy);
+        sum += next[c];
+    }
+    for(int c = 0; c < nbr_class(); c++)
+        next[c] /= sum;
+}
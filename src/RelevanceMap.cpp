@@ -0,0 +1,28 @@
+#include <image_processing/RelevanceMap.h>
+#include <algorithm>
+
+using namespace image_processing;
+
+void RelevanceMap::reset(const std::vector<uint32_t>& labels, int nbr_class, double value){
+    _labels = labels;
+    uint32_t max_label = 0;
+    for(const uint32_t& lbl : _labels)
+        max_label = std::max(max_label,lbl);
+    _rows.assign(_labels.empty() ? 0 : max_label + 1,-1);
+    for(size_t r = 0; r < _labels.size(); r++)
+        _rows[_labels[r]] = r;
+    _data = matrix_t::Constant(_labels.size(),nbr_class,value);
+}
+
+void RelevanceMap::clear(){
+    _labels.clear();
+    _rows.clear();
+    _data.resize(0,0);
+}
+
+std::vector<double> RelevanceMap::get(uint32_t label) const {
+    int r = row(label);
+    if(r < 0)
+        return std::vector<double>();
+    return std::vector<double>(_data.data() + r*_data.cols(),_data.data() + (r + 1)*_data.cols());
+}
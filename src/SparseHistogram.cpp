@@ -0,0 +1,73 @@
+#include "image_processing/SparseHistogram.hpp"
+#include <algorithm>
+#include <cassert>
+
+using namespace image_processing;
+
+void SparseHistogram::compute(std::vector<uint32_t>& indices){
+    _entries.clear();
+    std::sort(indices.begin(),indices.end());
+    for(size_t i = 0; i < indices.size();){
+        size_t j = i;
+        while(j < indices.size() && indices[j] == indices[i])
+            j++;
+        assert(indices[i] < _size);
+        _entries.push_back(entry_t(indices[i],(j - i)/((double)indices.size())));
+        i = j;
+    }
+}
+
+double SparseHistogram::operator()(uint32_t index) const {
+    auto it = std::lower_bound(_entries.begin(),_entries.end(),entry_t(index,0.),
+                               [](const entry_t& a, const entry_t& b){return a.first < b.first;});
+    return it != _entries.end() && it->first == index ? it->second : 0.;
+}
+
+Eigen::VectorXd SparseHistogram::to_dense() const {
+    Eigen::VectorXd hist = Eigen::VectorXd::Zero(_size);
+    for(const entry_t& e : _entries)
+        hist(e.first) = e.second;
+    return hist;
+}
+
+double SparseHistogram::chi_squared_distance(const SparseHistogram& hist1, const SparseHistogram& hist2){
+
+    assert(hist1.size() == hist2.size());
+
+    // a bin only present in one histogram contributes (v - 0)^2/(v + 0) = v
+    double sum = 0;
+    auto it1 = hist1._entries.begin(), it2 = hist2._entries.begin();
+    while(it1 != hist1._entries.end() && it2 != hist2._entries.end()){
+        if(it1->first < it2->first)
+            sum += (it1++)->second;
+        else if(it2->first < it1->first)
+            sum += (it2++)->second;
+        else{
+            double a = (it1++)->second, b = (it2++)->second;
+            if(a + b != 0)
+                sum += (a - b)*(a - b)/(a + b);
+        }
+    }
+    for(; it1 != hist1._entries.end(); ++it1)
+        sum += it1->second;
+    for(; it2 != hist2._entries.end(); ++it2)
+        sum += it2->second;
+
+    return sum/2.;
+}
+
+double SparseHistogram::intersection(const SparseHistogram& hist1, const SparseHistogram& hist2){
+
+    assert(hist1.size() == hist2.size());
+
+    double sum = 0;
+    auto it1 = hist1._entries.begin(), it2 = hist2._entries.begin();
+    while(it1 != hist1._entries.end() && it2 != hist2._entries.end()){
+        if(it1->first < it2->first)
+            ++it1;
+        else if(it2->first < it1->first)
+            ++it2;
+        else sum += std::min((it1++)->second,(it2++)->second);
+    }
+    return sum;
+}
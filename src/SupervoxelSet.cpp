@@ -2,55 +2,203 @@
 #include <pcl/filters/extract_indices.h>
 #include <pcl/registration/correspondence_estimation.h>
 #include <boost/random.hpp>
-#include <pcl/filters/passthrough.h>
-#include <pcl/filters/model_outlier_removal.h>
 #include <image_processing/features.hpp>
+#include <pcl/octree/octree_pointcloud_changedetector.h>
+#include <image_processing/voxel_key.hpp>
+#include <tbb/tbb.h>
+#include <unordered_set>
+#include <unordered_map>
 
 using namespace image_processing;
 
 const std::map<std::string, function_t> features_fct::fct_map = features_fct::create_map();
+const std::map<std::string,std::function<void(const FlatSupervoxelArray&)>> features_fct::cache_map =
+        features_fct::create_cache_map();
+const std::map<std::string,std::vector<std::string>> features_fct::dependencies = features_fct::create_dependencies();
+
+namespace {
+
+/**
+ * @brief workspace bounds flattened in single precision so the test of a point is branch free.
+ * The sphere test reproduces pcl::ModelOutlierRemoval with setNegative(true) : a point is kept
+ * if its distance to the sphere surface is not below the threshold. It is done on squared distances.
+ */
+struct workspace_crop_t{
+
+    workspace_crop_t(const workspace_t& ws) :
+        min_x(ws.area[0]), max_x(ws.area[1]),
+        min_y(ws.area[2]), max_y(ws.area[3]),
+        min_z(ws.area[4]), max_z(ws.area[5]),
+        with_sphere(ws.with_sphere),
+        cx(ws.sphere.x), cy(ws.sphere.y), cz(ws.sphere.z){
+        double inner = ws.sphere.radius - ws.sphere.threshold;
+        double outer = ws.sphere.radius + ws.sphere.threshold;
+        inner2 = inner >= 0 ? inner*inner : -1.f;
+        outer2 = outer*outer;
+    }
 
-void workspace_t::filter(PointCloudT::Ptr cloud){
+    bool operator()(const PointT& pt) const{
+        bool keep = (pt.x >= min_x) & (pt.x <= max_x)
+                & (pt.y >= min_y) & (pt.y <= max_y)
+                & (pt.z >= min_z) & (pt.z <= max_z);
+        if(!with_sphere)
+            return keep;
+        float dx = pt.x - cx, dy = pt.y - cy, dz = pt.z - cz;
+        float d2 = dx*dx + dy*dy + dz*dz;
+        return keep & ((d2 >= outer2) | (d2 <= inner2));
+    }
 
-    pcl::PassThrough<PointT> passFilter;
+    float min_x, max_x, min_y, max_y, min_z, max_z;
+    bool with_sphere;
+    float cx, cy, cz, inner2, outer2;
+};
+
+void compute_crop_mask(const workspace_crop_t& crop, const PointCloudT& cloud,
+                       std::vector<uint8_t>& mask, bool parallel){
+    mask.resize(cloud.size());
+    auto body = [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i)
+            mask[i] = crop(cloud.points[i]);
+    };
+    if(parallel)
+        tbb::parallel_for(tbb::blocked_range<size_t>(0,cloud.size(),4096),body);
+    else body(tbb::blocked_range<size_t>(0,cloud.size()));
+}
 
-    if(with_sphere){
-        pcl::ModelCoefficients sphere_coeff;
-        sphere_coeff.values.resize (4);
-        sphere_coeff.values[0] = sphere.x;
-        sphere_coeff.values[1] = sphere.y;
-        sphere_coeff.values[2] = sphere.z;
-        sphere_coeff.values[3] = sphere.radius;
+}
 
-        pcl::ModelOutlierRemoval<PointT> sphere_filter;
-        sphere_filter.setModelCoefficients (sphere_coeff);
-        sphere_filter.setNegative(true);
-        sphere_filter.setThreshold (sphere.threshold);
-        sphere_filter.setModelType (pcl::SACMODEL_SPHERE);
-        sphere_filter.setInputCloud (cloud);
-        sphere_filter.filter(*cloud);
+void workspace_t::filter(PointCloudT::Ptr cloud, bool parallel){
+    std::vector<uint8_t> mask;
+    compute_crop_mask(workspace_crop_t(*this),*cloud,mask,parallel);
+
+    //in place compaction, the write index never overtakes the read index
+    size_t n = 0;
+    for(size_t i = 0; i < mask.size(); i++){
+        if(!mask[i])
+            continue;
+        if(n != i)
+            cloud->points[n] = cloud->points[i];
+        n++;
     }
+    cloud->points.resize(n);
+    cloud->width = n;
+    cloud->height = 1;
+    cloud->is_dense = true;
+}
 
-    passFilter.setInputCloud(cloud);
-    passFilter.setFilterFieldName("x");
-    passFilter.setFilterLimits(area[0],area[1]);
-    passFilter.filter(*cloud);
+void workspace_t::filter(const PointCloudT::ConstPtr& cloud, std::vector<int>& indices, bool parallel) const{
+    std::vector<uint8_t> mask;
+    compute_crop_mask(workspace_crop_t(*this),*cloud,mask,parallel);
 
-    passFilter.setInputCloud(cloud);
-    passFilter.setFilterFieldName("y");
-    passFilter.setFilterLimits(area[2],area[3]);
-    passFilter.filter(*cloud);
+    indices.clear();
+    for(size_t i = 0; i < mask.size(); i++)
+        if(mask[i])
+            indices.push_back(i);
+}
 
-    passFilter.setInputCloud(cloud);
-    passFilter.setFilterFieldName("z");
-    passFilter.setFilterLimits(area[4],area[5]);
-    passFilter.filter(*cloud);
+void workspace_t::filter(PointCloudT::Ptr cloud, const cv::Rect& roi){
+    assert(cloud->isOrganized());
+    workspace_crop_t crop(*this);
+
+    //in place compaction : rows and columns are read in increasing order
+    size_t n = 0;
+    for(int v = roi.y; v < roi.y + roi.height; v++){
+        size_t row = v*cloud->width;
+        for(int u = roi.x; u < roi.x + roi.width; u++){
+            if(crop(cloud->points[row + u]))
+                cloud->points[n++] = cloud->points[row + u];
+        }
+    }
+    cloud->points.resize(n);
+    cloud->width = n;
+    cloud->height = 1;
+    cloud->is_dense = true;
 }
 
-bool SupervoxelSet::computeSupervoxel(workspace_t& workspace){
+bool workspace_t::image_roi(float fx, float fy, float cx, float cy, int width, int height, cv::Rect& roi) const{
+    double lo[3] = {area[0],area[2],area[4]};
+    double hi[3] = {area[1],area[3],area[5]};
+
+    //if the box does not reach the outer part of the removed shell, only the inner ball of the sphere is kept
+    if(with_sphere && sphere.radius - sphere.threshold > 0){
+        double center[3] = {sphere.x,sphere.y,sphere.z};
+        double far2 = 0;
+        for(int i = 0; i < 3; i++){
+            double d = std::max(fabs(lo[i] - center[i]),fabs(hi[i] - center[i]));
+            far2 += d*d;
+        }
+        double outer = sphere.radius + sphere.threshold;
+        if(far2 < outer*outer){
+            double inner = sphere.radius - sphere.threshold;
+            for(int i = 0; i < 3; i++){
+                lo[i] = std::max(lo[i],center[i] - inner);
+                hi[i] = std::min(hi[i],center[i] + inner);
+            }
+        }
+    }
+
+    if(lo[0] > hi[0] || lo[1] > hi[1] || lo[2] > hi[2]){
+        roi = cv::Rect();
+        return false;
+    }
+
+    //points near the image plane project anywhere
+    if(lo[2] <= 0){
+        roi = cv::Rect(0,0,width,height);
+        return true;
+    }
+
+    //x/z and y/z reach their extrema on the corners of the box
+    double u_min = fx*std::min(lo[0]/lo[2],lo[0]/hi[2]) + cx;
+    double u_max = fx*std::max(hi[0]/lo[2],hi[0]/hi[2]) + cx;
+    double v_min = fy*std::min(lo[1]/lo[2],lo[1]/hi[2]) + cy;
+    double v_max = fy*std::max(hi[1]/lo[2],hi[1]/hi[2]) + cy;
+
+    //one pixel of margin for the rounding of the back projection
+    int u0 = std::max(0,(int)std::floor(u_min) - 1);
+    int u1 = std::min(width,(int)std::ceil(u_max) + 2);
+    int v0 = std::max(0,(int)std::floor(v_min) - 1);
+    int v1 = std::min(height,(int)std::ceil(v_max) + 2);
+
+    if(u0 >= u1 || v0 >= v1){
+        roi = cv::Rect();
+        return false;
+    }
+
+    roi = cv::Rect(u0,v0,u1-u0,v1-v0);
+    return true;
+}
+
+void SupervoxelSet::_extract(const PointCloudT::Ptr& cloud, SupervoxelArray& supervoxels, AdjacencyMap& adjacency){
+    if(_parallel_clustering){
+        _parallel_extractor->setInputCloud(cloud);
+        _parallel_extractor->extract(supervoxels);
+        _parallel_extractor->getSupervoxelAdjacency(adjacency);
+    }
+    else{
+        _extractor->setInputCloud(cloud);
+        _extractor->extract(supervoxels);
+        _extractor->getSupervoxelAdjacency(adjacency);
+    }
+}
+
+void SupervoxelSet::_crop_workspace(workspace_t& workspace){
+    if(_organized_crop && _inputCloud->isOrganized()
+            && _inputCloud->width == _cam_param.width
+            && _inputCloud->height == _cam_param.height){
+        cv::Rect roi;
+        if(workspace.image_roi(_cam_param.focal_length_x,_cam_param.focal_length_y,
+                               _cam_param.depth_princ_pt_x,_cam_param.depth_princ_pt_y,
+                               _inputCloud->width,_inputCloud->height,roi))
+            workspace.filter(_inputCloud,roi);
+        else _inputCloud->clear();
+    }
+    else workspace.filter(_inputCloud,true);
+}
 
+bool SupervoxelSet::computeSupervoxel(workspace_t& workspace){
 
-    workspace.filter(_inputCloud);
+    _crop_workspace(workspace);
 
     //input cloud
     if(_inputCloud->empty()){
@@ -58,17 +206,14 @@ bool SupervoxelSet::computeSupervoxel(workspace_t& workspace){
         return false;
     }
 
-
-    //definition of super voxel clustering class
-    _extractor->setInputCloud(_inputCloud);
-
-    //--
+    _previous_cloud.reset();
 
 //    std::cout << "Extracting supervoxels!" << std::endl;
 
-    _extractor->extract(_supervoxels);
+    _extract(_inputCloud,_supervoxels,_adjacency_map);
+    _flat_valid = false;
     assert(_supervoxels.size() != 0);
-    _extractor->getSupervoxelAdjacency(_adjacency_map);
+    _next_label = _supervoxels.empty() ? 1 : _supervoxels.rbegin()->first + 1;
 //   std::cout << "Found " << _supervoxels.size() << " supervoxels" << std::endl;
     return true;
 }
@@ -82,22 +227,178 @@ bool SupervoxelSet::computeSupervoxel(){
         return false;
     }
 
-
-    //definition of super voxel clustering class
-    _extractor->setInputCloud(_inputCloud);
-
-    //--
+    _previous_cloud.reset();
 
 //    std::cout << "Extracting supervoxels!" << std::endl;
 
-    _extractor->extract(_supervoxels);
+    _extract(_inputCloud,_supervoxels,_adjacency_map);
+    _flat_valid = false;
     assert(_supervoxels.size() != 0);
-    _extractor->getSupervoxelAdjacency(_adjacency_map);
+    _next_label = _supervoxels.empty() ? 1 : _supervoxels.rbegin()->first + 1;
 
     std::cout << "Found " << _supervoxels.size() << " supervoxels" << std::endl;
     return true;
 }
 
+bool SupervoxelSet::updateSupervoxel(workspace_t& workspace, double octree_res, double max_change_ratio){
+
+    _crop_workspace(workspace);
+
+    if(_inputCloud->empty()){
+        std::cerr << "error : input cloud is empty" << std::endl;
+        return false;
+    }
+
+    if(!_previous_cloud || _supervoxels.empty()){
+        if(!computeSupervoxel())
+            return false;
+        _previous_cloud.reset(new PointCloudT(*_inputCloud));
+        return true;
+    }
+
+    //changed cells in both directions : appearing and disappearing points
+    std::vector<int> appeared, disappeared;
+    {
+        pcl::octree::OctreePointCloudChangeDetector<PointT> octree(octree_res);
+        octree.setInputCloud(_previous_cloud);
+        octree.addPointsFromInputCloud();
+        octree.switchBuffers();
+        octree.setInputCloud(_inputCloud);
+        octree.addPointsFromInputCloud();
+        octree.getPointIndicesFromNewVoxels(appeared);
+    }
+    {
+        pcl::octree::OctreePointCloudChangeDetector<PointT> octree(octree_res);
+        octree.setInputCloud(_inputCloud);
+        octree.addPointsFromInputCloud();
+        octree.switchBuffers();
+        octree.setInputCloud(_previous_cloud);
+        octree.addPointsFromInputCloud();
+        octree.getPointIndicesFromNewVoxels(disappeared);
+    }
+
+    if(appeared.empty() && disappeared.empty()){
+        _previous_cloud.reset(new PointCloudT(*_inputCloud));
+        return true;
+    }
+
+    //changed cells dilated by one cell so that the supervoxels bordering a change are re-clustered too
+    float inv_cr = 1./octree_res;
+    std::unordered_set<uint64_t> changed_cells;
+    auto mark_changed = [&](const PointT& pt){
+        Eigen::Vector3i c = tools::cell_of(pt.x,pt.y,pt.z,inv_cr);
+        for(int i = -1; i <= 1; i++)
+            for(int j = -1; j <= 1; j++)
+                for(int k = -1; k <= 1; k++)
+                    changed_cells.insert(tools::cell_key(c + Eigen::Vector3i(i,j,k)));
+    };
+    for(int i : appeared)
+        mark_changed(_inputCloud->points[i]);
+    for(int i : disappeared)
+        mark_changed(_previous_cloud->points[i]);
+
+    //supervoxels touching a changed cell
+    std::set<uint32_t> affected;
+    size_t nbr_voxels = 0, nbr_affected_voxels = 0;
+    for(const auto& sv : _supervoxels){
+        nbr_voxels += sv.second->voxels_->size();
+        for(const auto& pt : *(sv.second->voxels_)){
+            if(changed_cells.count(tools::cell_key(pt.x,pt.y,pt.z,inv_cr))){
+                affected.insert(sv.first);
+                nbr_affected_voxels += sv.second->voxels_->size();
+                break;
+            }
+        }
+    }
+
+    if(nbr_affected_voxels > max_change_ratio*nbr_voxels){
+        if(!computeSupervoxel())
+            return false;
+        _previous_cloud.reset(new PointCloudT(*_inputCloud));
+        return true;
+    }
+
+    //region to re-cluster : changed cells and cells of the affected supervoxels
+    std::unordered_set<uint64_t> region_cells(changed_cells);
+    for(const uint32_t& lbl : affected)
+        for(const auto& pt : *(_supervoxels[lbl]->voxels_))
+            region_cells.insert(tools::cell_key(pt.x,pt.y,pt.z,inv_cr));
+
+    //voxels of the stable supervoxels. A point of the region within one voxel of a stable voxel
+    //is considered as already represented and is left out of the re-clustering.
+    float inv_vr = 1./_extractor->getVoxelResolution();
+    std::unordered_map<uint64_t,uint32_t> stable_voxels;
+    for(const auto& sv : _supervoxels){
+        if(affected.count(sv.first))
+            continue;
+        for(const auto& pt : *(sv.second->voxels_))
+            stable_voxels.emplace(tools::cell_key(pt.x,pt.y,pt.z,inv_vr),sv.first);
+    }
+    auto near_stable = [&](const Eigen::Vector3i& c) -> uint32_t {
+        for(int i = -1; i <= 1; i++)
+            for(int j = -1; j <= 1; j++)
+                for(int k = -1; k <= 1; k++){
+                    auto it = stable_voxels.find(tools::cell_key(c + Eigen::Vector3i(i,j,k)));
+                    if(it != stable_voxels.end())
+                        return it->second;
+                }
+        return 0;
+    };
+
+    PointCloudT::Ptr region_cloud(new PointCloudT);
+    for(const auto& pt : *_inputCloud){
+        if(!region_cells.count(tools::cell_key(pt.x,pt.y,pt.z,inv_cr)))
+            continue;
+        if(near_stable(tools::cell_of(pt.x,pt.y,pt.z,inv_vr)))
+            continue;
+        region_cloud->push_back(pt);
+    }
+
+    //remove the affected supervoxels and their adjacency in both directions
+    for(const uint32_t& lbl : affected)
+        remove(lbl);
+    for(auto it = _adjacency_map.begin(); it != _adjacency_map.end();){
+        if(affected.count(it->second))
+            it = _adjacency_map.erase(it);
+        else ++it;
+    }
+
+    if(!region_cloud->empty()){
+        SupervoxelArray new_supervoxels;
+        AdjacencyMap new_adjacency;
+        _extract(region_cloud,new_supervoxels,new_adjacency);
+
+        //new labels start after the highest label ever given so removed labels are never reused
+        std::map<uint32_t,uint32_t> relabel;
+        for(const auto& sv : new_supervoxels){
+            relabel[sv.first] = _next_label;
+            _supervoxels.emplace(_next_label++,sv.second);
+        }
+        for(const auto& adj : new_adjacency)
+            _adjacency_map.emplace(relabel[adj.first],relabel[adj.second]);
+
+        //adjacency between the new supervoxels and the stable ones
+        std::set<std::pair<uint32_t,uint32_t>> border;
+        for(const auto& sv : new_supervoxels){
+            uint32_t lbl = relabel[sv.first];
+            for(const auto& pt : *(sv.second->voxels_)){
+                uint32_t stable_lbl = near_stable(tools::cell_of(pt.x,pt.y,pt.z,inv_vr));
+                if(stable_lbl)
+                    border.emplace(lbl,stable_lbl);
+            }
+        }
+        for(const auto& b : border){
+            _adjacency_map.emplace(b.first,b.second);
+            _adjacency_map.emplace(b.second,b.first);
+        }
+    }
+
+    _flat_valid = false;
+
+    _previous_cloud.reset(new PointCloudT(*_inputCloud));
+    return true;
+}
+
 void SupervoxelSet::extractEdges(PointCloudT::Ptr edges_cloud, AdjacencyMap supervoxel_adjacency){
 
     if(supervoxel_adjacency.empty())
@@ -179,6 +480,7 @@ void SupervoxelSet::consolidate(){
         }
         //        super_it = adjacency_map.upper_bound (adja_it->first);
     }
+    _flat_valid = false;
 
 }
 
@@ -188,39 +490,34 @@ bool SupervoxelSet::contain(uint32_t label){
 
 uint32_t SupervoxelSet::whichVoxelContain(float x, float y, float z){
 
-    pcl::PointXYZ pt;
+    PointT pt;
     pt.x = x;
     pt.y = y;
     pt.z = z;
 
-    pcl::KdTreeFLANN<pcl::PointXYZ>::Ptr tree(new pcl::KdTreeFLANN<pcl::PointXYZ>);
-    PointCloudT centr;
-    std::map<int, uint32_t> centroids_label;
-    getCentroidCloud(centr,centroids_label);
-    PointCloudXYZ::Ptr centroids(new PointCloudXYZ);
-    for(int i = 0; i < centr.size(); i++){
-        pcl::PointXYZ pt;
-        pt.x = centr.points[i].x;
-        pt.y = centr.points[i].y;
-        pt.z = centr.points[i].z;
-        centroids->push_back(pt);
-    }
-
-    tree->setInputCloud(centroids);
-
-    std::vector<int> nn_indices(1);
-    std::vector<float> nn_distance(1);
-
-    if(!tree->nearestKSearch(pt,1,nn_indices,nn_distance))
+    int i = flat().nearest_centroid(pt);
+    if(i < 0)
         return 0;
 
-    return centroids_label[nn_indices[0]];
+    return _flat.label(i);
 
 //  boost::random::mt19937 gen;
 
 //  return isInThisVoxel(x,y,z,_supervoxels.begin()->first,_adjacency_map,gen,20);
 }
 
+void SupervoxelSet::whichVoxelContain(const PointCloudXYZ& points, std::vector<uint32_t>& labels, bool membership){
+    const FlatSupervoxelArray& supervoxels = flat();
+    std::vector<int> indices;
+    if(membership)
+        supervoxels.containing_supervoxels(points,std::sqrt(3.f)*_extractor->getVoxelResolution(),indices);
+    else supervoxels.nearest_centroids(points,indices);
+
+    labels.resize(points.size());
+    for(size_t i = 0; i < points.size(); i++)
+        labels[i] = indices[i] < 0 ? 0 : supervoxels.label(indices[i]);
+}
+
 //Deprecated
 //uint32_t SupervoxelSet::isInThisVoxel(float x, float y, float z, uint32_t label,AdjacencyMap am,  boost::random::mt19937 gen, int counter ){
 //  if(counter <= 0)
@@ -272,9 +569,11 @@ void SupervoxelSet::insert(uint32_t label,
                                pcl::Supervoxel<PointT>::Ptr supervoxel,
                                std::vector<uint32_t> neighborLabel){
     _supervoxels.insert(std::pair<uint32_t,pcl::Supervoxel<PointT>::Ptr >(label,supervoxel));
+    _next_label = std::max(_next_label,label + 1);
 
     for(int i = 0; i < neighborLabel.size(); i++)
         _adjacency_map.insert(std::pair<uint32_t,uint32_t>(label,neighborLabel.at(i)));
+    _flat_valid = false;
 }
 
 
@@ -291,6 +590,7 @@ void SupervoxelSet::remove(uint32_t label){
 //        }
 //    }
     _adjacency_map.erase(label);
+    _flat_valid = false;
 }
 
 
@@ -466,12 +766,107 @@ pcl::PointXYZ SupervoxelSet::globalPosition(){
 
 void SupervoxelSet::init_features(){
     _features.clear();
-    for(const auto& sv : _supervoxels)
-        _features.emplace(sv.first,std::map<std::string,Eigen::VectorXd>());
+    _feature_builds.clear();
+    _features.set_labels(flat().labels());
 }
 
 void SupervoxelSet::compute_feature(const std::string& name){
-    features_fct::fct_map.at(name)(_supervoxels, _adjacency_map, _features);
+    compute_features(std::vector<std::string>(1,name));
+}
+
+bool SupervoxelSet::compute_features(const std::vector<std::string>& names){
+    typedef tbb::flow::continue_node<tbb::flow::continue_msg> node_t;
+
+    //the rows of the features follow the indices of the flat array. The features computed by a previous call
+    //are still valid if the array was not rebuilt since and no row was added by set_feature
+    const FlatSupervoxelArray& svs = flat();
+    bool same_rows = _features.labels() == svs.labels();
+    auto up_to_date = [&](const std::string& name) -> bool {
+        if(!same_rows || !features_fct::fct_map.count(name) || !_features.has(name))
+            return false;
+        int id = FeatureStore::modality_id(name);
+        return id < _feature_builds.size() && _feature_builds[id] == _flat_builds;
+    };
+
+    //order the requested features and everything they depend on so that dependencies come first.
+    //The features up to date are left out, with their dependencies
+    std::vector<std::string> plan;
+    std::set<std::string> planned;
+    std::function<bool(const std::string&)> add_to_plan = [&](const std::string& name) -> bool {
+        if(planned.count(name))
+            return true;
+        if(!features_fct::fct_map.count(name) && !features_fct::cache_map.count(name)){
+            std::cerr << "SupervoxelSet Error: unknown feature : " << name << std::endl;
+            return false;
+        }
+        planned.insert(name);
+        if(up_to_date(name))
+            return true;
+        auto deps = features_fct::dependencies.find(name);
+        if(deps != features_fct::dependencies.end())
+            for(const auto& dep : deps->second)
+                if(!add_to_plan(dep))
+                    return false;
+        plan.push_back(name);
+        return true;
+    };
+    for(const auto& name : names)
+        if(!add_to_plan(name))
+            return false;
+
+    _features.set_labels(svs.labels());
+    std::vector<int> ids;
+    for(const auto& name : plan)
+        if(features_fct::fct_map.count(name))
+            ids.push_back(FeatureStore::modality_id(name));
+    _features.reserve(ids);
+    std::set<std::string> in_plan(plan.begin(),plan.end());
+
+    //the graph runs in the arena in which it is built
+    auto run = [&](){
+        tbb::flow::graph graph;
+        std::map<std::string,std::shared_ptr<node_t>> nodes;
+        for(const auto& name : plan){
+            nodes[name].reset(new node_t(graph,[this,&svs,name](const tbb::flow::continue_msg&){
+                auto fct = features_fct::fct_map.find(name);
+                if(fct != features_fct::fct_map.end())
+                    fct->second(svs,_features);
+                else features_fct::cache_map.at(name)(svs);
+                return tbb::flow::continue_msg();
+            }));
+        }
+        //the nodes whose dependencies are all up to date start the graph
+        std::vector<std::string> sources;
+        for(const auto& name : plan){
+            bool source = true;
+            auto deps = features_fct::dependencies.find(name);
+            if(deps != features_fct::dependencies.end())
+                for(const auto& dep : deps->second)
+                    if(in_plan.count(dep)){
+                        tbb::flow::make_edge(*nodes[dep],*nodes[name]);
+                        source = false;
+                    }
+            if(source)
+                sources.push_back(name);
+        }
+        for(const auto& name : sources)
+            nodes[name]->try_put(tbb::flow::continue_msg());
+        graph.wait_for_all();
+    };
+
+    if(_parallel_features)
+        run();
+    else{
+        tbb::task_arena arena(1);
+        arena.execute(run);
+    }
+
+    for(const int& id : ids){
+        if(id >= _feature_builds.size())
+            _feature_builds.resize(id + 1,0);
+        _feature_builds[id] = _flat_builds;
+    }
+    return true;
 }
 
 void SupervoxelSet::filter_supervoxels(int min_size){
@@ -487,27 +882,19 @@ void SupervoxelSet::filter_supervoxels(int min_size){
 
 void SupervoxelSet::getCentroidCloud(PointCloudT &centroids, std::map<int,uint32_t> &centroidsLabel, PointCloudN &centroid_normals){
 
-    int i = 0;
-    for(SupervoxelArray::iterator it = _supervoxels.begin()
-        ; it != _supervoxels.end(); it++){
-        pcl::Supervoxel<PointT>::Ptr supervoxel = it->second;
-        centroids.push_back(supervoxel->centroid_);
-        centroid_normals.push_back(supervoxel->normal_);
-        centroidsLabel.insert(std::pair<int,uint32_t>(i,it->first));
-        i++;
-    }
+    const FlatSupervoxelArray& svs = flat();
+    centroids += *svs.centroid_cloud();
+    centroid_normals += *svs.centroid_normal_cloud();
+    for(size_t i = 0; i < svs.size(); i++)
+        centroidsLabel.insert(std::pair<int,uint32_t>(i,svs.label(i)));
 }
 
 void SupervoxelSet::getCentroidCloud(PointCloudT &centroids, std::map<int,uint32_t> &centroidsLabel){
 
-    int i = 0;
-    for(SupervoxelArray::iterator it = _supervoxels.begin()
-        ; it != _supervoxels.end(); it++){
-        pcl::Supervoxel<PointT>::Ptr supervoxel = it->second;
-        centroids.push_back(supervoxel->centroid_);
-        centroidsLabel.insert(std::pair<int,uint32_t>(i,it->first));
-        i++;
-    }
+    const FlatSupervoxelArray& svs = flat();
+    centroids += *svs.centroid_cloud();
+    for(size_t i = 0; i < svs.size(); i++)
+        centroidsLabel.insert(std::pair<int,uint32_t>(i,svs.label(i)));
 }
 
 std::vector<uint32_t> SupervoxelSet::getNeighbor(uint32_t label){
@@ -43,54 +43,35 @@ bool SurfaceOfInterest::generate(const PointCloudT::Ptr background, workspace_t
     return true;
 }
 
-void SurfaceOfInterest::find_soi(const PointCloudXYZ::Ptr key_pts){
-    pcl::KdTreeFLANN<pcl::PointXYZ>::Ptr tree(new pcl::KdTreeFLANN<pcl::PointXYZ>());
+bool SurfaceOfInterest::generate(const BackgroundModel& background, workspace_t &workspace){
+    delete_background(background);
+    if(!computeSupervoxel(workspace))
+        return false;
+
+    init_weights("expert",2);
+    return true;
+}
 
-    PointCloudT centr;
-    std::map<int, uint32_t> centroids_label;
+void SurfaceOfInterest::find_soi(const PointCloudXYZ::Ptr key_pts){
     _labels.clear();
     _labels_no_soi.clear();
-    _weights["keyPts"].clear();
-    getCentroidCloud(centr, centroids_label);
-    PointCloudXYZ::Ptr centroids(new PointCloudXYZ);
-    for(int i = 0; i < centr.size(); i++){
-        pcl::PointXYZ pt;
-        pt.x = centr.points[i].x;
-        pt.y = centr.points[i].y;
-        pt.z = centr.points[i].z;
-        centroids->push_back(pt);
-    }
+    // the centroid index of the flat view is shared with the other queries until the set is modified
+    const FlatSupervoxelArray& supervoxels = flat();
+    std::vector<int> nn_indices;
+    supervoxels.nearest_centroids(*key_pts,nn_indices);
 
-    tree->setInputCloud(centroids);
+    std::vector<char> result(supervoxels.size(),false);
+    for(const int& i : nn_indices)
+        if(i >= 0)
+            result[i] = true;
 
-    std::vector<int> nn_indices(1);
-    std::vector<float> nn_distance(1);
 
-    std::map<uint32_t,uint32_t> result;
-//    std::map<uint32_t,uint32_t> no_result;
-
-    for(int i = 0; i < key_pts->size(); i++){
-        if(!pcl::isFinite(key_pts->points[i]))
-            continue;
-
-        if(!tree->nearestKSearch(key_pts->points[i],1,nn_indices,nn_distance)){
-            PCL_WARN ("No neighbor found for point %lu (%f %f %f)!\n",
-                      i, key_pts->points[i].x, key_pts->points[i].y, key_pts->points[i].z);
-            continue;
-        }
-
-        result.emplace(centroids_label[nn_indices[0]],centroids_label[nn_indices[0]]);
-
-//        if(nn_distance[0] < 0.05)
-//            result.emplace(centroids_label[nn_indices[0]],centroids_label[nn_indices[0]]);
-//        else
-//            no_result.emplace(centroids_label[nn_indices[0]],centroids_label[nn_indices[0]]);
-    }
-
-
-    std::vector<double> v = {0.,1.};
-    for(auto it = result.begin(); it != result.end(); it++)
-        _weights["keyPts"].emplace(it->first,v);
+    std::vector<uint32_t> soi;
+    for(size_t i = 0; i < result.size(); i++)
+        if(result[i])
+            soi.push_back(supervoxels.label(i));
+    relevance_map_t& weights = reset_weights("keyPts",soi,2,0.);
+    weights.matrix().col(1).setOnes();
 
 
 //    for(auto it = no_result.begin(); it != no_result.end(); it++)
@@ -106,113 +87,160 @@ void SurfaceOfInterest::find_soi(const PointCloudXYZ::Ptr key_pts){
 void SurfaceOfInterest::init_weights(const std::string& modality, int nbr_class, float value){
 //    for(auto& mod : _weights){
 //        mod.second.clear();
-    _weights[modality].clear();
-    for(auto it_sv = _supervoxels.begin(); it_sv != _supervoxels.end(); it_sv++){
-        _weights[modality].emplace(it_sv->first,std::vector<double>(nbr_class,value));
-    }
+    reset_weights(modality,supervoxel_labels(),nbr_class,value);
 }
 
 void SurfaceOfInterest::reduce_to_soi(const std::string& modality, double threshold, int cat){
 
-    for(const auto& w : _weights[modality]){
-        if(w.second[cat] < threshold)
-            remove(w.first);
+    const relevance_map_t& weights = _weights[modality];
+    for(size_t r = 0; r < weights.size(); r++){
+        if(weights(r,cat) < threshold)
+            remove(weights.label(r));
     }
 }
 
-bool SurfaceOfInterest::choice_of_soi(const std::string& modality, pcl::Supervoxel<PointT> &supervoxel, uint32_t &lbl){
+namespace {
+/**
+ * @brief uncertainty of a probability, 1 at 0.5 and 0 at 0 or 1
+ */
+double uncertainty(double p){
+    return p > 0.5 ? (1. - p)*2. : p*2.;
+}
+}
 
-    //*build the distribution from weights
-    std::map<float,uint32_t> soi_dist;
-    float val = 0.f;
-    float total_w = 0.f;
-    for(auto it = _weights[modality].begin(); it != _weights[modality].end(); it++)
-        total_w += it->second[1];
+void SurfaceOfInterest::weights_changed(const std::string& modality){
+    _weight_samplers.erase(modality);
+    for(auto it = _uncertainty_samplers.begin(); it != _uncertainty_samplers.end();){
+        if(it->first.first == modality)
+            it = _uncertainty_samplers.erase(it);
+        else it++;
+    }
+}
 
-    if(total_w == 0)
-        return false;
+WeightedSampler& SurfaceOfInterest::weight_sampler(const std::string& modality){
+    auto it = _weight_samplers.find(modality);
+    if(it != _weight_samplers.end())
+        return it->second;
+
+    const relevance_map_t& weights = _weights[modality];
+    std::vector<double> w(weights.size());
+    for(size_t r = 0; r < weights.size(); r++)
+        w[r] = weights(r,1);
+    WeightedSampler& sampler = _weight_samplers[modality];
+    sampler.build(w);
+    return sampler;
+}
 
+WeightedSampler& SurfaceOfInterest::uncertainty_sampler(const std::string& modality, int class_lbl){
+    std::pair<std::string,int> key(modality,class_lbl);
+    auto it = _uncertainty_samplers.find(key);
+    if(it != _uncertainty_samplers.end())
+        return it->second;
+
+    const relevance_map_t& weights = _weights[modality];
+    std::vector<double> w(weights.size());
+    for(size_t r = 0; r < weights.size(); r++)
+        w[r] = uncertainty(weights(r,class_lbl));
+    WeightedSampler& sampler = _uncertainty_samplers[key];
+    sampler.build(w);
+    return sampler;
+}
 
-    for(auto it = _weights[modality].begin(); it != _weights[modality].end(); it++){
-        val+=it->second[1]/(total_w/**_weights[modality].size()*/);
-        soi_dist.emplace(val,it->first);
+void SurfaceOfInterest::set_weight(const std::string& modality, uint32_t label, int class_lbl, double value){
+    relevance_map_t& weights = _weights[modality];
+    int r = weights.row(label);
+    if(r < 0){
+        std::cerr << "SurfaceOfInterest Error: no weights for supervoxel " << label << " in " << modality << std::endl;
+        return;
     }
-    //*/
+    weights(r,class_lbl) = value;
+    weight_updated(modality,r);
+}
 
+void SurfaceOfInterest::weight_updated(const std::string& modality, int r){
+    const relevance_map_t& weights = _weights[modality];
+    auto w_it = _weight_samplers.find(modality);
+    if(w_it != _weight_samplers.end())
+        w_it->second.set(r,weights(r,1));
+    for(auto u_it = _uncertainty_samplers.lower_bound(std::make_pair(modality,0));
+        u_it != _uncertainty_samplers.end() && u_it->first.first == modality; u_it++)
+        u_it->second.set(r,uncertainty(weights(r,u_it->first.second)));
+}
 
-    //*choice of a supervoxel
-    boost::random::uniform_real_distribution<> dist(0.,1.);
+void SurfaceOfInterest::near_samples(const std::string& modality, const std::vector<Eigen::VectorXd>& samples, double radius,
+                                     std::vector<uint32_t>& lbls) const {
+    lbls.clear();
+    int id = FeatureStore::modality_id(modality);
+    if(!_features.has(id))
+        return;
+    for(const Eigen::VectorXd& sample : samples){
+        if(sample.size() != _features.dimension(id)){
+            std::cerr << "SurfaceOfInterest Error: sample of dimension " << sample.size() << " for features of dimension "
+                      << _features.dimension(id) << std::endl;
+            return;
+        }
+    }
 
-    float choice = dist(_gen);
+    const std::vector<uint32_t>& labels = _features.labels();
+    std::vector<char> near(labels.size(),false);
+    double sq_radius = radius*radius;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,labels.size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            FeatureStore::const_row_t feature = _features.feature(id,i);
+            for(const Eigen::VectorXd& sample : samples){
+                if((feature - sample).squaredNorm() <= sq_radius){
+                    near[i] = true;
+                    break;
+                }
+            }
+        }
+    });
 
-    lbl = soi_dist.lower_bound(choice)->second;
+    for(size_t i = 0; i < labels.size(); i++)
+        if(near[i])
+            lbls.push_back(labels[i]);
+    std::sort(lbls.begin(),lbls.end());
+}
+
+bool SurfaceOfInterest::choice_of_soi(const std::string& modality, pcl::Supervoxel<PointT> &supervoxel, uint32_t &lbl){
+    int r = weight_sampler(modality).sample(_gen);
+    if(r < 0)
+        return false;
+
+    lbl = _weights[modality].label(r);
     assert(_supervoxels[lbl]);
     supervoxel = *(_supervoxels[lbl]);
-    //*/
 
     return true;
 }
 
 bool SurfaceOfInterest::choice_of_soi_by_uncertainty(const std::string& modality, pcl::Supervoxel<PointT> &supervoxel, uint32_t &lbl){
+    const WeightedSampler& sampler = uncertainty_sampler(modality,lbl);
 
-    //*build the distribution from weights
-    std::map<float,uint32_t> soi_dist;
-    float val = 0.f;
-
-    float total_w = 0.f;
-    for(auto it = _weights[modality].begin(); it != _weights[modality].end(); it++){
-        if(it->second[lbl] > 0.5)
-            total_w += (1.-it->second[lbl])*2.;
-        else
-            total_w += it->second[lbl]*2.;
-    }
+    std::cout << "global uncertainty : " << sampler.total() << std::endl;
 
-    std::cout << "global uncertainty : " << total_w << std::endl;
-
-    if(total_w == 0)
+    int r = sampler.sample(_gen);
+    if(r < 0)
         return false;
 
-    for(auto it = _weights[modality].begin(); it != _weights[modality].end(); it++){
-        if(it->second[lbl] > .5)
-            val+=(1.-it->second[lbl])*2./(total_w);
-        else val+=(it->second[lbl])*2./(total_w);
-        soi_dist.emplace(val,it->first);
-    }
-    //*/
-
-    //*choice of a supervoxel
-    boost::random::uniform_real_distribution<> dist(0.,1.);
-
-    float choice = dist(_gen);
-    lbl = soi_dist.lower_bound(choice)->second;
+    lbl = _weights[modality].label(r);
     supervoxel = *(_supervoxels[lbl]);
-    //*/
 
     return true;
 }
 
 
 void SurfaceOfInterest::delete_background(const PointCloudT::Ptr background){
-    pcl::KdTreeFLANN<PointT>::Ptr tree(new pcl::KdTreeFLANN<PointT>);
-    tree->setInputCloud(background);
-
-    std::vector<int> nn_indices(1);
-    std::vector<float> nn_distance(1);
-
-    PointCloudT filtered_cloud;
-
-    for(auto pt : _inputCloud->points){
-        if(!pcl::isFinite(pt))
-            continue;
-
-        if(!tree->nearestKSearch(pt,1,nn_indices,nn_distance))
-            continue;
-
-        if(nn_distance[0] > 0.0001)
-            filtered_cloud.points.push_back(pt);
-    }
+    BackgroundModel model;
+    model.add(*background);
+    delete_background(model);
+}
 
-    _inputCloud.reset(new PointCloudT(filtered_cloud));
+void SurfaceOfInterest::delete_background(const BackgroundModel& background){
+    PointCloudT::Ptr filtered_cloud(new PointCloudT);
+    background.filter(*_inputCloud,*filtered_cloud);
+    _inputCloud = filtered_cloud;
 }
 
 pcl::PointCloud<pcl::PointXYZI> SurfaceOfInterest::getColoredWeightedCloud(const std::string &modality,int lbl){
@@ -220,9 +248,10 @@ pcl::PointCloud<pcl::PointXYZI> SurfaceOfInterest::getColoredWeightedCloud(const
     pcl::PointCloud<pcl::PointXYZI> result;
     pcl::PointXYZI pt;
 
+    const relevance_map_t& weights = _weights[modality];
     for(auto it_sv = _supervoxels.begin(); it_sv != _supervoxels.end(); it_sv++){
         pcl::Supervoxel<PointT>::Ptr current_sv = it_sv->second;
-        float c = _weights[modality][it_sv->first][lbl];
+        float c = weights.weight(it_sv->first,lbl);
 
         for(auto v : *(current_sv->voxels_)){
             pt.x = v.x;
@@ -240,68 +269,69 @@ pcl::PointCloud<pcl::PointXYZI> SurfaceOfInterest::getColoredWeightedCloud(const
 std::map<pcl::Supervoxel<PointT>::Ptr, int> SurfaceOfInterest::get_supervoxels_clusters(const std::string &modality, double &saliency_threshold,int lbl){
     std::map<pcl::Supervoxel<PointT>::Ptr, int> sv_clusters;
 
-    int cluster_id = 0;
-
-    std::function<void (uint32_t, int)> _add_supervoxels_to_clusters = [&](uint32_t sv_label, int cluster_id) {
-      double weight = _weights[modality][sv_label][lbl];
-      pcl::Supervoxel<PointT>::Ptr sv = _supervoxels.find(sv_label)->second;
-      auto it = sv_clusters.find(sv);
-
-      if (weight > saliency_threshold && it == sv_clusters.end()) {
-          sv_clusters[sv] = cluster_id;
-
-          for (auto adj_it = _adjacency_map.equal_range(sv_label).first;
-               adj_it != _adjacency_map.equal_range(sv_label).second; adj_it++) {
-              _add_supervoxels_to_clusters(adj_it->second, cluster_id);
-          }
-      }
-
-    };
-
-    for (auto it = _supervoxels.begin(); it != _supervoxels.end(); it++){
-        _add_supervoxels_to_clusters(it->first, cluster_id);
-
-        cluster_id += 1;
+    //the id of a cluster is the index of its first supervoxel
+    ConnectedComponents regions;
+    extract_regions(modality,saliency_threshold,lbl,regions);
+    for (size_t c = 0; c < regions.size(); c++) {
+        int cluster_id = regions.first(c);
+        for (const uint32_t* l = regions.labels_begin(c); l != regions.labels_end(c); l++)
+            sv_clusters[_supervoxels.find(*l)->second] = cluster_id;
     }
 
     return sv_clusters;
 }
 
 void SurfaceOfInterest::neighbor_bluring(const std::string& modality, double cst,int lbl){
-    relevance_map_t weights = _weights[modality];
-    for(auto it_sv = _supervoxels.begin(); it_sv != _supervoxels.end(); it_sv++){
-        auto neighbors = _adjacency_map.equal_range(it_sv->first);
-        for(auto adj_it = neighbors.first; adj_it != neighbors.second; adj_it++){
-            if(_weights[modality][adj_it->second][lbl] >= 0.5)
-                weights[adj_it->first][lbl] += cst;
+    const FlatSupervoxelArray& svs = flat();
+    relevance_map_t& weights = _weights[modality];
+    _diffusion.init(svs,weights);
+    const RelevanceDiffusion::matrix_t& current = _diffusion.current();
+    _diffusion.sweep([&](size_t i, double* next){
+        for(int c = 0; c < current.cols(); c++)
+            next[c] = current(i,c);
+        for(const int* n = svs.neighbors_begin(i); n != svs.neighbors_end(i); n++){
+            if(_diffusion.has_weights(*n) && current(*n,lbl) >= 0.5)
+                next[lbl] += cst;
 //            else
-//                weights[adj_it->first][lbl] -= cst;
-            if(weights[adj_it->first][lbl] >= 1.)
-                weights[adj_it->first][lbl] = 1.;
-            else if(weights[adj_it->first][lbl] <= 0.)
-                weights[adj_it->first][lbl] = 0.;
+//                next[lbl] -= cst;
+            if(next[lbl] >= 1.)
+                next[lbl] = 1.;
+            else if(next[lbl] <= 0.)
+                next[lbl] = 0.;
         }
-    }
-    _weights[modality] = weights;
+    });
+    _diffusion.store(weights);
+    weights_changed(modality);
 }
 
 void SurfaceOfInterest::adaptive_threshold(const std::string& modality, int lbl){
-    relevance_map_t weights = _weights[modality];
-    for(auto it_sv = _supervoxels.begin(); it_sv != _supervoxels.end(); it_sv++){
-        auto neighbors = _adjacency_map.equal_range(it_sv->first);
-        double avg = _weights[modality][it_sv->first][lbl];
+    const FlatSupervoxelArray& svs = flat();
+    relevance_map_t& weights = _weights[modality];
+    _diffusion.init(svs,weights);
+    const RelevanceDiffusion::matrix_t& current = _diffusion.current();
+    _diffusion.sweep([&](size_t i, double* next){
+        for(int c = 0; c < current.cols(); c++)
+            next[c] = current(i,c);
+        double avg = current(i,lbl);
         double tot = 1;
-        for(auto adj_it = neighbors.first; adj_it != neighbors.second; adj_it++){
-            avg+=_weights[modality][adj_it->second][lbl];
+        for(const int* n = svs.neighbors_begin(i); n != svs.neighbors_end(i); n++){
+            if(_diffusion.has_weights(*n))
+                avg+=current(*n,lbl);
             tot+=1.;
         }
         avg = avg/tot;
-        if(avg >= 0.5 && _weights[modality][it_sv->first][lbl] >= avg)
-            weights[it_sv->first][lbl] = 1.;
-        else weights[it_sv->first][lbl] = 0.;
+        if(avg >= 0.5 && current(i,lbl) >= avg)
+            next[lbl] = 1.;
+        else next[lbl] = 0.;
+    });
+    _diffusion.store(weights);
+    weights_changed(modality);
+}
 
-    }
-    _weights[modality] = weights;
+int SurfaceOfInterest::diffuse(const std::string& modality, RelevanceDiffusion& diffusion){
+    int iterations = diffusion.run(flat(),_weights[modality]);
+    weights_changed(modality);
+    return iterations;
 }
 
 pcl::PointCloud<pcl::PointXYZI> SurfaceOfInterest::cumulative_relevance_map(std::vector<pcl::PointCloud<pcl::PointXYZI>> list_weights){
@@ -318,33 +348,35 @@ pcl::PointCloud<pcl::PointXYZI> SurfaceOfInterest::cumulative_relevance_map(std:
 }
 
 
-std::vector<std::set<uint32_t>> SurfaceOfInterest::extract_regions(const std::string &modality, double saliency_threshold,int class_lbl)
+void SurfaceOfInterest::salient_mask(const std::string &modality, double saliency_threshold, int class_lbl, std::vector<char>& mask)
 {
-    std::set<uint32_t> labels_set;
-    std::vector<std::set<uint32_t>> regions;
-
-    std::function<void (std::set<uint32_t>&, uint32_t)> _add_supervoxels_to_region = [&](std::set<uint32_t>& region, uint32_t sv_label) {
-        double weight = _weights[modality][sv_label][class_lbl];
-        auto it = find(labels_set.begin(), labels_set.end(), sv_label);
-        if (weight > saliency_threshold && it == labels_set.end()) {
-            labels_set.insert(sv_label);
-            region.insert(sv_label);
-
-            for (auto adj_it = _adjacency_map.equal_range(sv_label).first;
-                 adj_it != _adjacency_map.equal_range(sv_label).second; adj_it++) {
-                _add_supervoxels_to_region(region, adj_it->second);
-            }
+    const FlatSupervoxelArray& svs = flat();
+    const relevance_map_t& weights = _weights[modality];
+    mask.resize(svs.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0,svs.size()),
+                      [&](const tbb::blocked_range<size_t>& r){
+        for(size_t i = r.begin(); i != r.end(); ++i){
+            int row = weights.row(svs.label(i));
+            mask[i] = row >= 0 && class_lbl < weights.nbr_class() && weights(row,class_lbl) > saliency_threshold;
         }
-    };
+    });
+}
 
-    for (auto it = _supervoxels.begin(); it != _supervoxels.end(); it++){
-        std::set<uint32_t> region;
-        _add_supervoxels_to_region(region, it->first);
+void SurfaceOfInterest::extract_regions(const std::string &modality, double saliency_threshold, int class_lbl, ConnectedComponents& regions)
+{
+    std::vector<char> mask;
+    salient_mask(modality,saliency_threshold,class_lbl,mask);
+    regions.compute(flat(),mask);
+}
 
-        if (region.size() > 0) {
-            regions.push_back(region);
-        }
-    }
+std::vector<std::set<uint32_t>> SurfaceOfInterest::extract_regions(const std::string &modality, double saliency_threshold,int class_lbl)
+{
+    ConnectedComponents components;
+    extract_regions(modality,saliency_threshold,class_lbl,components);
+
+    std::vector<std::set<uint32_t>> regions(components.size());
+    for (size_t c = 0; c < components.size(); c++)
+        regions[c].insert(components.labels_begin(c),components.labels_end(c));
 
     return regions;
 }
@@ -378,8 +410,9 @@ std::set<uint32_t> SurfaceOfInterest::extract_background(const std::string &moda
 {
     std::set<uint32_t> background;
 
+    const relevance_map_t& weights = _weights[modality];
     for (auto it = _supervoxels.begin(); it != _supervoxels.end(); it++){
-        double weight = _weights[modality][it->first][class_lbl];
+        double weight = weights.weight(it->first,class_lbl);
         if (weight < saliency_threshold) {
             background.insert(it->first);
         }
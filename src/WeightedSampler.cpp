@@ -0,0 +1,72 @@
+#include <image_processing/WeightedSampler.h>
+#include <algorithm>
+
+using namespace image_processing;
+
+void WeightedSampler::build(const std::vector<double>& weights){
+    size_t n = weights.size();
+    _weights.resize(n);
+    _tree.assign(n + 1,0.);
+    _total = 0;
+    _updates = 0;
+    for(size_t i = 0; i < n; i++){
+        _weights[i] = std::max(weights[i],0.);
+        _total += _weights[i];
+        _tree[i + 1] += _weights[i];
+        //a node pushes its partial sum to its parent, linear construction
+        size_t parent = (i + 1) + ((i + 1) & -(i + 1));
+        if(parent <= n)
+            _tree[parent] += _tree[i + 1];
+    }
+}
+
+void WeightedSampler::clear(){
+    _weights.clear();
+    _tree.clear();
+    _total = 0;
+    _updates = 0;
+}
+
+void WeightedSampler::set(size_t i, double weight){
+    weight = std::max(weight,0.);
+    double delta = weight - _weights[i];
+    _weights[i] = weight;
+
+    //the sums drift with the updates, they are recomputed once every size() updates
+    if(++_updates >= _weights.size()){
+        std::vector<double> weights;
+        weights.swap(_weights);
+        build(weights);
+        return;
+    }
+
+    for(size_t k = i + 1; k < _tree.size(); k += k & -k)
+        _tree[k] += delta;
+    _total += delta;
+}
+
+int WeightedSampler::find(double u) const {
+    if(_total <= 0)
+        return -1;
+
+    size_t n = _weights.size();
+    size_t step = 1;
+    while(step*2 <= n)
+        step *= 2;
+
+    //descent of the tree to the last prefix whose sum is not above u
+    size_t pos = 0;
+    for(; step > 0; step /= 2){
+        if(pos + step <= n && _tree[pos + step] <= u){
+            pos += step;
+            u -= _tree[pos];
+        }
+    }
+
+    //rounding can push u past the last weight, or onto an empty index
+    if(pos >= n)
+        pos = n - 1;
+    while(pos > 0 && _weights[pos] <= 0)
+        pos--;
+    return pos;
+}
@@ -1,5 +1,10 @@
 #include <iostream>
 #include <functional>
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include <image_processing/tools.hpp>
 
 //using namespace image_processing;
@@ -92,15 +97,14 @@ void image_processing::tools::rgb2hsv (int r, int g, int b, float& fh, float& fs
 }
 
 void image_processing::tools::cloudRGB2HSV(const PointCloudT::Ptr input, PointCloudHSV::Ptr output){
-    float h, s, v;
-
-    for(auto itr = input->begin(); itr != input->end(); itr++){
-
-        rgb2hsv(itr->r,itr->g,itr->b,h,s,v);
-        output->push_back(PointHSV(h,s,v));
-        output->back().x = itr->x;
-        output->back().y = itr->y;
-        output->back().z = itr->z;
+    std::vector<float> hsv;
+    cloudRGB2HSV(*input,hsv);
+
+    for(size_t i = 0; i < input->size(); i++){
+        output->push_back(PointHSV(hsv[3*i],hsv[3*i+1],hsv[3*i+2]));
+        output->back().x = input->points[i].x;
+        output->back().y = input->points[i].y;
+        output->back().z = input->points[i].z;
     }
 
 }
@@ -198,3 +202,388 @@ void image_processing::tools::rgb2Lab(int r, int g, int b, float& L, float& a, f
     a = a/300.0f;
     b2 = b2/300.0f;
 }
+
+// Batch color conversions. The colors are processed by blocks : they are first gathered into planar arrays,
+// converted by a SIMD kernel (AVX2 or SSE when available, scalar otherwise) and then written back interleaved.
+
+namespace {
+
+const int color_block_size = 64;
+
+/* Lab */
+
+const int lab_lut_size = 4096;
+// X/Xn, Y/Yn and Z/Zn are in [0,2.55] for 8-bit colors
+const float lab_lut_range = 2.56f;
+const float lab_lut_scale = lab_lut_size / lab_lut_range;
+
+// coefficients of rgb2Lab with the white point and the scale of the table folded in
+const float lab_x[3] = {0.412453f / 95.047f * lab_lut_scale,
+                        0.357580f / 95.047f * lab_lut_scale,
+                        0.180423f / 95.047f * lab_lut_scale};
+const float lab_y[3] = {0.212671f / 100.0f * lab_lut_scale,
+                        0.715160f / 100.0f * lab_lut_scale,
+                        0.072169f / 100.0f * lab_lut_scale};
+const float lab_z[3] = {0.019334f / 108.883f * lab_lut_scale,
+                        0.119193f / 108.883f * lab_lut_scale,
+                        0.950227f / 108.883f * lab_lut_scale};
+
+/**
+ * @brief table of the function f of rgb2Lab sampled over [0,lab_lut_range].
+ * One extra entry so that the interpolation never reads past the end.
+ */
+const float* lab_lut(){
+    struct table {
+        table(){
+            for(int i = 0; i <= lab_lut_size + 1; i++){
+                float t = static_cast<float>(i) / lab_lut_scale;
+                values[i] = t > 0.008856f ? std::pow(t,0.3333f) : 7.787f*t + 0.138f;
+            }
+        }
+        float values[lab_lut_size + 2];
+    };
+    static const table lut;
+    return lut.values;
+}
+
+inline float lab_f(const float* lut, float pos){
+    int i = std::min(static_cast<int>(pos),lab_lut_size);
+    float w = pos - static_cast<float>(i);
+    return lut[i] + w*(lut[i+1] - lut[i]);
+}
+
+inline void lab_scalar(const float* lut, float r, float g, float b, float& L, float& a, float& b2){
+    float fx = lab_f(lut,r*lab_x[0] + g*lab_x[1] + b*lab_x[2]);
+    float fy = lab_f(lut,r*lab_y[0] + g*lab_y[1] + b*lab_y[2]);
+    float fz = lab_f(lut,r*lab_z[0] + g*lab_z[1] + b*lab_z[2]);
+
+    L = std::min(1.16f*fy - 0.16f,1.0f);
+    a = std::max(std::min(5.0f/3.0f*(fx - fy),1.0f),-1.0f);
+    b2 = std::max(std::min(2.0f/3.0f*(fy - fz),1.0f),-1.0f);
+}
+
+#if defined(__AVX2__)
+inline __m256 lab_f(const float* lut, __m256 pos){
+    __m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(pos),_mm256_set1_epi32(lab_lut_size));
+    __m256 w = _mm256_sub_ps(pos,_mm256_cvtepi32_ps(i));
+    __m256 lo = _mm256_i32gather_ps(lut,i,4);
+    __m256 hi = _mm256_i32gather_ps(lut + 1,i,4);
+    return _mm256_add_ps(lo,_mm256_mul_ps(w,_mm256_sub_ps(hi,lo)));
+}
+
+inline __m256 dot3(const float* c, __m256 r, __m256 g, __m256 b){
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r,_mm256_set1_ps(c[0])),
+                                       _mm256_mul_ps(g,_mm256_set1_ps(c[1]))),
+                         _mm256_mul_ps(b,_mm256_set1_ps(c[2])));
+}
+#elif defined(__SSE2__)
+inline __m128 lab_f(const float* lut, __m128 pos){
+    __m128i i = _mm_cvttps_epi32(pos);
+    __m128i too_big = _mm_cmpgt_epi32(i,_mm_set1_epi32(lab_lut_size));
+    i = _mm_or_si128(_mm_andnot_si128(too_big,i),_mm_and_si128(too_big,_mm_set1_epi32(lab_lut_size)));
+    __m128 w = _mm_sub_ps(pos,_mm_cvtepi32_ps(i));
+    alignas(16) int idx[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(idx),i);
+    __m128 lo = _mm_setr_ps(lut[idx[0]],lut[idx[1]],lut[idx[2]],lut[idx[3]]);
+    __m128 hi = _mm_setr_ps(lut[idx[0]+1],lut[idx[1]+1],lut[idx[2]+1],lut[idx[3]+1]);
+    return _mm_add_ps(lo,_mm_mul_ps(w,_mm_sub_ps(hi,lo)));
+}
+
+inline __m128 dot3(const float* c, __m128 r, __m128 g, __m128 b){
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(r,_mm_set1_ps(c[0])),
+                                 _mm_mul_ps(g,_mm_set1_ps(c[1]))),
+                      _mm_mul_ps(b,_mm_set1_ps(c[2])));
+}
+#endif
+
+/**
+ * @brief convert a block of planar colors. out is interleaved (L,a,b).
+ */
+void lab_block(const float* r, const float* g, const float* b, int n, float* out){
+    const float* lut = lab_lut();
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256 one = _mm256_set1_ps(1.0f), minus_one = _mm256_set1_ps(-1.0f);
+    alignas(32) float L[8], A[8], B[8];
+    for(; i + 8 <= n; i += 8){
+        __m256 vr = _mm256_loadu_ps(r + i), vg = _mm256_loadu_ps(g + i), vb = _mm256_loadu_ps(b + i);
+        __m256 fx = lab_f(lut,dot3(lab_x,vr,vg,vb));
+        __m256 fy = lab_f(lut,dot3(lab_y,vr,vg,vb));
+        __m256 fz = lab_f(lut,dot3(lab_z,vr,vg,vb));
+        _mm256_store_ps(L,_mm256_min_ps(_mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(1.16f),fy),
+                                                      _mm256_set1_ps(0.16f)),one));
+        _mm256_store_ps(A,_mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_set1_ps(5.0f/3.0f),
+                                                                    _mm256_sub_ps(fx,fy)),one),minus_one));
+        _mm256_store_ps(B,_mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f/3.0f),
+                                                                    _mm256_sub_ps(fy,fz)),one),minus_one));
+        for(int k = 0; k < 8; k++){
+            out[3*(i+k)] = L[k];
+            out[3*(i+k)+1] = A[k];
+            out[3*(i+k)+2] = B[k];
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128 one = _mm_set1_ps(1.0f), minus_one = _mm_set1_ps(-1.0f);
+    alignas(16) float L[4], A[4], B[4];
+    for(; i + 4 <= n; i += 4){
+        __m128 vr = _mm_loadu_ps(r + i), vg = _mm_loadu_ps(g + i), vb = _mm_loadu_ps(b + i);
+        __m128 fx = lab_f(lut,dot3(lab_x,vr,vg,vb));
+        __m128 fy = lab_f(lut,dot3(lab_y,vr,vg,vb));
+        __m128 fz = lab_f(lut,dot3(lab_z,vr,vg,vb));
+        _mm_store_ps(L,_mm_min_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.16f),fy),_mm_set1_ps(0.16f)),one));
+        _mm_store_ps(A,_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_set1_ps(5.0f/3.0f),_mm_sub_ps(fx,fy)),one),minus_one));
+        _mm_store_ps(B,_mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_set1_ps(2.0f/3.0f),_mm_sub_ps(fy,fz)),one),minus_one));
+        for(int k = 0; k < 4; k++){
+            out[3*(i+k)] = L[k];
+            out[3*(i+k)+1] = A[k];
+            out[3*(i+k)+2] = B[k];
+        }
+    }
+#endif
+    for(; i < n; i++)
+        lab_scalar(lut,r[i],g[i],b[i],out[3*i],out[3*i+1],out[3*i+2]);
+}
+
+/* HSV */
+
+// integer hsv conversion of rgb2hsv, 1/v and 1/diff in fixed point with a 12 bits shift
+const int hsv_div_table[] =
+{
+    0, 1044480, 522240, 348160, 261120, 208896, 174080, 149211,
+    130560, 116053, 104448, 94953, 87040, 80345, 74606, 69632,
+    65280, 61440, 58027, 54973, 52224, 49737, 47476, 45412,
+    43520, 41779, 40172, 38684, 37303, 36017, 34816, 33693,
+    32640, 31651, 30720, 29842, 29013, 28229, 27486, 26782,
+    26112, 25475, 24869, 24290, 23738, 23211, 22706, 22223,
+    21760, 21316, 20890, 20480, 20086, 19707, 19342, 18991,
+    18651, 18324, 18008, 17703, 17408, 17123, 16846, 16579,
+    16320, 16069, 15825, 15589, 15360, 15137, 14921, 14711,
+    14507, 14308, 14115, 13926, 13743, 13565, 13391, 13221,
+    13056, 12895, 12738, 12584, 12434, 12288, 12145, 12006,
+    11869, 11736, 11605, 11478, 11353, 11231, 11111, 10995,
+    10880, 10768, 10658, 10550, 10445, 10341, 10240, 10141,
+    10043, 9947, 9854, 9761, 9671, 9582, 9495, 9410,
+    9326, 9243, 9162, 9082, 9004, 8927, 8852, 8777,
+    8704, 8632, 8561, 8492, 8423, 8356, 8290, 8224,
+    8160, 8097, 8034, 7973, 7913, 7853, 7795, 7737,
+    7680, 7624, 7569, 7514, 7461, 7408, 7355, 7304,
+    7253, 7203, 7154, 7105, 7057, 7010, 6963, 6917,
+    6872, 6827, 6782, 6739, 6695, 6653, 6611, 6569,
+    6528, 6487, 6447, 6408, 6369, 6330, 6292, 6254,
+    6217, 6180, 6144, 6108, 6073, 6037, 6003, 5968,
+    5935, 5901, 5868, 5835, 5803, 5771, 5739, 5708,
+    5677, 5646, 5615, 5585, 5556, 5526, 5497, 5468,
+    5440, 5412, 5384, 5356, 5329, 5302, 5275, 5249,
+    5222, 5196, 5171, 5145, 5120, 5095, 5070, 5046,
+    5022, 4998, 4974, 4950, 4927, 4904, 4881, 4858,
+    4836, 4813, 4791, 4769, 4748, 4726, 4705, 4684,
+    4663, 4642, 4622, 4601, 4581, 4561, 4541, 4522,
+    4502, 4483, 4464, 4445, 4426, 4407, 4389, 4370,
+    4352, 4334, 4316, 4298, 4281, 4263, 4246, 4229,
+    4212, 4195, 4178, 4161, 4145, 4128, 4112, 4096
+};
+
+#if defined(__AVX2__)
+inline void hsv_simd(__m256i r, __m256i g, __m256i b, float* h_out, float* s_out, float* v_out){
+    __m256i v = _mm256_max_epi32(_mm256_max_epi32(b,g),r);
+    __m256i vmin = _mm256_min_epi32(_mm256_min_epi32(b,g),r);
+    __m256i diff = _mm256_sub_epi32(v,vmin);
+    __m256i vr = _mm256_cmpeq_epi32(v,r);
+    __m256i vg = _mm256_cmpeq_epi32(v,g);
+
+    __m256i s = _mm256_srai_epi32(_mm256_mullo_epi32(diff,_mm256_i32gather_epi32(hsv_div_table,v,4)),12);
+    __m256i h = _mm256_add_epi32(
+                _mm256_and_si256(vr,_mm256_sub_epi32(g,b)),
+                _mm256_andnot_si256(vr,_mm256_add_epi32(
+                    _mm256_and_si256(vg,_mm256_add_epi32(_mm256_sub_epi32(b,r),_mm256_slli_epi32(diff,1))),
+                    _mm256_andnot_si256(vg,_mm256_add_epi32(_mm256_sub_epi32(r,g),_mm256_slli_epi32(diff,2))))));
+    h = _mm256_mullo_epi32(_mm256_mullo_epi32(h,_mm256_i32gather_epi32(hsv_div_table,diff,4)),
+                           _mm256_set1_epi32(15));
+    h = _mm256_srai_epi32(_mm256_add_epi32(h,_mm256_set1_epi32(1 << 18)),19);
+    h = _mm256_add_epi32(h,_mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(),h),
+                                            _mm256_set1_epi32(180)));
+
+    _mm256_store_ps(h_out,_mm256_div_ps(_mm256_cvtepi32_ps(h),_mm256_set1_ps(180.0f)));
+    _mm256_store_ps(s_out,_mm256_div_ps(_mm256_cvtepi32_ps(s),_mm256_set1_ps(255.0f)));
+    _mm256_store_ps(v_out,_mm256_div_ps(_mm256_cvtepi32_ps(v),_mm256_set1_ps(255.0f)));
+}
+#elif defined(__SSE4_1__)
+inline __m128i hsv_div(__m128i i){
+    alignas(16) int idx[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(idx),i);
+    return _mm_setr_epi32(hsv_div_table[idx[0]],hsv_div_table[idx[1]],hsv_div_table[idx[2]],hsv_div_table[idx[3]]);
+}
+
+inline void hsv_simd(__m128i r, __m128i g, __m128i b, float* h_out, float* s_out, float* v_out){
+    __m128i v = _mm_max_epi32(_mm_max_epi32(b,g),r);
+    __m128i vmin = _mm_min_epi32(_mm_min_epi32(b,g),r);
+    __m128i diff = _mm_sub_epi32(v,vmin);
+    __m128i vr = _mm_cmpeq_epi32(v,r);
+    __m128i vg = _mm_cmpeq_epi32(v,g);
+
+    __m128i s = _mm_srai_epi32(_mm_mullo_epi32(diff,hsv_div(v)),12);
+    __m128i h = _mm_add_epi32(
+                _mm_and_si128(vr,_mm_sub_epi32(g,b)),
+                _mm_andnot_si128(vr,_mm_add_epi32(
+                    _mm_and_si128(vg,_mm_add_epi32(_mm_sub_epi32(b,r),_mm_slli_epi32(diff,1))),
+                    _mm_andnot_si128(vg,_mm_add_epi32(_mm_sub_epi32(r,g),_mm_slli_epi32(diff,2))))));
+    h = _mm_mullo_epi32(_mm_mullo_epi32(h,hsv_div(diff)),_mm_set1_epi32(15));
+    h = _mm_srai_epi32(_mm_add_epi32(h,_mm_set1_epi32(1 << 18)),19);
+    h = _mm_add_epi32(h,_mm_and_si128(_mm_cmplt_epi32(h,_mm_setzero_si128()),_mm_set1_epi32(180)));
+
+    _mm_store_ps(h_out,_mm_div_ps(_mm_cvtepi32_ps(h),_mm_set1_ps(180.0f)));
+    _mm_store_ps(s_out,_mm_div_ps(_mm_cvtepi32_ps(s),_mm_set1_ps(255.0f)));
+    _mm_store_ps(v_out,_mm_div_ps(_mm_cvtepi32_ps(v),_mm_set1_ps(255.0f)));
+}
+#endif
+
+/**
+ * @brief convert a block of planar colors. out is interleaved (h,s,v).
+ */
+void hsv_block(const int* r, const int* g, const int* b, int n, float* out){
+    int i = 0;
+#if defined(__AVX2__)
+    alignas(32) float H[8], S[8], V[8];
+    for(; i + 8 <= n; i += 8){
+        hsv_simd(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i)),
+                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(g + i)),
+                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)),H,S,V);
+        for(int k = 0; k < 8; k++){
+            out[3*(i+k)] = H[k];
+            out[3*(i+k)+1] = S[k];
+            out[3*(i+k)+2] = V[k];
+        }
+    }
+#elif defined(__SSE4_1__)
+    alignas(16) float H[4], S[4], V[4];
+    for(; i + 4 <= n; i += 4){
+        hsv_simd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i)),
+                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(g + i)),
+                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)),H,S,V);
+        for(int k = 0; k < 4; k++){
+            out[3*(i+k)] = H[k];
+            out[3*(i+k)+1] = S[k];
+            out[3*(i+k)+2] = V[k];
+        }
+    }
+#endif
+    for(; i < n; i++)
+        image_processing::tools::rgb2hsv(r[i],g[i],b[i],out[3*i],out[3*i+1],out[3*i+2]);
+}
+
+/**
+ * @brief gather the colors block by block in planar arrays and convert them.
+ * @param size number of colors
+ * @param color function giving the (r,g,b) of the i-th color
+ * @param convert block conversion (lab_block or hsv_block)
+ * @param out interleaved output
+ */
+template <typename T, typename Color, typename Convert>
+void convert_by_blocks(size_t size, Color color, Convert convert, float* out){
+    T r[color_block_size], g[color_block_size], b[color_block_size];
+    for(size_t start = 0; start < size; start += color_block_size){
+        int n = std::min<size_t>(color_block_size,size - start);
+        for(int k = 0; k < n; k++)
+            color(start + k,r[k],g[k],b[k]);
+        convert(r,g,b,n,out + 3*start);
+    }
+}
+
+template <typename T>
+struct buffer_color {
+    const uint8_t* rgb;
+    void operator()(size_t i, T& r, T& g, T& b) const {
+        r = rgb[3*i]; g = rgb[3*i+1]; b = rgb[3*i+2];
+    }
+};
+
+template <typename T>
+struct point_color {
+    const image_processing::PointT* points;
+    void operator()(size_t i, T& r, T& g, T& b) const {
+        r = points[i].r; g = points[i].g; b = points[i].b;
+    }
+};
+
+}//anonymous
+
+void image_processing::tools::rgb2Lab(const uint8_t* rgb, size_t size, float* Lab){
+    convert_by_blocks<float>(size,buffer_color<float>{rgb},lab_block,Lab);
+}
+
+void image_processing::tools::rgb2Lab(const PointT* points, size_t size, float* Lab){
+    convert_by_blocks<float>(size,point_color<float>{points},lab_block,Lab);
+}
+
+void image_processing::tools::cloudRGB2Lab(const PointCloudT& cloud, std::vector<float>& Lab){
+    Lab.resize(3*cloud.size());
+    rgb2Lab(cloud.points.data(),cloud.size(),Lab.data());
+}
+
+void image_processing::tools::rgb2hsv(const uint8_t* rgb, size_t size, float* hsv){
+    convert_by_blocks<int>(size,buffer_color<int>{rgb},hsv_block,hsv);
+}
+
+void image_processing::tools::rgb2hsv(const PointT* points, size_t size, float* hsv){
+    convert_by_blocks<int>(size,point_color<int>{points},hsv_block,hsv);
+}
+
+void image_processing::tools::cloudRGB2HSV(const PointCloudT& cloud, std::vector<float>& hsv){
+    hsv.resize(3*cloud.size());
+    rgb2hsv(cloud.points.data(),cloud.size(),hsv.data());
+}
+
+void image_processing::tools::bin_values(const double* values, size_t size, double lower, double width, int bins, int* out){
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256d sign = _mm256_set1_pd(-0.0), max_val = _mm256_set1_pd(10e3), min_val = _mm256_set1_pd(10e-4);
+    const __m256d lo = _mm256_set1_pd(lower), w = _mm256_set1_pd(width);
+    const __m256d nb = _mm256_set1_pd(bins), one = _mm256_set1_pd(1.), minus_one = _mm256_set1_pd(-1.);
+    const __m128i nbi = _mm_set1_epi32(bins), none = _mm_set1_epi32(-1);
+    for(; i + 4 <= size; i += 4){
+        __m256d v = _mm256_loadu_pd(values + i);
+        __m256d a = _mm256_andnot_pd(sign,v);
+        __m256d valid = _mm256_cmp_pd(a,max_val,_CMP_LE_OQ);
+        v = _mm256_andnot_pd(_mm256_cmp_pd(a,min_val,_CMP_LE_OQ),v);
+        __m256d b = _mm256_div_pd(_mm256_sub_pd(v,lo),w);
+        b = _mm256_sub_pd(b,_mm256_and_pd(_mm256_cmp_pd(b,nb,_CMP_GE_OQ),one));
+        b = _mm256_blendv_pd(minus_one,b,valid);
+        __m128i n = _mm256_cvttpd_epi32(b);
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi32(n,none),_mm_cmplt_epi32(n,nbi));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                         _mm_or_si128(_mm_and_si128(in,n),_mm_andnot_si128(in,none)));
+    }
+#elif defined(__SSE2__)
+    const __m128d sign = _mm_set1_pd(-0.0), max_val = _mm_set1_pd(10e3), min_val = _mm_set1_pd(10e-4);
+    const __m128d lo = _mm_set1_pd(lower), w = _mm_set1_pd(width);
+    const __m128d nb = _mm_set1_pd(bins), one = _mm_set1_pd(1.), minus_one = _mm_set1_pd(-1.);
+    const __m128i nbi = _mm_set1_epi32(bins), none = _mm_set1_epi32(-1);
+    for(; i + 2 <= size; i += 2){
+        __m128d v = _mm_loadu_pd(values + i);
+        __m128d a = _mm_andnot_pd(sign,v);
+        __m128d valid = _mm_cmple_pd(a,max_val);
+        v = _mm_andnot_pd(_mm_cmple_pd(a,min_val),v);
+        __m128d b = _mm_div_pd(_mm_sub_pd(v,lo),w);
+        b = _mm_sub_pd(b,_mm_and_pd(_mm_cmpge_pd(b,nb),one));
+        b = _mm_or_pd(_mm_and_pd(valid,b),_mm_andnot_pd(valid,minus_one));
+        __m128i n = _mm_cvttpd_epi32(b);
+        __m128i in = _mm_and_si128(_mm_cmpgt_epi32(n,none),_mm_cmplt_epi32(n,nbi));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i),
+                         _mm_or_si128(_mm_and_si128(in,n),_mm_andnot_si128(in,none)));
+    }
+#endif
+    for(; i < size; i++){
+        double val = values[i];
+        if(val != val || (std::fabs(val) > 10e3)){
+            out[i] = -1;
+            continue;
+        }
+        if(std::fabs(val) <= 10e-4)
+            val = 0;
+
+        double b = (val - lower)/width;
+        if(b >= bins) b -= 1;
+        int n = std::trunc(b);
+        out[i] = n >= 0 && n < bins ? n : -1;
+    }
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <chrono>
+
+#include <pcl/io/pcd_io.h>
+#include <tbb/tbb.h>
+
+#include "../include/image_processing/ParallelSupervoxelClustering.h"
+#include "../include/image_processing/default_parameters.hpp"
+
+namespace ip = image_processing;
+typedef ip::parameters::supervoxel param;
+
+/**
+ * Timing of the supervoxel clustering of a pcd file :
+ * pcl::SupervoxelClustering once as a reference, then ParallelSupervoxelClustering from 1 to N threads.
+ */
+int main(int argc, char **argv) {
+
+    if (argc < 2) {
+        std::cerr << "Usage : \n\t- pcd file (e.g. data/cloud.pcd)\n\t- number of repetitions (optional, default 5)"
+                  << std::endl;
+        return 1;
+    }
+
+    int nbr_rep = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    ip::PointCloudT::Ptr input_cloud(new ip::PointCloudT);
+    if(pcl::io::loadPCDFile(argv[1], *input_cloud) < 0){
+        std::cerr << "Unable to load " << argv[1] << std::endl;
+        return 1;
+    }
+    std::cout << "pcd file loaded : " << input_cloud->size() << " points" << std::endl;
+
+    typedef std::chrono::high_resolution_clock bench_clock;
+    auto elapsed_ms = [](bench_clock::time_point start) -> double {
+        return std::chrono::duration<double,std::milli>(bench_clock::now() - start).count();
+    };
+
+    ip::SupervoxelArray supervoxels;
+
+    pcl::SupervoxelClustering<ip::PointT> pcl_extractor(param::voxel_resolution,param::seed_resolution);
+    pcl_extractor.setColorImportance(param::color_importance);
+    pcl_extractor.setSpatialImportance(param::spatial_importance);
+    pcl_extractor.setNormalImportance(param::normal_importance);
+    pcl_extractor.setInputCloud(input_cloud);
+    auto start = bench_clock::now();
+    for(int i = 0; i < nbr_rep; i++)
+        pcl_extractor.extract(supervoxels);
+    double pcl_time = elapsed_ms(start)/nbr_rep;
+    std::cout << "pcl::SupervoxelClustering : " << pcl_time << " ms, "
+              << supervoxels.size() << " supervoxels" << std::endl;
+
+    ip::ParallelSupervoxelClustering extractor(param::voxel_resolution,param::seed_resolution);
+    extractor.setColorImportance(param::color_importance);
+    extractor.setSpatialImportance(param::spatial_importance);
+    extractor.setNormalImportance(param::normal_importance);
+    extractor.setInputCloud(input_cloud);
+
+    int max_threads = tbb::this_task_arena::max_concurrency();
+    double single_time = 0;
+    std::cout << "threads\ttime (ms)\tspeedup\tvs pcl\tsupervoxels" << std::endl;
+    for(int nbr_threads = 1; nbr_threads <= max_threads; nbr_threads++){
+        tbb::task_arena arena(nbr_threads);
+        double time = 0;
+        arena.execute([&]{
+            extractor.extract(supervoxels); //warm up
+            auto start = bench_clock::now();
+            for(int i = 0; i < nbr_rep; i++)
+                extractor.extract(supervoxels);
+            time = elapsed_ms(start)/nbr_rep;
+        });
+        if(nbr_threads == 1)
+            single_time = time;
+        std::cout << nbr_threads << "\t" << time << "\t" << single_time/time << "\t"
+                  << pcl_time/time << "\t" << supervoxels.size() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,714 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <queue>
+#include <map>
+
+#include <boost/random.hpp>
+
+#include "../include/image_processing/WeightedSampler.h"
+#include "../include/image_processing/HistogramDistance.hpp"
+#include "../include/image_processing/ConnectedComponents.h"
+#include "../include/image_processing/tools.hpp"
+#include "../include/image_processing/SurfaceOfInterest.h"
+#include "../include/image_processing/BackgroundModel.h"
+
+namespace ip = image_processing;
+
+/**
+ * Checks of the self-contained algorithms of the library against naive references.
+ * No data is needed, the program returns 1 if a check fails.
+ */
+
+namespace {
+
+bool check(bool ok, const std::string& what){
+    std::cout << (ok ? "[ok] " : "[FAILED] ") << what << std::endl;
+    return ok;
+}
+
+bool test_weighted_sampler(){
+    boost::random::mt19937 gen(0);
+    boost::random::uniform_real_distribution<> dist(0.,1.);
+    bool ok = true;
+    for(int n : {1,2,3,7,8,9,100,1000}){
+        std::vector<double> weights(n);
+        for(int i = 0; i < n; i++)
+            weights[i] = i % 3 == 0 ? 0. : dist(gen);
+        weights[n - 1] = 1.;
+
+        ip::WeightedSampler sampler;
+        sampler.build(weights);
+
+        //more updates than the size to go through the periodic rebuild
+        for(int k = 0; k < 3*n; k++){
+            int i = gen() % n;
+            weights[i] = gen() % 4 == 0 ? 0. : dist(gen);
+            sampler.set(i,weights[i]);
+        }
+
+        double total = 0;
+        for(const double& w : weights)
+            total += w;
+        bool same = std::fabs(total - sampler.total()) < 1e-9;
+
+        //linear CDF : the index i covers [cdf[i],cdf[i+1])
+        std::vector<double> cdf(n + 1,0.);
+        for(int i = 0; i < n; i++)
+            cdf[i + 1] = cdf[i] + weights[i];
+        for(int i = 0; i < n; i++)
+            if(weights[i] > 0)
+                same = same && sampler.find((cdf[i] + cdf[i + 1])/2.) == i;
+        for(int k = 0; k < 1000; k++){
+            double u = dist(gen)*total;
+            int i = sampler.find(u);
+            //up to the rounding of the sums
+            same = same && weights[i] > 0 && cdf[i] - 1e-9 <= u && u < cdf[i + 1] + 1e-9;
+        }
+        ok = check(same,"WeightedSampler::find against a linear scan of the CDF, n = " + std::to_string(n)) && ok;
+    }
+
+    ip::WeightedSampler empty;
+    empty.build(std::vector<double>(5,0.));
+    ok = check(empty.sample(gen) == -1,"WeightedSampler with a null total") && ok;
+    return ok;
+}
+
+bool test_histogram_distance_nan(){
+    //a NaN bin must give a NaN distance wherever it falls (vector lanes or scalar tail)
+    bool ok = true;
+    for(int size : {4,5,7,9}){
+        bool nan = true;
+        for(int k = 0; k < size; k++){
+            std::vector<double> hist1(size,0.1), hist2(size,0.2);
+            hist1[k] = std::numeric_limits<double>::quiet_NaN();
+            nan = nan && std::isnan(ip::HistogramDistance::compute(ip::HistogramDistance::CHI_SQUARED,
+                                                                   hist1.data(),hist2.data(),size));
+        }
+        ok = check(nan,"chi squared distance of histograms with a NaN bin, size = " + std::to_string(size)) && ok;
+    }
+    return ok;
+}
+
+bool test_connected_components(){
+    boost::random::mt19937 gen(1);
+    bool ok = true;
+    for(int n : {1,10,100,2000}){
+        //supervoxels of one voxel with labels leaving gaps, random symmetric adjacency and random mask
+        ip::SupervoxelArray supervoxels;
+        for(int i = 0; i < n; i++){
+            pcl::Supervoxel<ip::PointT>::Ptr sv(new pcl::Supervoxel<ip::PointT>);
+            ip::PointT pt;
+            pt.x = i; pt.y = pt.z = 0;
+            sv->voxels_->push_back(pt);
+            sv->centroid_ = pt;
+            supervoxels[3*i + 1] = sv;
+        }
+        ip::AdjacencyMap adjacency;
+        for(int k = 0; k < n; k++){
+            uint32_t a = 3*(gen() % n) + 1, b = 3*(gen() % n) + 1;
+            if(a == b)
+                continue;
+            adjacency.insert(std::make_pair(a,b));
+            adjacency.insert(std::make_pair(b,a));
+        }
+        ip::FlatSupervoxelArray svs;
+        svs.build(supervoxels,adjacency);
+        std::vector<char> mask(n);
+        for(int i = 0; i < n; i++)
+            mask[i] = gen() % 4 != 0;
+
+        ip::ConnectedComponents components;
+        components.compute(svs,mask);
+
+        //sequential BFS from the supervoxels by increasing index, which numbers the components the same way
+        std::vector<int> reference(n,-1);
+        std::vector<std::vector<int>> members;
+        for(int i = 0; i < n; i++){
+            if(!mask[i] || reference[i] >= 0)
+                continue;
+            members.push_back(std::vector<int>());
+            std::queue<int> queue;
+            queue.push(i);
+            reference[i] = members.size() - 1;
+            while(!queue.empty()){
+                int j = queue.front();
+                queue.pop();
+                members.back().push_back(j);
+                for(const int* nb = svs.neighbors_begin(j); nb != svs.neighbors_end(j); nb++){
+                    if(mask[*nb] && reference[*nb] < 0){
+                        reference[*nb] = reference[i];
+                        queue.push(*nb);
+                    }
+                }
+            }
+            std::sort(members.back().begin(),members.back().end());
+        }
+
+        bool same = components.size() == members.size() && components.components() == reference;
+        for(size_t c = 0; same && c < members.size(); c++){
+            std::vector<uint32_t> labels;
+            for(const int& i : members[c])
+                labels.push_back(svs.label(i));
+            same = std::vector<int>(components.members_begin(c),components.members_end(c)) == members[c] &&
+                    std::vector<uint32_t>(components.labels_begin(c),components.labels_end(c)) == labels;
+        }
+        ok = check(same,"ConnectedComponents against a sequential BFS, n = " + std::to_string(n)) && ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief bin of a value computed with the division by the bin width
+ */
+int division_bin(double val, double lower, double upper, int bins){
+    if(val != val || std::fabs(val) > 10e3)
+        return -1;
+    if(std::fabs(val) <= 10e-4)
+        val = 0;
+    double b = (val - lower)/((upper - lower)/bins);
+    if(b >= bins) b -= 1;
+    int n = std::trunc(b);
+    return n >= 0 && n < bins ? n : -1;
+}
+
+bool test_bin_values(){
+    //the normalized colors, which fall on the bounds of the bins, random values in and out of the bounds
+    //and the special values. The double values on the bounds are added for each histogram.
+    std::vector<double> values;
+    for(int k = 0; k <= 180; k++)
+        values.push_back(k/180.f);
+    for(int k = 0; k <= 255; k++)
+        values.push_back(k/255.f);
+    boost::random::mt19937 gen(2);
+    boost::random::uniform_real_distribution<> dist(-1.2,1.2);
+    for(int k = 0; k < 100000; k++)
+        values.push_back((float)dist(gen));
+    values.push_back(std::numeric_limits<double>::quiet_NaN());
+    values.push_back(1e5);
+    values.push_back(-1e-4);
+
+    bool ok = true;
+    for(int bins : {2,3,5,10}){
+        for(double lower : {0.,-1.}){
+            //double values on the bounds of the bins and one ulp around them (e.g. 0.6 for 5 bins on [0,1])
+            std::vector<double> all(values);
+            double width = (1. - lower)/bins;
+            for(int k = 0; k <= bins; k++){
+                for(double bound : {lower + k*width, k/(double)bins*(1. - lower) + lower, lower + k*(1. - lower)/bins}){
+                    all.push_back(bound);
+                    all.push_back(std::nextafter(bound,-2.));
+                    all.push_back(std::nextafter(bound,2.));
+                }
+            }
+            for(double val : {0.3,0.6,0.7,0.9})
+                all.push_back(val);
+
+            std::vector<int> out(all.size());
+            ip::tools::bin_values(all.data(),all.size(),lower,width,bins,out.data());
+            bool same = true;
+            for(size_t i = 0; i < all.size(); i++)
+                same = same && out[i] == division_bin(all[i],lower,1.,bins);
+            ok = check(same,"tools::bin_values against the division by the bin width, bins = " + std::to_string(bins) +
+                       ", lower = " + std::to_string((int)lower)) && ok;
+        }
+    }
+    return ok;
+}
+
+bool test_color_conversions(){
+    //all the 8-bit colors, by chunks of a size which is not a multiple of the vector width to go through the tails
+    const size_t chunk = 4093, nbr_colors = 1 << 24;
+    std::vector<uint8_t> rgb(3*chunk);
+    std::vector<float> hsv(3*chunk), Lab(3*chunk);
+    bool same_hsv = true, close_Lab = true;
+    for(size_t first = 0; first < nbr_colors; first += chunk){
+        size_t n = std::min(chunk,nbr_colors - first);
+        for(size_t i = 0; i < n; i++){
+            rgb[3*i] = (first + i) >> 16;
+            rgb[3*i + 1] = (first + i) >> 8;
+            rgb[3*i + 2] = first + i;
+        }
+        ip::tools::rgb2hsv(rgb.data(),n,hsv.data());
+        ip::tools::rgb2Lab(rgb.data(),n,Lab.data());
+        for(size_t i = 0; i < n; i++){
+            float ref[3];
+            ip::tools::rgb2hsv(rgb[3*i],rgb[3*i + 1],rgb[3*i + 2],ref[0],ref[1],ref[2]);
+            for(int c = 0; c < 3; c++)
+                same_hsv = same_hsv && (hsv[3*i + c] == ref[c] || (ref[c] != ref[c] && hsv[3*i + c] != hsv[3*i + c]));
+            ip::tools::rgb2Lab(rgb[3*i],rgb[3*i + 1],rgb[3*i + 2],ref[0],ref[1],ref[2]);
+            for(int c = 0; c < 3; c++)
+                close_Lab = close_Lab && std::fabs(Lab[3*i + c] - ref[c]) <= ip::tools::lab_batch_tolerance;
+        }
+    }
+    bool ok = check(same_hsv,"batch tools::rgb2hsv equal to the scalar one on all the colors");
+    return check(close_Lab,"batch tools::rgb2Lab within lab_batch_tolerance of the scalar one on all the colors") && ok;
+}
+
+bool test_background_model(){
+    boost::random::mt19937 gen(7);
+    const float res = 0.01f;
+    bool ok = true;
+    for(int config = 0; config < 2; config++){
+        ip::PointCloudT background, input;
+        auto point = [](float x, float y, float z) -> ip::PointT {
+            ip::PointT pt;
+            pt.x = x; pt.y = y; pt.z = z;
+            return pt;
+        };
+        if(config == 0){
+            //random clouds in a 10cm cube, some points not finite
+            boost::random::uniform_real_distribution<float> dist(-0.05f,0.05f);
+            for(int k = 0; k < 300; k++)
+                background.push_back(point(dist(gen),dist(gen),dist(gen)));
+            for(int k = 0; k < 20000; k++)
+                input.push_back(point(dist(gen),dist(gen),dist(gen)));
+            input.push_back(point(std::numeric_limits<float>::quiet_NaN(),0,0));
+        }
+        else{
+            //pairs straddling the cell borders (and corners) at about the threshold
+            boost::random::uniform_real_distribution<float> offset(0.f,0.1f*res), direction(-1.f,1.f);
+            boost::random::uniform_int_distribution<int> cell(-20,20);
+            for(int k = 0; k < 5000; k++){
+                Eigen::Vector3f border(cell(gen)*res,cell(gen)*res,cell(gen)*res);
+                Eigen::Vector3f b = border - Eigen::Vector3f(offset(gen),offset(gen),offset(gen));
+                Eigen::Vector3f u(std::fabs(direction(gen)),std::fabs(direction(gen)),std::fabs(direction(gen)));
+                if(k % 3 == 0) u(1) = u(2) = 0;
+                u.normalize();
+                background.push_back(point(b(0),b(1),b(2)));
+                for(float d : {0.5f,0.999f,1.f,1.001f,1.5f}){
+                    Eigen::Vector3f p = b + d*res*u;
+                    input.push_back(point(p(0),p(1),p(2)));
+                }
+            }
+        }
+
+        ip::BackgroundModel model(res);
+        model.add(background);
+        ip::PointCloudT output;
+        model.filter(input,output);
+
+        //brute force nearest background point, with the squared distances of the model
+        std::vector<float> reference;
+        for(const ip::PointT& pt : input){
+            if(!pcl::isFinite(pt))
+                continue;
+            Eigen::Vector3f p(pt.x,pt.y,pt.z);
+            bool near = false;
+            for(const ip::PointT& b : background)
+                near = near || (Eigen::Vector3f(b.x,b.y,b.z) - p).squaredNorm() <= res*res;
+            if(!near)
+                reference.push_back(pt.x);
+        }
+        bool same = output.size() == reference.size();
+        for(size_t i = 0; same && i < output.size(); i++)
+            same = output.points[i].x == reference[i];
+        ok = check(same,std::string("BackgroundModel::filter against a brute force search, ") +
+                   (config == 0 ? "random clouds" : "points across the cell borders") +
+                   ", " + std::to_string(output.size()) + " points kept out of " + std::to_string(input.size())) && ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief toy mixture classifier with kernels of compact support : a component only changes the estimations
+ * of the features closer than its width
+ */
+struct toy_classifier {
+    struct component {
+        Eigen::VectorXd mean;
+        int class_lbl;
+    };
+
+    int get_nbr_class() const {return 2;}
+
+    std::vector<double> compute_estimation(const Eigen::VectorXd& sample) const {
+        //prior of 0.1 for each class
+        double mass[2] = {0.1,0.1};
+        for(const component& c : components)
+            mass[c.class_lbl] += std::max(0.,1. - (sample - c.mean).squaredNorm()/(width*width));
+        return {mass[0]/(mass[0] + mass[1]),mass[1]/(mass[0] + mass[1])};
+    }
+
+    /**
+     * @brief one component per sample
+     */
+    void fit_batch(const std::vector<Eigen::VectorXd>& samples, const std::vector<int>& labels){
+        for(size_t i = 0; i < samples.size(); i++)
+            components.push_back({samples[i],labels[i]});
+    }
+
+    std::vector<component> components;
+    double width = 0.1;
+};
+
+/**
+ * @brief the toy classifier with a batch estimation, which gives rows samples.rows() - missing_rows
+ */
+struct batch_toy_classifier : public toy_classifier {
+    void compute_estimation_batch(const Eigen::MatrixXd& samples, Eigen::MatrixXd& estimations) const {
+        estimations.resize(std::max<int>(0,samples.rows() - missing_rows),get_nbr_class());
+        for(int i = 0; i < estimations.rows(); i++){
+            std::vector<double> estimation = compute_estimation(samples.row(i).transpose());
+            for(int c = 0; c < estimations.cols(); c++)
+                estimations(i,c) = estimation[c];
+        }
+    }
+
+    int missing_rows = 0;
+};
+
+/**
+ * @brief a batch estimation which is not const is not detected
+ */
+struct non_const_batch_classifier : public toy_classifier {
+    void compute_estimation_batch(const Eigen::MatrixXd& samples, Eigen::MatrixXd& estimations){}
+};
+
+static_assert(!ip::has_compute_estimation_batch<toy_classifier>::value,"toy_classifier has no batch estimation");
+static_assert(ip::has_compute_estimation_batch<batch_toy_classifier>::value,"batch_toy_classifier has a batch estimation");
+static_assert(!ip::has_compute_estimation_batch<non_const_batch_classifier>::value,
+              "the batch estimation of non_const_batch_classifier is not const");
+
+/**
+ * @brief surface of n supervoxels of one voxel, labels leaving gaps, with random features of dimension 2 in [0,1]
+ * for a modality. The adjacency links each supervoxel to the next one.
+ */
+void toy_surface(int n, const std::string& modality, boost::random::mt19937& gen, ip::SurfaceOfInterest& soi){
+    boost::random::uniform_real_distribution<> dist(0.,1.);
+    for(int i = 0; i < n; i++){
+        pcl::Supervoxel<ip::PointT>::Ptr sv(new pcl::Supervoxel<ip::PointT>);
+        ip::PointT pt;
+        pt.x = i; pt.y = pt.z = 0;
+        sv->voxels_->push_back(pt);
+        sv->centroid_ = pt;
+        std::vector<uint32_t> neighbors;
+        if(i > 0) neighbors.push_back(3*i - 2);
+        if(i < n - 1) neighbors.push_back(3*i + 4);
+        soi.insert(3*i + 1,sv,neighbors);
+        Eigen::VectorXd feature(2);
+        feature << dist(gen), dist(gen);
+        soi.set_feature(modality,3*i + 1,feature);
+    }
+}
+
+double max_difference(const ip::RelevanceMap& a, const ip::RelevanceMap& b){
+    if(a.labels() != b.labels() || a.nbr_class() != b.nbr_class())
+        return std::numeric_limits<double>::infinity();
+    return a.empty() ? 0. : (a.matrix() - b.matrix()).cwiseAbs().maxCoeff();
+}
+
+bool test_update_weights(){
+    //the same surface twice, one updated and one computed in full
+    const std::string modality = "toy";
+    ip::SurfaceOfInterest soi, full;
+    boost::random::mt19937 gen(3);
+    toy_surface(500,modality,gen,soi);
+    gen.seed(3);
+    toy_surface(500,modality,gen,full);
+    boost::random::uniform_real_distribution<> dist(0.,1.);
+
+    toy_classifier classifier;
+    std::vector<Eigen::VectorXd> samples;
+    std::vector<int> labels;
+    for(int k = 0; k < 20; k++){
+        samples.push_back(Eigen::Vector2d(dist(gen),dist(gen)));
+        labels.push_back(k % 2);
+    }
+    classifier.fit_batch(samples,labels);
+    soi.compute_weights(modality,classifier);
+
+    //new components : only the supervoxels within their width change, re-scoring them gives the full computation
+    samples.clear();
+    labels.clear();
+    for(int k = 0; k < 5; k++){
+        samples.push_back(Eigen::Vector2d(dist(gen),dist(gen)));
+        labels.push_back(1);
+    }
+    classifier.fit_batch(samples,labels);
+    size_t n = soi.update_weights(modality,classifier,samples,classifier.width);
+    full.compute_weights(modality,classifier);
+    bool ok = check(n > 0 && n < 500 && max_difference(soi.get_weights().at(modality),full.get_weights().at(modality)) == 0.,
+                    "SurfaceOfInterest::update_weights against compute_weights, " + std::to_string(n) +
+                    " supervoxels re-scored");
+    ok = check(soi.weights_drift(modality,classifier) == 0.,"SurfaceOfInterest::weights_drift without drift") && ok;
+
+    //a component moved far from the samples of the fit : the radius misses the supervoxels it covered
+    //and the drift shows it
+    classifier.components[0].mean = Eigen::Vector2d(dist(gen),dist(gen));
+    soi.update_weights(modality,classifier,samples,classifier.width);
+    double drift = soi.weights_drift(modality,classifier);
+    bool stale = max_difference(soi.get_weights().at(modality),full.get_weights().at(modality)) > 0;
+    full.compute_weights(modality,classifier);
+    double expected = max_difference(soi.get_weights().at(modality),full.get_weights().at(modality));
+    ok = check(stale && drift > 0 && drift == expected,
+               "SurfaceOfInterest::weights_drift of the weights kept by update_weights, " + std::to_string(drift)) && ok;
+    return ok;
+}
+
+bool test_batch_estimation(){
+    const std::string modality = "toy";
+    ip::SurfaceOfInterest batch, per_sample;
+    boost::random::mt19937 gen(6);
+    toy_surface(300,modality,gen,batch);
+    gen.seed(6);
+    toy_surface(300,modality,gen,per_sample);
+    //a supervoxel without features keeps the default weights in both paths
+    pcl::Supervoxel<ip::PointT>::Ptr sv(new pcl::Supervoxel<ip::PointT>);
+    batch.insert(1000,sv,std::vector<uint32_t>());
+    per_sample.insert(1000,sv,std::vector<uint32_t>());
+
+    batch_toy_classifier classifier;
+    boost::random::uniform_real_distribution<> dist(0.,1.);
+    for(int k = 0; k < 30; k++)
+        classifier.components.push_back({Eigen::Vector2d(dist(gen),dist(gen)),k % 2});
+
+    bool ok = batch.compute_weights(modality,classifier) &&
+            per_sample.compute_weights(modality,static_cast<const toy_classifier&>(classifier));
+    ok = check(ok && max_difference(batch.get_weights().at(modality),per_sample.get_weights().at(modality)) == 0.,
+               "compute_weights gives the same weights with the batch and the per sample estimations");
+
+    classifier.missing_rows = 1;
+    ok = check(!batch.compute_weights(modality,classifier) && batch.update_weights(modality,classifier,{1,4,7}) == 0,
+               "compute_weights and update_weights fail when the batch estimation misses rows") && ok;
+    return ok;
+}
+
+/**
+ * @brief grid of width x height supervoxels of one voxel, labels leaving gaps, 4-connected
+ */
+void grid_supervoxels(int width, int height, ip::SupervoxelArray& supervoxels, ip::AdjacencyMap& adjacency){
+    auto label = [width](int x, int y) -> uint32_t {return 2*(y*width + x) + 1;};
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            pcl::Supervoxel<ip::PointT>::Ptr sv(new pcl::Supervoxel<ip::PointT>);
+            ip::PointT pt;
+            pt.x = x; pt.y = y; pt.z = 0;
+            sv->voxels_->push_back(pt);
+            sv->centroid_ = pt;
+            supervoxels[label(x,y)] = sv;
+            if(x > 0) adjacency.insert(std::make_pair(label(x,y),label(x - 1,y)));
+            if(x < width - 1) adjacency.insert(std::make_pair(label(x,y),label(x + 1,y)));
+            if(y > 0) adjacency.insert(std::make_pair(label(x,y),label(x,y - 1)));
+            if(y < height - 1) adjacency.insert(std::make_pair(label(x,y),label(x,y + 1)));
+        }
+    }
+}
+
+/**
+ * @brief largest difference between the weights of a supervoxel and the update of the diffusion computed from
+ * the weights of its neighbors, i.e. 0 at a fixed point. The update is written again from the definitions.
+ */
+double fixed_point_residual(const ip::FlatSupervoxelArray& svs, const ip::RelevanceMap& initial,
+                            const ip::RelevanceMap& weights, const ip::RelevanceDiffusion::parameters_t& param,
+                            const std::vector<double>& edge_weights){
+    double residual = 0;
+    int nbr_class = weights.nbr_class();
+    for(size_t i = 0; i < svs.size(); i++){
+        int r = weights.row(svs.label(i));
+        if(r < 0)
+            continue;
+        std::vector<double> next(nbr_class);
+        double total = param.unary_weight;
+        for(int c = 0; c < nbr_class; c++)
+            next[c] = param.mode == ip::RelevanceDiffusion::MEAN_FIELD ?
+                        param.unary_weight*std::log(std::max(initial(r,c),1e-12)) : param.unary_weight*initial(r,c);
+        for(const int* n = svs.neighbors_begin(i); n != svs.neighbors_end(i); n++){
+            int rn = weights.row(svs.label(*n));
+            if(rn < 0)
+                continue;
+            double w = param.pairwise_weight*(edge_weights.empty() ? 1. : edge_weights[n - svs.neighbors_begin(0)]);
+            total += w;
+            for(int c = 0; c < nbr_class; c++)
+                next[c] += w*weights(rn,c);
+        }
+        double sum = 0;
+        for(int c = 0; c < nbr_class; c++){
+            if(param.mode == ip::RelevanceDiffusion::MEAN_FIELD)
+                next[c] = std::exp(next[c]);
+            else next[c] /= total;
+            sum += next[c];
+        }
+        for(int c = 0; c < nbr_class; c++){
+            if(param.mode == ip::RelevanceDiffusion::MEAN_FIELD)
+                next[c] /= sum;
+            residual = std::max(residual,std::fabs(next[c] - weights(r,c)));
+        }
+    }
+    return residual;
+}
+
+bool test_relevance_diffusion(){
+    boost::random::mt19937 gen(4);
+    boost::random::uniform_real_distribution<> dist(0.,1.);
+    ip::SupervoxelArray supervoxels;
+    ip::AdjacencyMap adjacency;
+    grid_supervoxels(12,9,supervoxels,adjacency);
+    ip::FlatSupervoxelArray svs;
+    svs.build(supervoxels,adjacency);
+
+    //one supervoxel out of 7 without weights, 3 classes normalized
+    std::vector<uint32_t> lbls;
+    for(size_t i = 0; i < svs.size(); i++)
+        if(i % 7 != 3)
+            lbls.push_back(svs.label(i));
+    ip::RelevanceMap initial;
+    initial.reset(lbls,3,0.);
+    for(size_t r = 0; r < initial.size(); r++){
+        for(int c = 0; c < 3; c++)
+            initial(r,c) = 0.05 + dist(gen);
+        initial.matrix().row(r) /= initial.matrix().row(r).sum();
+    }
+    std::vector<double> edge_weights(svs.neighbors_end(svs.size() - 1) - svs.neighbors_begin(0));
+    for(double& w : edge_weights)
+        w = 0.1 + dist(gen);
+
+    bool ok = true;
+    for(bool with_edge_weights : {false,true}){
+        const std::string config = with_edge_weights ? ", edge weights" : ", uniform edges";
+        for(ip::RelevanceDiffusion::mode_t mode : {ip::RelevanceDiffusion::AVERAGING,ip::RelevanceDiffusion::MEAN_FIELD}){
+            const std::string name = mode == ip::RelevanceDiffusion::AVERAGING ? "AVERAGING" : "MEAN_FIELD";
+            ip::RelevanceDiffusion::parameters_t param;
+            param.mode = mode;
+            param.max_iterations = 1000;
+            param.tolerance = 1e-12;
+            param.pairwise_weight = 0.5;
+            ip::RelevanceDiffusion diffusion(param);
+            if(with_edge_weights)
+                diffusion.set_edge_weights(edge_weights);
+
+            ip::RelevanceMap weights = initial;
+            int iterations = diffusion.run(svs,weights);
+            double residual = fixed_point_residual(svs,initial,weights,param,
+                                                   with_edge_weights ? edge_weights : std::vector<double>());
+            ok = check(weights.labels() == initial.labels() && iterations < param.max_iterations && residual < 1e-10,
+                       name + " reaches a fixed point in " + std::to_string(iterations) + " sweeps" + config) && ok;
+            if(mode == ip::RelevanceDiffusion::MEAN_FIELD){
+                double sum_error = (weights.matrix().rowwise().sum().array() - 1.).abs().maxCoeff();
+                ok = check(sum_error < 1e-12,"MEAN_FIELD rows sum to 1" + config) && ok;
+            }
+
+            //early stop : a loose tolerance stops before a null one, which does all the sweeps
+            param.tolerance = 1e-3;
+            diffusion.parameters() = param;
+            weights = initial;
+            int loose = diffusion.run(svs,weights);
+            param.tolerance = 0;
+            param.max_iterations = 50;
+            diffusion.parameters() = param;
+            weights = initial;
+            int none = diffusion.run(svs,weights);
+            ok = check(loose < iterations && none == 50,name + " stops on the tolerance" + config) && ok;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief weights as stored before the dense relevance maps : the probabilities of each label.
+ * The reference algorithms below are the map based ones.
+ */
+typedef std::map<uint32_t,std::vector<double>> map_weights_t;
+
+map_weights_t to_map(const ip::RelevanceMap& weights){
+    map_weights_t map;
+    for(size_t r = 0; r < weights.size(); r++)
+        map[weights.label(r)] = std::vector<double>(weights.matrix().row(r).data(),
+                                                    weights.matrix().row(r).data() + weights.nbr_class());
+    return map;
+}
+
+void reference_neighbor_bluring(const ip::SupervoxelArray& supervoxels, const ip::AdjacencyMap& adjacency,
+                                map_weights_t& map, double cst, int lbl){
+    map_weights_t weights = map;
+    for(auto it_sv = supervoxels.begin(); it_sv != supervoxels.end(); it_sv++){
+        auto neighbors = adjacency.equal_range(it_sv->first);
+        for(auto adj_it = neighbors.first; adj_it != neighbors.second; adj_it++){
+            if(map[adj_it->second][lbl] >= 0.5)
+                weights[adj_it->first][lbl] += cst;
+            if(weights[adj_it->first][lbl] >= 1.)
+                weights[adj_it->first][lbl] = 1.;
+            else if(weights[adj_it->first][lbl] <= 0.)
+                weights[adj_it->first][lbl] = 0.;
+        }
+    }
+    map = weights;
+}
+
+void reference_adaptive_threshold(const ip::SupervoxelArray& supervoxels, const ip::AdjacencyMap& adjacency,
+                                  map_weights_t& map, int lbl){
+    map_weights_t weights = map;
+    for(auto it_sv = supervoxels.begin(); it_sv != supervoxels.end(); it_sv++){
+        auto neighbors = adjacency.equal_range(it_sv->first);
+        double avg = map[it_sv->first][lbl];
+        double tot = 1;
+        for(auto adj_it = neighbors.first; adj_it != neighbors.second; adj_it++){
+            avg += map[adj_it->second][lbl];
+            tot += 1.;
+        }
+        avg = avg/tot;
+        if(avg >= 0.5 && map[it_sv->first][lbl] >= avg)
+            weights[it_sv->first][lbl] = 1.;
+        else weights[it_sv->first][lbl] = 0.;
+    }
+    map = weights;
+}
+
+bool test_bluring_and_threshold(){
+    boost::random::mt19937 gen(5);
+    boost::random::uniform_real_distribution<> dist(0.,1.);
+    ip::SupervoxelArray supervoxels;
+    ip::AdjacencyMap adjacency;
+    grid_supervoxels(15,10,supervoxels,adjacency);
+
+    const std::string modality = "toy";
+    ip::SurfaceOfInterest soi;
+    for(const auto& sv : supervoxels){
+        std::vector<uint32_t> neighbors;
+        auto range = adjacency.equal_range(sv.first);
+        for(auto it = range.first; it != range.second; ++it)
+            neighbors.push_back(it->second);
+        soi.insert(sv.first,sv.second,neighbors);
+    }
+    soi.init_weights(modality,2,0.);
+    for(const auto& sv : supervoxels){
+        double p = dist(gen);
+        soi.set_weight(modality,sv.first,0,1. - p);
+        soi.set_weight(modality,sv.first,1,p);
+    }
+    map_weights_t reference = to_map(soi.get_weights().at(modality));
+
+    bool ok = true;
+    for(double cst : {0.1,-0.3}){
+        soi.neighbor_bluring(modality,cst,1);
+        reference_neighbor_bluring(supervoxels,adjacency,reference,cst,1);
+        ok = check(to_map(soi.get_weights().at(modality)) == reference,
+                   "SurfaceOfInterest::neighbor_bluring against the map based algorithm, cst = " + std::to_string(cst)) && ok;
+    }
+    soi.adaptive_threshold(modality,1);
+    reference_adaptive_threshold(supervoxels,adjacency,reference,1);
+    ok = check(to_map(soi.get_weights().at(modality)) == reference,
+               "SurfaceOfInterest::adaptive_threshold against the map based algorithm") && ok;
+    return ok;
+}
+
+}
+
+int main(int argc, char **argv){
+    bool ok = true;
+    ok = test_weighted_sampler() && ok;
+    ok = test_histogram_distance_nan() && ok;
+    ok = test_connected_components() && ok;
+    ok = test_bin_values() && ok;
+    ok = test_color_conversions() && ok;
+    ok = test_background_model() && ok;
+    ok = test_update_weights() && ok;
+    ok = test_batch_estimation() && ok;
+    ok = test_relevance_diffusion() && ok;
+    ok = test_bluring_and_threshold() && ok;
+
+    std::cout << (ok ? "all checks passed" : "some checks FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
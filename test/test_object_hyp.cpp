@@ -114,8 +114,8 @@ int main(int argc, char **argv) {
         }
 
         ip::SupervoxelArray supervoxels = soi.getSupervoxels();
-        ip::SurfaceOfInterest::relevance_map_t weights_for_this_modality =
-            soi.get_weights()[modality];
+        const ip::SurfaceOfInterest::relevance_map_t& weights_for_this_modality =
+            soi.get_weights().at(modality);
 
         /* Draw all supervoxels points in various colors. */
 
@@ -128,7 +128,7 @@ int main(int argc, char **argv) {
              it_sv++) {
             int current_sv_label = it_sv->first;
             pcl::Supervoxel<ip::PointT>::Ptr current_sv = it_sv->second;
-            float c = weights_for_this_modality[it_sv->first][lbl];
+            float c = weights_for_this_modality.weight(it_sv->first,lbl);
 
             if (c < 0.5) {
                 // std::cout << " skipping sv of label " << current_sv_label <<
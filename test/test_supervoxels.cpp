@@ -0,0 +1,323 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <unordered_set>
+
+#include <pcl/io/pcd_io.h>
+
+#include "../include/image_processing/SupervoxelSet.h"
+#include "../include/image_processing/ParallelSupervoxelClustering.h"
+#include "../include/image_processing/voxel_key.hpp"
+#include "../include/image_processing/default_parameters.hpp"
+
+namespace ip = image_processing;
+typedef ip::parameters::supervoxel param;
+
+/**
+ * Checks of the supervoxel clustering on a pcd file (e.g. data/cloud.pcd).
+ * The program returns 1 if a check fails.
+ */
+
+namespace {
+
+bool check(bool ok, const std::string& what){
+    std::cout << (ok ? "[ok] " : "[FAILED] ") << what << std::endl;
+    return ok;
+}
+
+/**
+ * @brief workspace containing the whole cloud
+ */
+ip::workspace_t whole_workspace(const ip::PointCloudT& cloud){
+    std::vector<double> area = {1e9,-1e9,1e9,-1e9,1e9,-1e9};
+    for(const auto& pt : cloud){
+        area[0] = std::min<double>(area[0],pt.x - 1); area[1] = std::max<double>(area[1],pt.x + 1);
+        area[2] = std::min<double>(area[2],pt.y - 1); area[3] = std::max<double>(area[3],pt.y + 1);
+        area[4] = std::min<double>(area[4],pt.z - 1); area[5] = std::max<double>(area[5],pt.z + 1);
+    }
+    return ip::workspace_t(false,0,0,0,0,0,area);
+}
+
+/**
+ * @brief is every voxel of a set of supervoxels within max_cells voxel cells of a voxel of another set ?
+ */
+bool covered(const ip::SupervoxelArray& supervoxels, const ip::SupervoxelArray& by, int max_cells){
+    float inv_res = 1./param::voxel_resolution;
+    std::unordered_set<uint64_t> cells;
+    for(const auto& sv : by)
+        for(const auto& pt : *(sv.second->voxels_))
+            cells.insert(ip::tools::cell_key(pt.x,pt.y,pt.z,inv_res));
+    for(const auto& sv : supervoxels){
+        for(const auto& pt : *(sv.second->voxels_)){
+            Eigen::Vector3i c = ip::tools::cell_of(pt.x,pt.y,pt.z,inv_res);
+            bool found = false;
+            for(int i = -max_cells; i <= max_cells && !found; i++)
+                for(int j = -max_cells; j <= max_cells && !found; j++)
+                    for(int k = -max_cells; k <= max_cells && !found; k++)
+                        found = cells.count(ip::tools::cell_key(c + Eigen::Vector3i(i,j,k)));
+            if(!found)
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief fraction of the points of a cloud lying in a voxel of a set of supervoxels
+ */
+double coverage(const ip::PointCloudT& cloud, const ip::SupervoxelArray& supervoxels){
+    size_t nbr_points = 0, nbr_covered = 0;
+    float inv_res = 1./param::voxel_resolution;
+    std::unordered_set<uint64_t> cells;
+    for(const auto& sv : supervoxels)
+        for(const auto& pt : *(sv.second->voxels_))
+            cells.insert(ip::tools::cell_key(pt.x,pt.y,pt.z,inv_res));
+    for(const auto& pt : cloud){
+        if(!std::isfinite(pt.x) || !std::isfinite(pt.y) || !std::isfinite(pt.z))
+            continue;
+        nbr_points++;
+        //a point and the centroid of its voxel are less than one cell apart on each axis
+        Eigen::Vector3i c = ip::tools::cell_of(pt.x,pt.y,pt.z,inv_res);
+        bool found = false;
+        for(int i = -1; i <= 1 && !found; i++)
+            for(int j = -1; j <= 1 && !found; j++)
+                for(int k = -1; k <= 1 && !found; k++)
+                    found = cells.count(ip::tools::cell_key(c + Eigen::Vector3i(i,j,k)));
+        nbr_covered += found;
+    }
+    return nbr_points ? nbr_covered/(double)nbr_points : 1.;
+}
+
+/**
+ * @brief does every adjacency go both ways between existing supervoxels ?
+ */
+bool symmetric_adjacency(const ip::SupervoxelArray& supervoxels, const ip::AdjacencyMap& adjacency){
+    for(const auto& adj : adjacency){
+        if(adj.first == adj.second || !supervoxels.count(adj.first) || !supervoxels.count(adj.second))
+            return false;
+        bool back = false;
+        auto range = adjacency.equal_range(adj.second);
+        for(auto it = range.first; it != range.second && !back; ++it)
+            back = it->second == adj.first;
+        if(!back)
+            return false;
+    }
+    return true;
+}
+
+bool test_incremental_update(const ip::PointCloudT& cloud, bool parallel_clustering){
+    const std::string config = parallel_clustering ? " (ParallelSupervoxelClustering)" : " (pcl::SupervoxelClustering)";
+    ip::workspace_t workspace = whole_workspace(cloud);
+
+    ip::SupervoxelSet incremental;
+    incremental.setParallelClustering(parallel_clustering);
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(cloud)));
+    incremental.updateSupervoxel(workspace);
+    ip::SupervoxelArray previous = incremental.getSupervoxels();
+    uint32_t max_label = previous.rbegin()->first;
+
+    //same frame : nothing to re-cluster
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(cloud)));
+    incremental.updateSupervoxel(workspace);
+    bool same = incremental.getSupervoxels().size() == previous.size();
+    for(const auto& sv : incremental.getSupervoxels())
+        same = same && previous.count(sv.first) && previous[sv.first]->voxels_->size() == sv.second->voxels_->size();
+    bool ok = check(same,"updateSupervoxel keeps the labels of an unchanged frame" + config);
+
+    //small change : the points within radius of a point of the cloud are moved by shift along x
+    const float radius = 0.05, shift = 0.04;
+    Eigen::Vector3f center = cloud.points[cloud.size()/2].getVector3fMap();
+    ip::PointCloudT::Ptr changed(new ip::PointCloudT(cloud));
+    for(auto& pt : *changed)
+        if((pt.getVector3fMap() - center).norm() < radius)
+            pt.x += shift;
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(*changed)));
+    incremental.updateSupervoxel(workspace);
+    ip::SupervoxelArray updated = incremental.getSupervoxels();
+
+    ip::SupervoxelSet full;
+    full.setParallelClustering(parallel_clustering);
+    full.setInputCloud(changed);
+    full.computeSupervoxel(workspace);
+    ip::SupervoxelArray recomputed = full.getSupervoxels();
+
+    //supervoxels far from the change (beyond the dilated changed cells) keep their label and their voxels,
+    //the other ones are replaced by supervoxels with new labels
+    const float far = radius + shift + 0.1;
+    bool stable = true, new_labels = true;
+    for(const auto& sv : previous){
+        bool is_far = true;
+        for(const auto& pt : *(sv.second->voxels_))
+            is_far = is_far && (pt.getVector3fMap() - center).norm() > far;
+        if(is_far)
+            stable = stable && updated.count(sv.first) && updated[sv.first]->voxels_->size() == sv.second->voxels_->size();
+    }
+    for(const auto& sv : updated)
+        new_labels = new_labels && (previous.count(sv.first) || sv.first > max_label);
+    ok = check(stable,"updateSupervoxel keeps the supervoxels away from the change" + config) && ok;
+    ok = check(new_labels,"updateSupervoxel gives new labels to the re-clustered supervoxels" + config) && ok;
+    ok = check(symmetric_adjacency(updated,incremental.getAdjacencyMap()),
+               "updateSupervoxel adjacency is symmetric" + config) && ok;
+
+    //against the full recompute of the changed frame : same surface and a close number of supervoxels.
+    //The points within one voxel cell of a stable voxel are left out of the re-clustering, and the voxels are
+    //centroids, hence a tolerance of 3 cells.
+    ok = check(covered(recomputed,updated,3) && covered(updated,recomputed,3),
+               "updateSupervoxel covers the same voxels as a full recompute" + config) && ok;
+    double ratio = updated.size()/(double)recomputed.size();
+    ok = check(ratio > 0.85 && ratio < 1.15,"updateSupervoxel gives " + std::to_string(updated.size()) +
+               " supervoxels, full recompute " + std::to_string(recomputed.size()) + config) && ok;
+    return ok;
+}
+
+/**
+ * @brief an object leaves the scene then comes back : the labels removed with it must not be given again
+ */
+bool test_remove_then_add(const ip::PointCloudT& cloud, bool parallel_clustering){
+    const std::string config = parallel_clustering ? " (ParallelSupervoxelClustering)" : " (pcl::SupervoxelClustering)";
+    ip::workspace_t workspace = whole_workspace(cloud);
+
+    //a 10cm square patch 30cm above the highest point of the cloud, far from any other change cell
+    Eigen::Vector3f center(0,0,-1e9);
+    for(const auto& pt : cloud){
+        center.x() += pt.x/cloud.size(); center.y() += pt.y/cloud.size();
+        center.z() = std::max(center.z(),pt.z);
+    }
+    center.z() += 0.3;
+    ip::PointCloudT::Ptr with_object(new ip::PointCloudT(cloud));
+    for(int i = -20; i <= 20; i++){
+        for(int j = -20; j <= 20; j++){
+            ip::PointT pt = cloud.points[0];
+            pt.x = center.x() + i*0.0025; pt.y = center.y() + j*0.0025; pt.z = center.z();
+            pt.r = 200; pt.g = 30; pt.b = 30;
+            with_object->push_back(pt);
+        }
+    }
+
+    ip::SupervoxelSet incremental;
+    incremental.setParallelClustering(parallel_clustering);
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(cloud)));
+    incremental.updateSupervoxel(workspace);
+
+    //the object appears : it gets the highest labels
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(*with_object)));
+    incremental.updateSupervoxel(workspace);
+    uint32_t max_label = incremental.getSupervoxels().rbegin()->first;
+    size_t nbr_with_object = incremental.getSupervoxels().size();
+
+    //the object leaves : its supervoxels are removed and none is created
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(cloud)));
+    incremental.updateSupervoxel(workspace);
+    ip::SupervoxelArray without_object = incremental.getSupervoxels();
+    bool ok = check(without_object.size() < nbr_with_object && without_object.rbegin()->first < max_label,
+                    "updateSupervoxel removes the supervoxels of an object leaving the scene" + config);
+
+    //the object comes back : its supervoxels get labels never given before
+    incremental.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(*with_object)));
+    incremental.updateSupervoxel(workspace);
+    bool new_labels = incremental.getSupervoxels().size() > without_object.size();
+    for(const auto& sv : incremental.getSupervoxels())
+        new_labels = new_labels && (without_object.count(sv.first) || sv.first > max_label);
+    ok = check(new_labels,"updateSupervoxel does not reuse the labels of removed supervoxels" + config) && ok;
+    return ok;
+}
+
+/**
+ * @brief a feature computed by a previous call of compute_feature is reused by the next ones,
+ * until the set changes
+ */
+bool test_feature_reuse(const ip::PointCloudT& cloud){
+    ip::SupervoxelSet soi;
+    soi.setParallelClustering(true);
+    soi.setInputCloud(ip::PointCloudT::Ptr(new ip::PointCloudT(cloud)));
+    ip::workspace_t workspace = whole_workspace(cloud);
+    soi.computeSupervoxel(workspace);
+    if(soi.getSupervoxels().size() < 2)
+        return check(false,"compute_feature reuses the features already computed");
+    uint32_t lbl = soi.getSupervoxels().begin()->first;
+
+    //a marked colorLabHist is kept, so colora is derived from it
+    soi.compute_feature("colorL");
+    Eigen::VectorXd mark = Eigen::VectorXd::Constant(15,7);
+    soi.set_feature("colorLabHist",lbl,mark);
+    soi.compute_feature("colora");
+    bool ok = check(soi.get_feature(lbl,"colora") == mark.segment(5,5),
+                    "compute_feature reuses the features already computed");
+
+    //once the set changed, colorLabHist is computed again
+    soi.remove(soi.getSupervoxels().rbegin()->first);
+    soi.compute_feature("colora");
+    ok = check(soi.get_feature(lbl,"colora") != mark.segment(5,5) &&
+               soi.get_feature(lbl,"colorLabHist") != mark,
+               "compute_feature computes the features again after a change of the set") && ok;
+    return ok;
+}
+
+bool test_parallel_clustering(const ip::PointCloudT::Ptr& cloud){
+    ip::SupervoxelArray reference, supervoxels;
+    ip::AdjacencyMap reference_adjacency, adjacency;
+
+    pcl::SupervoxelClustering<ip::PointT> pcl_extractor(param::voxel_resolution,param::seed_resolution);
+    pcl_extractor.setColorImportance(param::color_importance);
+    pcl_extractor.setSpatialImportance(param::spatial_importance);
+    pcl_extractor.setNormalImportance(param::normal_importance);
+    pcl_extractor.setInputCloud(cloud);
+    pcl_extractor.extract(reference);
+    pcl_extractor.getSupervoxelAdjacency(reference_adjacency);
+
+    ip::ParallelSupervoxelClustering extractor(param::voxel_resolution,param::seed_resolution);
+    extractor.setColorImportance(param::color_importance);
+    extractor.setSpatialImportance(param::spatial_importance);
+    extractor.setNormalImportance(param::normal_importance);
+    extractor.setInputCloud(cloud);
+    extractor.extract(supervoxels);
+    extractor.getSupervoxelAdjacency(adjacency);
+
+    double ratio = supervoxels.size()/(double)reference.size();
+    bool ok = check(ratio > 0.85 && ratio < 1.15,"ParallelSupervoxelClustering gives " + std::to_string(supervoxels.size()) +
+                    " supervoxels, pcl::SupervoxelClustering " + std::to_string(reference.size()));
+
+    double cover = coverage(*cloud,supervoxels), reference_cover = coverage(*cloud,reference);
+    ok = check(cover >= reference_cover - 0.005,"ParallelSupervoxelClustering covers " + std::to_string(cover) +
+               " of the points, pcl::SupervoxelClustering " + std::to_string(reference_cover)) && ok;
+
+    //one voxel per occupied cell, in one supervoxel at most
+    std::unordered_set<uint64_t> cells;
+    float inv_res = 1.f/param::voxel_resolution;
+    for(const auto& pt : *cloud)
+        if(std::isfinite(pt.x) && std::isfinite(pt.y) && std::isfinite(pt.z))
+            cells.insert(ip::tools::cell_key(pt.x,pt.y,pt.z,inv_res));
+    size_t nbr_voxels = 0;
+    for(const auto& sv : supervoxels)
+        nbr_voxels += sv.second->voxels_->size();
+    ok = check(nbr_voxels <= cells.size(),"ParallelSupervoxelClustering puts each voxel in one supervoxel at most") && ok;
+
+    ok = check(symmetric_adjacency(supervoxels,adjacency),"ParallelSupervoxelClustering adjacency is symmetric") && ok;
+    return ok;
+}
+
+}
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        std::cerr << "Usage : \n\t- pcd file (e.g. data/cloud.pcd)" << std::endl;
+        return 1;
+    }
+
+    ip::PointCloudT::Ptr cloud(new ip::PointCloudT);
+    if(pcl::io::loadPCDFile(argv[1], *cloud) < 0 || cloud->empty()){
+        std::cerr << "Unable to load " << argv[1] << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+    ok = test_incremental_update(*cloud,false) && ok;
+    ok = test_incremental_update(*cloud,true) && ok;
+    ok = test_remove_then_add(*cloud,false) && ok;
+    ok = test_remove_then_add(*cloud,true) && ok;
+    ok = test_feature_reuse(*cloud) && ok;
+    ok = test_parallel_clustering(cloud) && ok;
+
+    std::cout << (ok ? "all checks passed" : "some checks FAILED") << std::endl;
+    return ok ? 0 : 1;
+}